@@ -26,6 +26,8 @@ enum class ErrorCode
     InvalidValueType,             //!< Invalid type of the value in the particular context
     InvalidTemplateName,          //!< Invalid name of the template. ExtraParams[0] contains the name
     MetadataParseError,           //!< Invalid name of the template. ExtraParams[0] contains the name
+    BlockNotFound,                //!< Block with the specified name was not found in the template. ExtraParams[0] contains the name
+    RenderLimitExceeded,          //!< Rendering was aborted because one of the Settings::RenderLimits was exceeded. ExtraParams[0] contains the limit name
     ExpectedStringLiteral = 1001, //!< String literal expected
     ExpectedIdentifier,           //!< Identifier expected
     ExpectedSquareBracket,        //!< ']' expected
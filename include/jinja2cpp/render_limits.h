@@ -0,0 +1,19 @@
+#ifndef JINJA2CPP_RENDER_LIMITS_H
+#define JINJA2CPP_RENDER_LIMITS_H
+
+#include <chrono>
+#include <cstddef>
+
+namespace jinja2
+{
+/// Resources limits for the single template rendering. Zero value means that the corresponding resource isn't limited
+struct RenderLimits
+{
+    std::size_t maxOutputSize = 0;        //!< Maximum size of the rendered output (in characters), including the output captured by blocks and macro calls
+    std::size_t maxLoopIterations = 0;    //!< Maximum total number of the `for` loops iterations
+    std::size_t maxCallDepth = 0;         //!< Maximum nesting depth of the macro calls, recursive loops and included templates
+    std::chrono::milliseconds timeout{0}; //!< Maximum wall-clock duration of the rendering
+};
+} // namespace jinja2
+
+#endif // JINJA2CPP_RENDER_LIMITS_H
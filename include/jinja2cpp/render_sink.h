@@ -0,0 +1,74 @@
+#ifndef JINJA2CPP_RENDER_SINK_H
+#define JINJA2CPP_RENDER_SINK_H
+
+#include "config.h"
+
+#include <nonstd/string_view.hpp>
+
+#include <cstdint>
+#include <cstddef>
+
+namespace jinja2
+{
+template<typename CharT>
+/*!
+ * \brief Generic interface to the template output consumers (sinks)
+ *
+ * This interface should be implemented in order to receive rendered template output without the intermediate string or stream object. For
+ * instance, it allows to render template directly into the network buffer or memory-mapped file. Template engine calls the sink methods
+ * in the order of the output, so concatenation of all received pieces forms the rendered document.
+ *
+ * Numeric values are passed to the sink as is, so the sink is responsible for its formatting. Default rendering of the floating-point values
+ * corresponds to the `{:.8g}` format.
+ *
+ * Output of the constant string and boolean expressions (like `{{ 'text' }}` or `{{ "a" ~ "b" }}`) is merged with the template text at
+ * load time, so it's passed to the WriteBuffer method. Numeric values are always passed to WriteInteger or WriteDouble, even if they are
+ * calculated at load time (like `{{ 40 + 2 }}`).
+ *
+ * Exact specialization of IRenderSinkTpl depends on type of the template object: \ref IRenderSink for \ref Template and \ref IRenderSinkW
+ * for \ref TemplateW.
+ *
+ * @tparam CharT Character type of the rendered output
+ */
+class IRenderSinkTpl
+{
+public:
+    //! Destructor
+    virtual ~IRenderSinkTpl() = default;
+
+    /*!
+     * \brief Method is called to write the piece of the raw template text
+     *
+     * Pointed characters are valid only during the call.
+     *
+     * @param ptr    Pointer to the characters to write
+     * @param length Number of characters to write
+     */
+    virtual void WriteBuffer(const CharT* ptr, std::size_t length) = 0;
+    /*!
+     * \brief Method is called to write the integer value produced by the template expression
+     *
+     * @param val Value to write
+     */
+    virtual void WriteInteger(int64_t val) = 0;
+    /*!
+     * \brief Method is called to write the floating-point value produced by the template expression
+     *
+     * @param val Value to write
+     */
+    virtual void WriteDouble(double val) = 0;
+    /*!
+     * \brief Method is called to write the string value produced by the template expression
+     *
+     * Viewed string is valid only during the call.
+     *
+     * @param str String to write
+     */
+    virtual void WriteString(nonstd::basic_string_view<CharT> str) = 0;
+};
+
+using IRenderSink = IRenderSinkTpl<char>;
+using IRenderSinkW = IRenderSinkTpl<wchar_t>;
+} // jinja2
+
+#endif // JINJA2CPP_RENDER_SINK_H
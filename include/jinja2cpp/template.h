@@ -3,6 +3,7 @@
 
 #include "config.h"
 #include "error_info.h"
+#include "render_sink.h"
 #include "value.h"
 
 #include <nonstd/expected.hpp>
@@ -10,6 +11,7 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace jinja2
 {
@@ -30,6 +32,74 @@ struct MetadataInfo
     SourceLocation location;
 };
 
+/*!
+ * \brief Template output in the form of the ordered list of segments
+ *
+ * Concatenation of all segments forms the rendered document. Segments which correspond to the raw text of the template point directly
+ * to the template source, so they stay valid until the template object is destroyed or reloaded. Rest of the segments point to the
+ * \ref storage string, which is shared between the copies of the object.
+ */
+template<typename CharT>
+struct RenderSegmentsTpl
+{
+    //! Ordered list of the output pieces
+    std::vector<nonstd::basic_string_view<CharT>> segments;
+    //! Storage of the dynamically produced output
+    std::shared_ptr<const std::basic_string<CharT>> storage;
+};
+
+using RenderSegments = RenderSegmentsTpl<char>;
+using RenderSegmentsW = RenderSegmentsTpl<wchar_t>;
+
+template<typename CharT>
+class RenderStateImpl;
+
+/*!
+ * \brief State of the resumable template rendering
+ *
+ * Object is created by \ref Template::StartRender or \ref TemplateW::StartRender and produces the rendered output piece by piece.
+ * Each \ref Resume call renders the next chunk of output and returns control to the caller, so the rendering can be suspended while
+ * the consumer isn't ready to accept the data. Rendering can be resumed on any thread, but not concurrently. Rendering is suspended
+ * between the statements and between the `for` loop iterations, also within the `if` branches and the parent templates. Other statements
+ * (for instance, `include`, `block`, macro calls or `filter` blocks) are rendered at once, so the chunk can exceed the requested size by
+ * the output of the single such statement.
+ *
+ * Exact specialization of RenderStateTpl depends on type of the template object: \ref RenderState for \ref Template and
+ * \ref RenderStateW for \ref TemplateW.
+ *
+ * @tparam CharT Character type of the rendered output
+ */
+template<typename CharT>
+class RenderStateTpl
+{
+public:
+    /*!
+     * \brief Render the next chunk of the output
+     *
+     * Replaces content of the specified string with the next chunk of the rendered output. Once the error occurs, rendering is finished.
+     *
+     * @param chunk String to render the next chunk to
+     *
+     * @return Either noting or instance of \ref ErrorInfoTpl as an error
+     */
+    JINJA2CPP_EXPORT nonstd::expected<void, ErrorInfoTpl<CharT>> Resume(std::basic_string<CharT>& chunk);
+    //! Return true if all output has been rendered
+    JINJA2CPP_EXPORT bool IsFinished() const;
+
+private:
+    explicit RenderStateTpl(std::shared_ptr<RenderStateImpl<CharT>> impl)
+        : m_impl(std::move(impl))
+    {
+    }
+
+    std::shared_ptr<RenderStateImpl<CharT>> m_impl;
+    friend class Template;
+    friend class TemplateW;
+};
+
+using RenderState = RenderStateTpl<char>;
+using RenderStateW = RenderStateTpl<wchar_t>;
+
 /*!
  * \brief Template object which is used to render narrow char templates
  *
@@ -119,7 +189,9 @@ public:
     /*!
      * \brief Render previously loaded template to the narrow char stream
      *
-     * Renders previously loaded template to the specified narrow char stream and specified set of params.
+     * Renders previously loaded template to the specified narrow char stream and specified set of params. Output is
+     * written to the stream in fixed-size chunks as soon as it is produced, so memory consumption doesn't depend on
+     * the size of the rendered document. In case of error the stream contains partially rendered output.
      *
      * @param os      Stream to render template to
      * @param params  Set of params which should be passed to the template engine and can be used within the template
@@ -127,6 +199,31 @@ public:
      * @return Either noting or instance of \ref ErrorInfoTpl as an error
      */
     Result<void> Render(std::ostream& os, const ValuesMap& params);
+    /*!
+     * \brief Render previously loaded template to the narrow char stream
+     *
+     * Same as the previous overload, but also reports the number of characters which were written to the stream.
+     * In case of error it's the size of the partially rendered output.
+     *
+     * @param os          Stream to render template to
+     * @param params      Set of params which should be passed to the template engine and can be used within the template
+     * @param emittedSize Number of characters written to the stream
+     *
+     * @return Either noting or instance of \ref ErrorInfoTpl as an error
+     */
+    Result<void> Render(std::ostream& os, const ValuesMap& params, std::size_t& emittedSize);
+    /*!
+     * \brief Render previously loaded template to the custom output sink
+     *
+     * Renders previously loaded template with specified set of params and passes the output pieces directly to the specified sink object
+     * without any intermediate buffering. Raw template text, string and numeric values are passed to the different sink methods.
+     *
+     * @param sink    Sink object to render template to
+     * @param params  Set of params which should be passed to the template engine and can be used within the template
+     *
+     * @return Either noting or instance of \ref ErrorInfoTpl as an error
+     */
+    Result<void> Render(IRenderSink& sink, const ValuesMap& params);
     /*!
      * \brief Render previously loaded template to the narrow char string
      *
@@ -137,6 +234,77 @@ public:
      * @return Either rendered string or instance of \ref ErrorInfoTpl as an error
      */
     Result<std::string> RenderAsString(const ValuesMap& params);
+    /*!
+     * \brief Render previously loaded template to the existing narrow char string
+     *
+     * Renders previously loaded template with specified set of params and replaces content of the specified string with the result.
+     * Capacity of the string is preserved, so the same buffer can be reused for the series of renders without reallocations.
+     *
+     * @param buffer  String to render template to
+     * @param params  Set of params which should be passed to the template engine and can be used within the template
+     *
+     * @return Either noting or instance of \ref ErrorInfoTpl as an error
+     */
+    Result<void> RenderAsString(std::string& buffer, const ValuesMap& params);
+    /*!
+     * \brief Render previously loaded template to the narrow char string and calculate hash of the result
+     *
+     * Renders previously loaded template as a narrow char string and with specified set of params. 64-bit XXH64 hash (seed 0) of the
+     * rendered characters is calculated during the rendering, without the extra pass over the result. Characters are hashed as a byte
+     * sequence in the native byte order. Hash can be used as the ETag or for the change detection.
+     *
+     * @param params     Set of params which should be passed to the template engine and can be used within the template
+     * @param outputHash Hash of the rendered output
+     *
+     * @return Either rendered string or instance of \ref ErrorInfoTpl as an error
+     */
+    Result<std::string> RenderAsString(const ValuesMap& params, uint64_t& outputHash);
+    /*!
+     * \brief Render previously loaded template as a list of the output segments
+     *
+     * Renders previously loaded template with specified set of params. Raw template text isn't copied to the result, corresponding
+     * segments refer to the template source instead, as well as the static text which is merged at load time. Result can be passed to
+     * the scatter-gather output functions (like `writev`).
+     *
+     * @param params  Set of params which should be passed to the template engine and can be used within the template
+     *
+     * @return Either rendered segments or instance of \ref ErrorInfoTpl as an error
+     */
+    Result<RenderSegments> RenderAsSegments(const ValuesMap& params);
+    /*!
+     * \brief Render the single named block of the previously loaded template
+     *
+     * Renders only the block with the specified name and specified set of params. If the template extends other templates, the block is
+     * resolved through the whole inheritance chain, including the `super()` calls. Rest of the template isn't evaluated.
+     *
+     * @param blockName Name of the block to render
+     * @param params    Set of params which should be passed to the template engine and can be used within the template
+     *
+     * @return Either rendered block or instance of \ref ErrorInfoTpl as an error
+     */
+    Result<std::string> RenderBlock(const std::string& blockName, const ValuesMap& params);
+    /*!
+     * \brief Get the static prefix of the previously loaded template output
+     *
+     * Returns the longest beginning of the rendered output which doesn't depend on the render params, for instance, the static
+     * `<head>` section of the HTML page. It can be sent to the consumer before the params are ready. For templates which extend other
+     * templates the prefix of the whole inheritance chain is returned. Output of the full render always starts with this prefix.
+     *
+     * @return Either static prefix of the output or instance of \ref ErrorInfoTpl as an error
+     */
+    Result<std::string> GetStaticPrefix();
+    /*!
+     * \brief Start resumable rendering of the previously loaded template
+     *
+     * Prepares the render state object for the previously loaded template and specified set of params. Params are copied to the state, so
+     * they don't need to outlive it. Output is produced by the subsequent \ref RenderStateTpl::Resume calls.
+     *
+     * @param params     Set of params which should be passed to the template engine and can be used within the template
+     * @param chunkSize  Size of the output chunk after which rendering is suspended
+     *
+     * @return Either render state object or instance of \ref ErrorInfoTpl as an error
+     */
+    Result<RenderState> StartRender(const ValuesMap& params, std::size_t chunkSize = 0x1000);
     /*!
      * \brief Get metadata, provided in the {% meta %} tag
      *
@@ -153,6 +321,7 @@ public:
 private:
     std::shared_ptr<ITemplateImpl> m_impl;
     friend class TemplateImpl<char>;
+    friend class TemplateEnv;
 };
 
 /*!
@@ -244,7 +413,9 @@ public:
     /*!
      * \brief Render previously loaded template to the wide char stream
      *
-     * Renders previously loaded template to the specified wide char stream and specified set of params.
+     * Renders previously loaded template to the specified wide char stream and specified set of params. Output is
+     * written to the stream in fixed-size chunks as soon as it is produced, so memory consumption doesn't depend on
+     * the size of the rendered document. In case of error the stream contains partially rendered output.
      *
      * @param os      Stream to render template to
      * @param params  Set of params which should be passed to the template engine and can be used within the template
@@ -252,6 +423,31 @@ public:
      * @return Either noting or instance of \ref ErrorInfoTpl as an error
      */
     ResultW<void> Render(std::wostream& os, const ValuesMap& params);
+    /*!
+     * \brief Render previously loaded template to the wide char stream
+     *
+     * Same as the previous overload, but also reports the number of characters which were written to the stream.
+     * In case of error it's the size of the partially rendered output.
+     *
+     * @param os          Stream to render template to
+     * @param params      Set of params which should be passed to the template engine and can be used within the template
+     * @param emittedSize Number of characters written to the stream
+     *
+     * @return Either noting or instance of \ref ErrorInfoTpl as an error
+     */
+    ResultW<void> Render(std::wostream& os, const ValuesMap& params, std::size_t& emittedSize);
+    /*!
+     * \brief Render previously loaded template to the custom output sink
+     *
+     * Renders previously loaded template with specified set of params and passes the output pieces directly to the specified sink object
+     * without any intermediate buffering. Raw template text, string and numeric values are passed to the different sink methods.
+     *
+     * @param sink    Sink object to render template to
+     * @param params  Set of params which should be passed to the template engine and can be used within the template
+     *
+     * @return Either noting or instance of \ref ErrorInfoTpl as an error
+     */
+    ResultW<void> Render(IRenderSinkW& sink, const ValuesMap& params);
     /*!
      * \brief Render previously loaded template to the wide char string
      *
@@ -262,6 +458,77 @@ public:
      * @return Either rendered string or instance of \ref ErrorInfoTpl as an error
      */
     ResultW<std::wstring> RenderAsString(const ValuesMap& params);
+    /*!
+     * \brief Render previously loaded template to the existing wide char string
+     *
+     * Renders previously loaded template with specified set of params and replaces content of the specified string with the result.
+     * Capacity of the string is preserved, so the same buffer can be reused for the series of renders without reallocations.
+     *
+     * @param buffer  String to render template to
+     * @param params  Set of params which should be passed to the template engine and can be used within the template
+     *
+     * @return Either noting or instance of \ref ErrorInfoTpl as an error
+     */
+    ResultW<void> RenderAsString(std::wstring& buffer, const ValuesMap& params);
+    /*!
+     * \brief Render previously loaded template to the wide char string and calculate hash of the result
+     *
+     * Renders previously loaded template as a wide char string and with specified set of params. 64-bit XXH64 hash (seed 0) of the
+     * rendered characters is calculated during the rendering, without the extra pass over the result. Characters are hashed as a byte
+     * sequence in the native byte order. Hash can be used as the ETag or for the change detection.
+     *
+     * @param params     Set of params which should be passed to the template engine and can be used within the template
+     * @param outputHash Hash of the rendered output
+     *
+     * @return Either rendered string or instance of \ref ErrorInfoTpl as an error
+     */
+    ResultW<std::wstring> RenderAsString(const ValuesMap& params, uint64_t& outputHash);
+    /*!
+     * \brief Render previously loaded template as a list of the output segments
+     *
+     * Renders previously loaded template with specified set of params. Raw template text isn't copied to the result, corresponding
+     * segments refer to the template source instead, as well as the static text which is merged at load time. Result can be passed to
+     * the scatter-gather output functions (like `writev`).
+     *
+     * @param params  Set of params which should be passed to the template engine and can be used within the template
+     *
+     * @return Either rendered segments or instance of \ref ErrorInfoTpl as an error
+     */
+    ResultW<RenderSegmentsW> RenderAsSegments(const ValuesMap& params);
+    /*!
+     * \brief Render the single named block of the previously loaded template
+     *
+     * Renders only the block with the specified name and specified set of params. If the template extends other templates, the block is
+     * resolved through the whole inheritance chain, including the `super()` calls. Rest of the template isn't evaluated.
+     *
+     * @param blockName Name of the block to render
+     * @param params    Set of params which should be passed to the template engine and can be used within the template
+     *
+     * @return Either rendered block or instance of \ref ErrorInfoTpl as an error
+     */
+    ResultW<std::wstring> RenderBlock(const std::string& blockName, const ValuesMap& params);
+    /*!
+     * \brief Get the static prefix of the previously loaded template output
+     *
+     * Returns the longest beginning of the rendered output which doesn't depend on the render params, for instance, the static
+     * `<head>` section of the HTML page. It can be sent to the consumer before the params are ready. For templates which extend other
+     * templates the prefix of the whole inheritance chain is returned. Output of the full render always starts with this prefix.
+     *
+     * @return Either static prefix of the output or instance of \ref ErrorInfoTpl as an error
+     */
+    ResultW<std::wstring> GetStaticPrefix();
+    /*!
+     * \brief Start resumable rendering of the previously loaded template
+     *
+     * Prepares the render state object for the previously loaded template and specified set of params. Params are copied to the state, so
+     * they don't need to outlive it. Output is produced by the subsequent \ref RenderStateTpl::Resume calls.
+     *
+     * @param params     Set of params which should be passed to the template engine and can be used within the template
+     * @param chunkSize  Size of the output chunk after which rendering is suspended
+     *
+     * @return Either render state object or instance of \ref ErrorInfoTpl as an error
+     */
+    ResultW<RenderStateW> StartRender(const ValuesMap& params, std::size_t chunkSize = 0x1000);
     /*!
      * \brief Get metadata, provided in the {% meta %} tag
      *
@@ -278,6 +545,7 @@ public:
 private:
     std::shared_ptr<ITemplateImpl> m_impl;
     friend class TemplateImpl<wchar_t>;
+    friend class TemplateEnv;
 };
 } // jinja2
 
@@ -4,16 +4,24 @@
 #include "config.h"
 #include "error_info.h"
 #include "filesystem_handler.h"
+#include "render_limits.h"
 #include "template.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
 #include <shared_mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace jinja2
 {
 
 class IErrorHandler;
 class IFilesystemHandler;
+struct TemplateLayout;
 
 //! Compatibility mode for jinja2c++ engine
 enum class Jinja2CompatMode
@@ -47,6 +55,16 @@ struct Settings
     Jinja2CompatMode jinja2CompatMode = Jinja2CompatMode::None;
     //! Default format for metadata block in the templates
     std::string m_defaultMetadataType = "json";
+    //! Enables specialization of the templates with the current values of the environment globals. Scalar globals are substituted into the
+    //! parsed template as constants and constant expressions are folded again. Specialized template is rebuilt after the globals change.
+    //! It's used by all kinds of the rendering (including the blocks, the chunked rendering and the included and parent templates) unless
+    //! the render params or the variables of the including template shadow the substituted globals
+    bool specializeOnGlobals = false;
+
+    using RenderLimits = jinja2::RenderLimits;
+
+    //! Limits which are applied to every rendering of the templates. If the limit is exceeded, rendering fails with ErrorCode::RenderLimitExceeded
+    RenderLimits renderLimits;
 };
 
 /*!
@@ -159,6 +177,34 @@ public:
      * @return Either loaded template or load/parse error. See \ref ErrorInfoTpl
      */
     nonstd::expected<TemplateW, ErrorInfoW> LoadTemplateW(std::string fileName);
+    /*!
+     * \brief Load narrow char templates with the specified names concurrently
+     *
+     * Templates are loaded and parsed via registered file handlers on the pool of the worker threads and stored to the templates cache,
+     * so the subsequent \ref LoadTemplate calls return them without parsing. Cache is locked only for the insertion of every loaded
+     * template. If the templates cache is disabled, templates are only checked for the load/parse errors.
+     * Method is thread-unsafe. It's dangerous to add new filesystem handlers and load templates simultaneously.
+     *
+     * @param fileNames    Names of the templates to load
+     * @param threadsCount Number of the worker threads (including the calling one). If zero, the number of the hardware threads is used
+     *
+     * @return Load/parse errors of the templates which can't be loaded, keyed by the template name. Empty if all templates are loaded
+     */
+    std::unordered_map<std::string, ErrorInfo> PreloadTemplates(const std::vector<std::string>& fileNames, std::size_t threadsCount = 0);
+    /*!
+     * \brief Load wide char templates with the specified names concurrently
+     *
+     * Templates are loaded and parsed via registered file handlers on the pool of the worker threads and stored to the templates cache,
+     * so the subsequent \ref LoadTemplateW calls return them without parsing. Cache is locked only for the insertion of every loaded
+     * template. If the templates cache is disabled, templates are only checked for the load/parse errors.
+     * Method is thread-unsafe. It's dangerous to add new filesystem handlers and load templates simultaneously.
+     *
+     * @param fileNames    Names of the templates to load
+     * @param threadsCount Number of the worker threads (including the calling one). If zero, the number of the hardware threads is used
+     *
+     * @return Load/parse errors of the templates which can't be loaded, keyed by the template name. Empty if all templates are loaded
+     */
+    std::unordered_map<std::string, ErrorInfoW> PreloadTemplatesW(const std::vector<std::string>& fileNames, std::size_t threadsCount = 0);
 
     /*!
      * \brief Add global variable to the environment
@@ -173,6 +219,7 @@ public:
     {
         std::unique_lock<std::shared_timed_mutex> l(m_guard);
         m_globalValues[std::move(name)] = std::move(val);
+        ++ m_globalsVersion;
     }
     /*!
      * \brief Remove global variable from the environment
@@ -186,6 +233,7 @@ public:
     {
         std::unique_lock<std::shared_timed_mutex> l(m_guard);
         m_globalValues.erase(name);
+        ++ m_globalsVersion;
     }
 
     /*!
@@ -203,10 +251,44 @@ public:
         std::shared_lock<std::shared_timed_mutex> l(m_guard);
         fn(m_globalValues);
     }
+    /*!
+     * \brief Save precompiled form of the cached templates to the stream
+     *
+     * Writes the tokenization results (text blocks layout, source lines table, metadata location and the tokens of the expressions
+     * and statements) of every template which is stored in the templates cache. Data is written in the versioned binary format and can be loaded on the next start with
+     * \ref LoadPrecompiledTemplates, so the unchanged templates are loaded without tokenization of the source.
+     * Parsed statements tree and the results of the load-time optimizations (constant folding, variable slots, macro inlining and
+     * so on) aren't saved. They are built from the saved tokens on every template load.
+     * Method is thread-safe.
+     *
+     * @param os Stream to write the data to. Stream should be opened in the binary mode
+     *
+     * @return true if the data is successfully written
+     */
+    bool SavePrecompiledTemplates(std::ostream& os);
+    /*!
+     * \brief Load precompiled templates which were saved by \ref SavePrecompiledTemplates
+     *
+     * Loaded data is used by the subsequent loads of the templates with the same names. Precompiled data of the template is used only
+     * if the template source hash and the blocks stripping settings match the saved ones, otherwise the template is parsed as usual.
+     * Only the source tokenization is skipped: template is still parsed from the loaded tokens and optimized as usual.
+     * Method is thread-safe.
+     *
+     * @param is Stream to read the data from. Stream should be opened in the binary mode
+     *
+     * @return false if the data has unsupported format version or is corrupted. Nothing is loaded in this case
+     */
+    bool LoadPrecompiledTemplates(std::istream& is);
 
 private:
     template<typename CharT, typename T, typename Cache>
     auto LoadTemplateImpl(TemplateEnv* env, std::string fileName, const T& filesystemHandlers, Cache& cache);
+    template<typename CharT, typename Cache>
+    auto PreloadTemplatesImpl(const std::vector<std::string>& fileNames, std::size_t threadsCount, Cache& cache);
+    std::shared_ptr<const TemplateLayout> FindPrecompiledLayout(const std::string& fileName, std::size_t charSize);
+
+    template<typename CharT>
+    friend class TemplateImpl;
 
 
 private:
@@ -236,9 +318,13 @@ private:
     std::vector<FsHandler> m_filesystemHandlers;
     Settings m_settings;
     ValuesMap m_globalValues;
+    //! Incremented on every change of the globals. Used for invalidation of the templates specialized with the globals values
+    std::atomic<uint64_t> m_globalsVersion{0};
     std::shared_timed_mutex m_guard;
     std::unordered_map<std::string, TemplateCacheEntry> m_templateCache;
     std::unordered_map<std::string, TemplateWCacheEntry> m_templateWCache;
+    std::unordered_map<std::string, std::shared_ptr<const TemplateLayout>> m_precompiledLayouts;
+    std::unordered_map<std::string, std::shared_ptr<const TemplateLayout>> m_precompiledWLayouts;
 };
 
 } // jinja2
@@ -10,6 +10,9 @@ class ForStatement;
 class IfStatement;
 class ElseBranchStatement;
 class SetStatement;
+class SetLineStatement;
+class SetRawBlockStatement;
+class SetFilteredBlockStatement;
 class ParentBlockStatement;
 class BlockStatement;
 class ExtendsStatement;
@@ -17,6 +20,10 @@ class IncludeStatement;
 class ImportStatement;
 class MacroStatement;
 class MacroCallStatement;
+class InlinedMacroCallStatement;
+class DoStatement;
+class WithStatement;
+class FilterStatement;
 class ComposedRenderer;
 class RawTextRenderer;
 class ExpressionRenderer;
@@ -88,6 +95,9 @@ class StatementVisitor : public VisitorBase<
     IfStatement,
     ElseBranchStatement,
     SetStatement,
+    SetLineStatement,
+    SetRawBlockStatement,
+    SetFilteredBlockStatement,
     ParentBlockStatement,
     BlockStatement,
     ExtendsStatement,
@@ -95,6 +105,10 @@ class StatementVisitor : public VisitorBase<
     ImportStatement,
     MacroStatement,
     MacroCallStatement,
+    InlinedMacroCallStatement,
+    DoStatement,
+    WithStatement,
+    FilterStatement,
     ComposedRenderer,
     RawTextRenderer,
     ExpressionRenderer>
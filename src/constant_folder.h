@@ -0,0 +1,291 @@
+#ifndef CONSTANT_FOLDER_H
+#define CONSTANT_FOLDER_H
+
+#include "renderer.h"
+#include "statements.h"
+#include "value_visitors.h"
+
+#include <boost/optional.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace jinja2
+{
+// Parse-time optimization pass. Constant subexpressions are replaced with the literals, output of the constant non-numeric expressions
+// is merged into the adjacent raw text and the `if` branches with constant conditions are resolved. Expressions which fail to evaluate
+// are kept as is, so the errors are reported during the rendering as usual
+template<typename CharT>
+class ConstantFolder : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    // Merged text is kept by the `textPool` of the folded renderers tree
+    ConstantFolder(IRendererCallback* callback, std::shared_ptr<OwnedTextPool<CharT>> textPool)
+        : m_context(m_emptyScope, m_emptyScope, callback)
+        , m_folder([this](ExpressionEvaluatorPtr<>& expr) { FoldExpression(expr); })
+        , m_textPool(std::move(textPool))
+    {
+    }
+
+    void Fold(const RendererPtr& renderer)
+    {
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+        if (stmt)
+            Visit(stmt);
+    }
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        std::vector<RendererPtr> renderers;
+        TextCollector text(m_textPool);
+        for (auto& r : renderer->GetRenderers())
+            ProcessRenderer(r, renderers, text);
+        text.Flush(renderers);
+
+        renderer->SetRenderers(std::move(renderers));
+    }
+
+    void DoVisit(IfStatement* stmt) override
+    {
+        Fold(stmt->GetMainBody());
+        for (auto& branch : stmt->GetElseBranches())
+            Fold(branch->GetMainBody());
+    }
+
+    void DoVisit(ForStatement* stmt) override
+    {
+        Fold(stmt->GetMainBody());
+        if (stmt->GetElseBody())
+            Fold(stmt->GetElseBody());
+    }
+
+    void DoVisit(ParentBlockStatement* stmt) override
+    {
+        Fold(stmt->GetMainBody());
+    }
+
+    void DoVisit(BlockStatement* stmt) override
+    {
+        Fold(stmt->GetMainBody());
+    }
+
+    void DoVisit(ExtendsStatement* stmt) override
+    {
+        for (auto& block : stmt->GetBlocks())
+            Visit(block.second.get());
+    }
+
+    void DoVisit(MacroStatement* stmt) override
+    {
+        Fold(stmt->GetMainBody());
+    }
+
+    void DoVisit(MacroCallStatement* stmt) override
+    {
+        Fold(stmt->GetMainBody());
+    }
+
+private:
+    // Accumulates the sequence of raw text pieces. Single piece of the template source is kept as is, otherwise pieces are merged
+    class TextCollector
+    {
+    public:
+        explicit TextCollector(const std::shared_ptr<OwnedTextPool<CharT>>& textPool)
+            : m_textPool(textPool)
+        {
+        }
+
+        void Add(const RendererPtr& renderer, const RawTextRenderer* raw)
+        {
+            m_text.append(static_cast<const CharT*>(raw->GetData()), raw->GetLength());
+            m_singleRenderer = m_piecesCount == 0 ? renderer : RendererPtr();
+            ++ m_piecesCount;
+        }
+        void Add(const std::basic_string<CharT>& text)
+        {
+            m_text.append(text);
+            m_singleRenderer.reset();
+            ++ m_piecesCount;
+        }
+        void Flush(std::vector<RendererPtr>& renderers)
+        {
+            if (m_piecesCount == 0)
+                return;
+
+            if (m_singleRenderer)
+                renderers.push_back(std::move(m_singleRenderer));
+            else if (!m_text.empty())
+                renderers.push_back(std::make_shared<OwnedTextRenderer<CharT>>(m_textPool, std::move(m_text)));
+
+            m_text.clear();
+            m_singleRenderer.reset();
+            m_piecesCount = 0;
+        }
+
+    private:
+        const std::shared_ptr<OwnedTextPool<CharT>>& m_textPool;
+        std::basic_string<CharT> m_text;
+        RendererPtr m_singleRenderer;
+        size_t m_piecesCount = 0;
+    };
+
+    void ProcessRenderer(const RendererPtr& renderer, std::vector<RendererPtr>& renderers, TextCollector& text)
+    {
+        if (auto raw = dynamic_cast<RawTextRenderer*>(renderer.get()))
+        {
+            text.Add(renderer, raw);
+            return;
+        }
+
+        if (auto exprRenderer = dynamic_cast<ExpressionRenderer*>(renderer.get()))
+        {
+            auto& expr = exprRenderer->GetExpression();
+            InternalValue value;
+            if (EvaluateConstant(expr.get(), value))
+            {
+                AddConstant(std::move(value), renderers, text);
+                return;
+            }
+            expr->FoldSubexpressions(m_folder);
+        }
+        else if (auto ifStmt = dynamic_cast<IfStatement*>(renderer.get()))
+        {
+            DoVisit(ifStmt);
+            if (ResolveIf(ifStmt, renderers, text))
+                return;
+        }
+        else
+        {
+            Fold(renderer);
+        }
+
+        text.Flush(renderers);
+        renderers.push_back(renderer);
+    }
+
+    // Returns false if the statement should be kept as is
+    bool ResolveIf(IfStatement* stmt, std::vector<RendererPtr>& renderers, TextCollector& text)
+    {
+        auto& branches = stmt->GetElseBranches();
+        for (size_t idx = 0; idx <= branches.size(); ++ idx)
+        {
+            auto& condition = idx == 0 ? stmt->GetCondition() : branches[idx - 1]->GetCondition();
+            auto& body = idx == 0 ? stmt->GetMainBody() : branches[idx - 1]->GetMainBody();
+
+            auto isTrue = condition ? EvaluateCondition(condition.get()) : boost::optional<bool>(true);
+            if (!isTrue)
+            {
+                if (idx == 0)
+                    return false;
+
+                // Leading branches are never taken, so the first non-constant one becomes the main branch
+                auto newStmt = std::make_shared<IfStatement>(condition);
+                newStmt->SetMainBody(body);
+                for (++ idx; idx <= branches.size(); ++ idx)
+                    newStmt->AddElseBranch(branches[idx - 1]);
+
+                text.Flush(renderers);
+                renderers.push_back(std::move(newStmt));
+                return true;
+            }
+
+            if (!isTrue.get())
+                continue;
+
+            auto composed = std::dynamic_pointer_cast<ComposedRenderer>(body);
+            if (!composed)
+            {
+                ProcessRenderer(body, renderers, text);
+                return true;
+            }
+
+            for (auto& r : composed->GetRenderers())
+                ProcessRenderer(r, renderers, text);
+            return true;
+        }
+
+        return true;
+    }
+
+    boost::optional<bool> EvaluateCondition(ExpressionEvaluatorBase* condition)
+    {
+        if (!condition->IsConstant())
+        {
+            condition->FoldSubexpressions(m_folder);
+            return boost::optional<bool>();
+        }
+
+        try
+        {
+            return Apply<visitors::BooleanEvaluator>(condition->Evaluate(m_context));
+        }
+        catch (...)
+        {
+            return boost::optional<bool>();
+        }
+    }
+
+    // Numbers are kept typed, so the custom sinks get them via WriteInteger/WriteDouble and format them on their own. Output of the
+    // other constants is merged into the raw text
+    void AddConstant(InternalValue value, std::vector<RendererPtr>& renderers, TextCollector& text)
+    {
+        auto& data = value.GetData();
+        if (nonstd::holds_alternative<int64_t>(data) || nonstd::holds_alternative<double>(data))
+        {
+            text.Flush(renderers);
+            renderers.push_back(std::make_shared<ExpressionRenderer>(std::make_shared<ConstantExpression>(std::move(value))));
+            return;
+        }
+
+        std::basic_string<CharT> result;
+        Apply<visitors::ValueRenderer<CharT>>(value, result);
+        text.Add(result);
+    }
+
+    void FoldExpression(ExpressionEvaluatorPtr<>& expr)
+    {
+        if (!expr || dynamic_cast<ConstantExpression*>(expr.get()))
+            return;
+
+        InternalValue value;
+        if (EvaluateConstant(expr.get(), value))
+        {
+            expr = std::make_shared<ConstantExpression>(std::move(value));
+            return;
+        }
+
+        expr->FoldSubexpressions(m_folder);
+    }
+
+    // Only the self-contained scalar values are folded. Lists, maps and views can refer to the data which doesn't outlive the render
+    bool EvaluateConstant(ExpressionEvaluatorBase* expr, InternalValue& value)
+    {
+        if (!expr->IsConstant())
+            return false;
+
+        try
+        {
+            value = expr->Evaluate(m_context);
+        }
+        catch (...)
+        {
+            return false;
+        }
+
+        auto& data = value.GetData();
+        return nonstd::holds_alternative<EmptyValue>(data) || nonstd::holds_alternative<bool>(data) || nonstd::holds_alternative<std::string>(data) ||
+            nonstd::holds_alternative<TargetString>(data) || nonstd::holds_alternative<int64_t>(data) || nonstd::holds_alternative<double>(data);
+    }
+
+private:
+    InternalValueMap m_emptyScope;
+    RenderContext m_context;
+    SubexpressionFolder m_folder;
+    std::shared_ptr<OwnedTextPool<CharT>> m_textPool;
+};
+} // jinja2
+
+#endif // CONSTANT_FOLDER_H
@@ -239,6 +239,12 @@ void RenderErrorInfo(std::basic_string<CharT>& result, const ErrorInfoTpl<CharT>
     case ErrorCode::InvalidTemplateName:
         format_to(out, UNIVERSAL_STR("Invalid template name: {}").GetValue<CharT>(), errInfo.GetExtraParams()[0]);
         break;
+    case ErrorCode::BlockNotFound:
+        format_to(out, UNIVERSAL_STR("Block not found: {}").GetValue<CharT>(), errInfo.GetExtraParams()[0]);
+        break;
+    case ErrorCode::RenderLimitExceeded:
+        format_to(out, UNIVERSAL_STR("Render limit exceeded: {}").GetValue<CharT>(), errInfo.GetExtraParams()[0]);
+        break;
     case ErrorCode::InvalidValueType:
         format_to(out, UNIVERSAL_STR("Invalid value type").GetValue<CharT>());
         break;
@@ -9,6 +9,7 @@
 #include <boost/algorithm/string/join.hpp>
 #include <boost/container/small_vector.hpp>
 
+#include <algorithm>
 #include <cmath>
 #include <stack>
 
@@ -43,8 +44,28 @@ void FullExpressionEvaluator::Render(OutStream& stream, RenderContext& values)
         Expression::Render(stream, values);
 }
 
+bool FullExpressionEvaluator::IsConstant() const
+{
+    return m_expression && m_expression->IsConstant() && (!m_tester || m_tester->IsConstant());
+}
+
+void FullExpressionEvaluator::FoldSubexpressions(const SubexpressionFolder& folder)
+{
+    if (m_expression)
+        folder(m_expression);
+    if (m_tester)
+        m_tester->FoldSubexpressions(folder);
+}
+
 InternalValue ValueRefExpression::Evaluate(RenderContext& values)
 {
+    if (m_binder)
+    {
+        auto value = values.FindSlot(m_slot, m_binder);
+        if (value)
+            return *value;
+    }
+
     bool found = false;
     auto p = values.FindValue(m_valueName, found);
     if (found)
@@ -54,6 +75,20 @@ InternalValue ValueRefExpression::Evaluate(RenderContext& values)
 }
 
 InternalValue SubscriptExpression::Evaluate(RenderContext& values)
+{
+    if (!m_memoOwner)
+        return EvaluatePath(values);
+
+    auto memo = values.FindMemo(m_memoOwner, m_memo, m_memoRoot);
+    if (memo)
+        return *memo;
+
+    auto result = EvaluatePath(values);
+    values.StoreMemo(m_memoOwner, m_memo, m_memoRoot, result);
+    return result;
+}
+
+InternalValue SubscriptExpression::EvaluatePath(RenderContext& values)
 {
     InternalValue cur = m_value->Evaluate(values);
 
@@ -69,12 +104,34 @@ InternalValue SubscriptExpression::Evaluate(RenderContext& values)
     return cur;
 }
 
+bool SubscriptExpression::IsConstant() const
+{
+    return m_value->IsConstant() && std::all_of(m_subscriptExprs.begin(), m_subscriptExprs.end(), [](auto& e) {return e->IsConstant();});
+}
+
+void SubscriptExpression::FoldSubexpressions(const SubexpressionFolder& folder)
+{
+    folder(m_value);
+    for (auto& e : m_subscriptExprs)
+        folder(e);
+}
+
 InternalValue FilteredExpression::Evaluate(RenderContext& values)
 {
     auto origResult = m_expression->Evaluate(values);
     return m_filter->Evaluate(origResult, values);
 }
 
+bool FilteredExpression::IsConstant() const
+{
+    return m_expression->IsConstant() && m_filter->IsConstant();
+}
+
+void FilteredExpression::FoldSubexpressions(const SubexpressionFolder& folder)
+{
+    folder(m_expression);
+}
+
 InternalValue UnaryExpression::Evaluate(RenderContext& values)
 {
     return Apply<visitors::UnaryOperation>(m_expr->Evaluate(values), m_oper);
@@ -174,6 +231,17 @@ InternalValue TupleCreator::Evaluate(RenderContext& context)
     return ListAdapter::CreateAdapter(std::move(result));
 }
 
+bool TupleCreator::IsConstant() const
+{
+    return std::all_of(m_exprs.begin(), m_exprs.end(), [](auto& e) {return e->IsConstant();});
+}
+
+void TupleCreator::FoldSubexpressions(const SubexpressionFolder& folder)
+{
+    for (auto& e : m_exprs)
+        folder(e);
+}
+
 InternalValue DictCreator::Evaluate(RenderContext& context)
 {
     InternalValueMap result;
@@ -185,15 +253,65 @@ InternalValue DictCreator::Evaluate(RenderContext& context)
     return CreateMapAdapter(std::move(result));;
 }
 
+bool DictCreator::IsConstant() const
+{
+    return std::all_of(m_exprs.begin(), m_exprs.end(), [](auto& e) {return e.second->IsConstant();});
+}
+
+void DictCreator::FoldSubexpressions(const SubexpressionFolder& folder)
+{
+    for (auto& e : m_exprs)
+        folder(e.second);
+}
+
 ExpressionFilter::ExpressionFilter(const std::string& filterName, CallParamsInfo params)
+    : m_params(params)
 {
     m_filter = CreateFilter(filterName, std::move(params));
     if (!m_filter)
         throw std::runtime_error("Can't find filter '" + filterName + "'");
 }
 
+void ExpressionFilter::SetParentFilter(std::shared_ptr<ExpressionFilter> parentFilter)
+{
+    m_parentFilter = std::move(parentFilter);
+
+    // Adjacent string converters are fused into the single filter, so the chain like `trim | lower | replace(...)` converts the same
+    // string buffer instead of producing the new value on each step
+    auto converter = std::dynamic_pointer_cast<filters::StringConverter>(m_filter);
+    if (!converter || !converter->IsStringToString())
+        return;
+
+    std::vector<std::shared_ptr<filters::StringConverter>> converters;
+    if (m_parentFilter->m_fusedFilter)
+    {
+        converters = m_parentFilter->m_fusedFilter->GetConverters();
+        m_fusedParent = m_parentFilter->m_fusedParent;
+    }
+    else
+    {
+        auto parentConverter = std::dynamic_pointer_cast<filters::StringConverter>(m_parentFilter->m_filter);
+        if (!parentConverter || !parentConverter->IsStringToString())
+            return;
+
+        converters.push_back(std::move(parentConverter));
+        m_fusedParent = m_parentFilter->m_parentFilter;
+    }
+
+    converters.push_back(std::move(converter));
+    m_fusedFilter = std::make_shared<filters::FusedStringConverter>(std::move(converters));
+}
+
 InternalValue ExpressionFilter::Evaluate(const InternalValue& baseVal, RenderContext& context)
 {
+    if (m_fusedFilter)
+    {
+        if (m_fusedParent)
+            return m_fusedFilter->Filter(m_fusedParent->Evaluate(baseVal, context), context);
+
+        return m_fusedFilter->Filter(baseVal, context);
+    }
+
     if (m_parentFilter)
         return m_filter->Filter(m_parentFilter->Evaluate(baseVal, context), context);
 
@@ -202,6 +320,7 @@ InternalValue ExpressionFilter::Evaluate(const InternalValue& baseVal, RenderCon
 
 IsExpression::IsExpression(ExpressionEvaluatorPtr<> value, const std::string& tester, CallParamsInfo params)
     : m_value(value)
+    , m_params(params)
 {
     m_tester = CreateTester(tester, std::move(params));
     if (!m_tester)
@@ -253,6 +372,15 @@ InternalValue CallExpression::Evaluate(RenderContext& values)
     }
 }
 
+void CallExpression::FoldSubexpressions(const SubexpressionFolder& folder)
+{
+    folder(m_valueRef);
+    for (auto& e : m_params.posParams)
+        folder(e);
+    for (auto& e : m_params.kwParams)
+        folder(e.second);
+}
+
 void CallExpression::Render(OutStream& stream, RenderContext& values)
 {
     auto fnVal = m_valueRef->Evaluate(values);
@@ -4,6 +4,7 @@
 #include "internal_value.h"
 #include "render_context.h"
 
+#include <functional>
 #include <memory>
 #include <limits>
 
@@ -17,6 +18,17 @@ enum
     LoopCycleFn = 2
 };
 
+class ExpressionEvaluatorBase;
+
+namespace filters
+{
+class FusedStringConverter;
+}
+
+template<typename T = ExpressionEvaluatorBase>
+using ExpressionEvaluatorPtr = std::shared_ptr<T>;
+using SubexpressionFolder = std::function<void (ExpressionEvaluatorPtr<>& expr)>;
+
 class ExpressionEvaluatorBase
 {
 public:
@@ -24,10 +36,13 @@ public:
 
     virtual InternalValue Evaluate(RenderContext& values) = 0;
     virtual void Render(OutStream& stream, RenderContext& values);
+
+    // Returns true if result of the expression doesn't depend on the render context, so it can be evaluated once
+    virtual bool IsConstant() const {return false;}
+    // Applies the folder to every direct subexpression. Folder can replace the subexpression with the equivalent one
+    virtual void FoldSubexpressions(const SubexpressionFolder&) {}
 };
 
-template<typename T = ExpressionEvaluatorBase>
-using ExpressionEvaluatorPtr = std::shared_ptr<T>;
 using Expression = ExpressionEvaluatorBase;
 
 struct CallParams
@@ -104,6 +119,11 @@ public:
     }
     InternalValue Evaluate(RenderContext& values) override;
     void Render(OutStream &stream, RenderContext &values) override;
+    bool IsConstant() const override;
+    void FoldSubexpressions(const SubexpressionFolder& folder) override;
+
+    auto& GetExpression() const {return m_expression;}
+    auto& GetTester() const {return m_tester;}
 private:
     ExpressionEvaluatorPtr<Expression> m_expression;
     ExpressionEvaluatorPtr<IfExpression> m_tester;
@@ -117,8 +137,20 @@ public:
     {
     }
     InternalValue Evaluate(RenderContext& values) override;
+
+    auto& GetValueName() const {return m_valueName;}
+    // Makes the reference to read the value from the frame slot which is bound by the `binder` statement. Name lookup is used if the
+    // slot isn't bound
+    void SetSlot(size_t slot, const void* binder)
+    {
+        m_slot = slot;
+        m_binder = binder;
+    }
+
 private:
     std::string m_valueName;
+    size_t m_slot = InvalidSlot;
+    const void* m_binder = nullptr;
 };
 
 class SubscriptExpression : public Expression
@@ -129,14 +161,33 @@ public:
     {
     }
     InternalValue Evaluate(RenderContext& values) override;
+    bool IsConstant() const override;
+    void FoldSubexpressions(const SubexpressionFolder& folder) override;
     void AddIndex(ExpressionEvaluatorPtr<Expression> value)
     {
         m_subscriptExprs.push_back(value);
     }
 
+    auto& GetValue() const {return m_value;}
+    auto& GetIndexes() const {return m_subscriptExprs;}
+    // Makes the expression to keep its value in the memo cell of the render context until the binding of the `root` variable is changed.
+    // Memo is used only while the render context renders the renderers tree of the `owner`
+    void SetMemo(const void* owner, size_t memo, size_t root)
+    {
+        m_memoOwner = owner;
+        m_memo = memo;
+        m_memoRoot = root;
+    }
+
+private:
+    InternalValue EvaluatePath(RenderContext& values);
+
 private:
     ExpressionEvaluatorPtr<Expression> m_value;
     std::vector<ExpressionEvaluatorPtr<Expression>> m_subscriptExprs;
+    const void* m_memoOwner = nullptr;
+    size_t m_memo = 0;
+    size_t m_memoRoot = 0;
 };
 
 class FilteredExpression : public Expression
@@ -148,6 +199,10 @@ public:
     {
     }
     InternalValue Evaluate(RenderContext&) override;
+    bool IsConstant() const override;
+    void FoldSubexpressions(const SubexpressionFolder& folder) override;
+
+    auto& GetFilter() const {return m_filter;}
 
 private:
     ExpressionEvaluatorPtr<Expression> m_expression;
@@ -164,6 +219,9 @@ public:
     {
         return m_constant;
     }
+    bool IsConstant() const override {return true;}
+
+    auto& GetValue() const {return m_constant;}
 private:
     InternalValue m_constant;
 };
@@ -177,6 +235,8 @@ public:
     }
 
     InternalValue Evaluate(RenderContext&) override;
+    bool IsConstant() const override;
+    void FoldSubexpressions(const SubexpressionFolder& folder) override;
 
 private:
     std::vector<ExpressionEvaluatorPtr<>> m_exprs;
@@ -205,6 +265,8 @@ public:
     }
 
     InternalValue Evaluate(RenderContext&) override;
+    bool IsConstant() const override;
+    void FoldSubexpressions(const SubexpressionFolder& folder) override;
 
 private:
     std::unordered_map<std::string, ExpressionEvaluatorPtr<>> m_exprs;
@@ -225,6 +287,8 @@ public:
         , m_expr(expr)
     {}
     InternalValue Evaluate(RenderContext&) override;
+    bool IsConstant() const override {return m_expr->IsConstant();}
+    void FoldSubexpressions(const SubexpressionFolder& folder) override {folder(m_expr);}
 private:
     Operation m_oper;
     ExpressionEvaluatorPtr<> m_expr;
@@ -239,16 +303,24 @@ public:
     {
         virtual ~ITester() {}
         virtual bool Test(const InternalValue& baseVal, RenderContext& context) = 0;
+        // Returns true if the tester can invoke the macros or user callables, which have access to the variables of the render context
+        virtual bool InvokesCallables() const {return false;}
     };
 
     using TesterFactoryFn = std::function<std::shared_ptr<ITester>(CallParamsInfo params)>;
 
     IsExpression(ExpressionEvaluatorPtr<> value, const std::string& tester, CallParamsInfo params);
     InternalValue Evaluate(RenderContext& context) override;
+    void FoldSubexpressions(const SubexpressionFolder& folder) override {folder(m_value);}
+
+    // Tester arguments. They aren't folded, because the tester keeps its own references to them
+    auto& GetParams() const {return m_params;}
+    bool InvokesCallables() const {return m_tester->InvokesCallables();}
 
 private:
     ExpressionEvaluatorPtr<> m_value;
     std::shared_ptr<ITester> m_tester;
+    CallParamsInfo m_params;
 };
 
 class BinaryExpression : public Expression
@@ -284,6 +356,12 @@ public:
 
     BinaryExpression(Operation oper, ExpressionEvaluatorPtr<> leftExpr, ExpressionEvaluatorPtr<> rightExpr);
     InternalValue Evaluate(RenderContext&) override;
+    bool IsConstant() const override {return m_leftExpr->IsConstant() && m_rightExpr->IsConstant();}
+    void FoldSubexpressions(const SubexpressionFolder& folder) override
+    {
+        folder(m_leftExpr);
+        folder(m_rightExpr);
+    }
 private:
     Operation m_oper;
     ExpressionEvaluatorPtr<> m_leftExpr;
@@ -305,6 +383,7 @@ public:
 
     InternalValue Evaluate(RenderContext &values) override;
     void Render(OutStream &stream, RenderContext &values) override;
+    void FoldSubexpressions(const SubexpressionFolder& folder) override;
 
     auto& GetValueRef() const {return m_valueRef;}
     auto& GetParams() const {return m_params;}
@@ -328,6 +407,10 @@ public:
     {
         virtual ~IExpressionFilter() {}
         virtual InternalValue Filter(const InternalValue& baseVal, RenderContext& context) = 0;
+        // Returns true if the result depends on the filtered value only, i.e. the filter is pure and all its arguments are constant
+        virtual bool IsConstant() const {return false;}
+        // Returns true if the filter can invoke the macros or user callables, which have access to the variables of the render context
+        virtual bool InvokesCallables() const {return false;}
     };
 
     using FilterFactoryFn = std::function<std::shared_ptr<IExpressionFilter>(CallParamsInfo params)>;
@@ -335,13 +418,25 @@ public:
     ExpressionFilter(const std::string& filterName, CallParamsInfo params);
 
     InternalValue Evaluate(const InternalValue& baseVal, RenderContext& context);
-    void SetParentFilter(std::shared_ptr<ExpressionFilter> parentFilter)
+    bool IsConstant() const
     {
-        m_parentFilter = std::move(parentFilter);
+        return m_filter->IsConstant() && (!m_parentFilter || m_parentFilter->IsConstant());
     }
+    bool InvokesCallables() const
+    {
+        return m_filter->InvokesCallables() || (m_parentFilter && m_parentFilter->InvokesCallables());
+    }
+    void SetParentFilter(std::shared_ptr<ExpressionFilter> parentFilter);
+    // Filter arguments. They aren't folded, because the filter keeps its own references to them
+    auto& GetParams() const {return m_params;}
+    auto& GetParentFilter() const {return m_parentFilter;}
 private:
     std::shared_ptr<IExpressionFilter> m_filter;
     std::shared_ptr<ExpressionFilter> m_parentFilter;
+    CallParamsInfo m_params;
+    // Chain of the string converters which ends with this filter, and the filter which precedes this chain
+    std::shared_ptr<filters::FusedStringConverter> m_fusedFilter;
+    std::shared_ptr<ExpressionFilter> m_fusedParent;
 };
 
 
@@ -358,6 +453,16 @@ public:
 
     bool Evaluate(RenderContext& context);
     InternalValue EvaluateAltValue(RenderContext& context);
+    bool IsConstant() const
+    {
+        return m_testExpr->IsConstant() && (!m_altValue || m_altValue->IsConstant());
+    }
+    void FoldSubexpressions(const SubexpressionFolder& folder)
+    {
+        folder(m_testExpr);
+        if (m_altValue)
+            folder(m_altValue);
+    }
 
     void SetAltValue(ExpressionEvaluatorPtr<> altValue)
     {
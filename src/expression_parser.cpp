@@ -139,7 +139,7 @@ ExpressionParser::ParseResult<ExpressionEvaluatorPtr<Expression>> ExpressionPars
             if (nextTok != Token::Identifier)
                 return MakeParseError(ErrorCode::ExpectedIdentifier, nextTok);
     
-            std::string name = AsString(nextTok.value);
+            std::string name = lexer.GetAsString(nextTok);
             ParseResult<CallParamsInfo> params;
 
             if (lexer.EatIfEqual('('))
@@ -299,13 +299,13 @@ ExpressionParser::ParseResult<ExpressionEvaluatorPtr<Expression>> ExpressionPars
         if (forbiddenKw.count(kwType) != 0)
             return MakeParseError(ErrorCode::UnexpectedToken, tok);
             
-        valueRef = std::make_shared<ValueRefExpression>(AsString(tok.value));
+        valueRef = std::make_shared<ValueRefExpression>(lexer.GetAsString(tok));
         break;
     }
     case Token::IntegerNum:
     case Token::FloatNum:
     case Token::String:
-        return std::make_shared<ConstantExpression>(tok.value);
+        return std::make_shared<ConstantExpression>(lexer.GetAsValue(tok));
     case Token::True:
         return std::make_shared<ConstantExpression>(InternalValue(true));
     case Token::False:
@@ -392,7 +392,7 @@ ExpressionParser::ParseResult<ExpressionEvaluatorPtr<Expression>> ExpressionPars
         if (!expr)
             return ReplaceErrorIfPossible(expr, pivotTok, ErrorCode::ExpectedExpression);
 
-        items[AsString(key.value)] = *expr;
+        items[lexer.GetAsString(key)] = *expr;
 
     } while (lexer.EatIfEqual(','));
 
@@ -457,7 +457,7 @@ ExpressionParser::ParseResult<CallParamsInfo> ExpressionParser::ParseCallParams(
         std::string paramName;
         if (tok == Token::Identifier && lexer.PeekNextToken() == '=')
         {
-            paramName = AsString(tok.value);
+            paramName = lexer.GetAsString(tok);
             lexer.EatToken();
         }
         else
@@ -496,7 +496,7 @@ ExpressionParser::ParseResult<ExpressionEvaluatorPtr<Expression>> ExpressionPars
             if (tok.type != Token::Identifier)
                 return MakeParseError(ErrorCode::ExpectedIdentifier, tok);
 
-            auto valueName = AsString(tok.value);
+            auto valueName = lexer.GetAsString(tok);
             indexExpr = std::make_shared<ConstantExpression>(InternalValue(valueName));
         }
         else
@@ -533,7 +533,7 @@ ExpressionParser::ParseResult<ExpressionEvaluatorPtr<ExpressionFilter>> Expressi
             if (tok != Token::Identifier)
                 return MakeParseError(ErrorCode::ExpectedIdentifier, tok);
 
-            std::string name = AsString(tok.value);
+            std::string name = lexer.GetAsString(tok);
             ParseResult<CallParamsInfo> params;
 
             if (lexer.NextToken() == '(')
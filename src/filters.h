@@ -8,6 +8,8 @@
 
 #include <memory>
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace jinja2
 {
@@ -28,6 +30,7 @@ public:
     ApplyMacro(FilterParams params);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool InvokesCallables() const override {return true;}
 
 private:
     FilterParams m_mappingParams;
@@ -47,6 +50,7 @@ public:
     Default(FilterParams params);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool IsConstant() const override {return HasConstantArgs();}
 };
 
 class DictSort : public  FilterBase
@@ -55,6 +59,7 @@ public:
     DictSort(FilterParams params);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool IsConstant() const override {return HasConstantArgs();}
 };
 
 class GroupBy : public FilterBase
@@ -71,6 +76,7 @@ public:
     Join(FilterParams params);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool IsConstant() const override {return HasConstantArgs();}
 };
 
 class Map : public FilterBase
@@ -79,6 +85,7 @@ public:
     Map(FilterParams params);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool InvokesCallables() const override {return true;}
 
 private:
     static FilterParams MakeParams(FilterParams);
@@ -122,6 +129,7 @@ public:
     SequenceAccessor(FilterParams params, Mode mode);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool IsConstant() const override {return m_mode != RandomMode && HasConstantArgs();}
 
 private:
     Mode m_mode;
@@ -169,6 +177,7 @@ public:
     Sort(FilterParams params);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool IsConstant() const override {return HasConstantArgs();}
 };
 
 class StringConverter : public  FilterBase
@@ -197,11 +206,34 @@ public:
     StringConverter(FilterParams params, Mode mode);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool IsConstant() const override {return HasConstantArgs();}
+
+    // Returns true if the converter produces the string from the string and can convert it in place
+    bool IsStringToString() const;
+    // Converts the string in place. `buffer` is the scratch space for the conversions which can't be done in place
+    template<typename CharT>
+    void Convert(std::basic_string<CharT>& str, std::basic_string<CharT>& buffer, RenderContext& context);
 
 private:
     Mode m_mode;
 };
 
+// Applies the chain of the string converters in one pass. The first converter produces the string from the filtered value, and the rest
+// of them convert this string in place, so the intermediate values aren't created
+class FusedStringConverter : public FilterBase
+{
+public:
+    FusedStringConverter(std::vector<std::shared_ptr<StringConverter>> converters);
+
+    InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool IsConstant() const override;
+
+    auto& GetConverters() const {return m_converters;}
+
+private:
+    std::vector<std::shared_ptr<StringConverter>> m_converters;
+};
+
 class StringFormat : public  FilterBase
 {
 public:
@@ -226,6 +258,7 @@ public:
     Tester(FilterParams params, Mode mode);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool InvokesCallables() const override {return true;}
 
 private:
     Mode m_mode;
@@ -248,6 +281,7 @@ public:
     ValueConverter(FilterParams params, Mode mode);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool IsConstant() const override {return HasConstantArgs();}
 
 private:
     Mode m_mode;
@@ -267,6 +301,7 @@ public:
     UserDefinedFilter(std::string filterName, FilterParams params);
 
     InternalValue Filter(const InternalValue& baseVal, RenderContext& context);
+    bool InvokesCallables() const override {return true;}
 
 private:
     std::string m_filterName;
@@ -12,6 +12,7 @@ public:
 protected:
     bool ParseParams(const std::initializer_list<ArgumentInfo>& argsInfo, const CallParamsInfo& params);
     InternalValue GetArgumentValue(const std::string& argName, RenderContext& context, InternalValue defVal = InternalValue());
+    bool HasConstantArgs() const;
 
 protected:
     ParsedArgumentsInfo m_args;
@@ -31,6 +32,28 @@ inline InternalValue FunctionBase::GetArgumentValue(const std::string& argName,
     return argExpr ? argExpr->Evaluate(context) : std::move(defVal);
 }
 
+inline bool FunctionBase::HasConstantArgs() const
+{
+    auto isConstant = [](auto& expr) {return !expr || expr->IsConstant();};
+    for (auto& a : m_args.args)
+    {
+        if (!isConstant(a.second))
+            return false;
+    }
+    for (auto& a : m_args.extraKwArgs)
+    {
+        if (!isConstant(a.second))
+            return false;
+    }
+    for (auto& a : m_args.extraPosArgs)
+    {
+        if (!isConstant(a))
+            return false;
+    }
+
+    return true;
+}
+
 } // jinja2
 
 #endif // FUNCTION_BASE_H
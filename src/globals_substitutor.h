@@ -0,0 +1,187 @@
+#ifndef GLOBALS_SUBSTITUTOR_H
+#define GLOBALS_SUBSTITUTOR_H
+
+#include "renderer.h"
+#include "statements.h"
+#include "template_names_collector.h"
+
+#include <string>
+#include <unordered_set>
+
+namespace jinja2
+{
+// Parse-time pass which replaces the references to the environment globals with the constants, so the subsequent constant folding can
+// evaluate the expressions and resolve the `if` branches which depend on them. Reference is replaced only if the template can't assign
+// the variable of the same name at all. Templates which are included with the context and the parent templates can assign any name,
+// so the references which are rendered after such template, or are within the macro body of the template which has such statements,
+// aren't replaced
+class GlobalsSubstitutor : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    explicit GlobalsSubstitutor(const InternalValueMap& constants)
+        : m_constants(constants)
+    {
+    }
+
+    void Substitute(const RendererPtr& renderer)
+    {
+        TemplateNamesCollector collector(m_assigned);
+        collector.Collect(renderer);
+        m_assignsAny = collector.AssignsAny();
+
+        Process(renderer);
+    }
+
+    // Names of the globals which are substituted at least once
+    auto& GetSubstitutedNames() const {return m_substituted;}
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        for (auto& r : renderer->GetRenderers())
+            Process(r);
+    }
+
+    void DoVisit(ExpressionRenderer* renderer) override
+    {
+        SubstituteSubexpressions(renderer->GetExpression());
+    }
+
+    void DoVisit(IfStatement* stmt) override
+    {
+        SubstituteSubexpressions(stmt->GetCondition());
+        Process(stmt->GetMainBody());
+        for (auto& branch : stmt->GetElseBranches())
+        {
+            SubstituteSubexpressions(branch->GetCondition());
+            Process(branch->GetMainBody());
+        }
+    }
+
+    void DoVisit(ForStatement* stmt) override
+    {
+        SubstituteSubexpressions(stmt->GetValue());
+        // Recursive calls render the body after the included templates of the outer iteration
+        if (stmt->IsRecursive() && AssignsAny(stmt->GetMainBody()))
+            m_isRebound = true;
+        Process(stmt->GetMainBody());
+        Process(stmt->GetElseBody());
+    }
+
+    void DoVisit(SetLineStatement* stmt) override
+    {
+        SubstituteSubexpressions(stmt->GetExpression());
+    }
+
+    void DoVisit(SetRawBlockStatement* stmt) override
+    {
+        Process(stmt->GetBody());
+    }
+
+    void DoVisit(SetFilteredBlockStatement* stmt) override
+    {
+        Process(stmt->GetBody());
+    }
+
+    void DoVisit(MacroStatement* stmt) override
+    {
+        ProcessMacroBody(stmt->GetMainBody());
+    }
+
+    void DoVisit(MacroCallStatement* stmt) override
+    {
+        ProcessMacroBody(stmt->GetMainBody());
+    }
+
+    void DoVisit(ParentBlockStatement* stmt) override
+    {
+        Process(stmt->GetMainBody());
+    }
+
+    void DoVisit(BlockStatement* stmt) override
+    {
+        Process(stmt->GetMainBody());
+    }
+
+    void DoVisit(WithStatement* stmt) override
+    {
+        Process(stmt->GetMainBody());
+    }
+
+    void DoVisit(FilterStatement* stmt) override
+    {
+        Process(stmt->GetBody());
+    }
+
+    void DoVisit(IncludeStatement* stmt) override
+    {
+        if (stmt->IsWithContext())
+            m_isRebound = true;
+    }
+
+    void DoVisit(ExtendsStatement*) override
+    {
+        m_isRebound = true;
+    }
+
+private:
+    void Process(const RendererPtr& renderer)
+    {
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+        if (stmt)
+            Visit(stmt);
+    }
+
+    // Macro body is rendered at the time of the call, so it isn't known which statements are rendered before it
+    void ProcessMacroBody(const RendererPtr& renderer)
+    {
+        ++ m_macroBodyLevel;
+        Process(renderer);
+        -- m_macroBodyLevel;
+    }
+
+    static bool AssignsAny(const RendererPtr& renderer)
+    {
+        std::unordered_multiset<std::string> names;
+        TemplateNamesCollector collector(names);
+        collector.Collect(renderer);
+        return collector.AssignsAny();
+    }
+
+    void SubstituteSubexpressions(const ExpressionEvaluatorPtr<>& expr)
+    {
+        if (expr)
+            expr->FoldSubexpressions([this](ExpressionEvaluatorPtr<>& subexpr) { SubstituteExpression(subexpr); });
+    }
+
+    void SubstituteExpression(ExpressionEvaluatorPtr<>& expr)
+    {
+        auto ref = dynamic_cast<ValueRefExpression*>(expr.get());
+        if (!ref)
+        {
+            SubstituteSubexpressions(expr);
+            return;
+        }
+
+        auto& name = ref->GetValueName();
+        auto p = m_constants.find(name);
+        if (p == m_constants.end() || m_assigned.count(name) != 0 || (m_macroBodyLevel != 0 ? m_assignsAny : m_isRebound))
+            return;
+
+        m_substituted.insert(name);
+        expr = std::make_shared<ConstantExpression>(p->second);
+    }
+
+private:
+    const InternalValueMap& m_constants;
+    std::unordered_multiset<std::string> m_assigned;
+    std::unordered_set<std::string> m_substituted;
+    bool m_assignsAny = false;
+    // Set when the statement which can assign any name is visited
+    bool m_isRebound = false;
+    int m_macroBodyLevel = 0;
+};
+} // jinja2
+
+#endif // GLOBALS_SUBSTITUTOR_H
@@ -74,7 +74,6 @@ bool Lexer::Preprocess()
 bool Lexer::ProcessNumber(const lexertk::token&, Token& newToken)
 {
     newToken.type = Token::FloatNum;
-    newToken.value = m_helper->GetAsValue(newToken.range, newToken.type);
     return true;
 }
 
@@ -100,22 +99,15 @@ bool Lexer::ProcessSymbolOrKeyword(const lexertk::token&, Token& newToken)
     }
     
     if (tokType == Token::Unknown)
-    {
         newToken.type = Token::Identifier;
-        auto id = m_helper->GetAsString(newToken.range);
-        newToken.value = InternalValue(id);
-    }
     else
-    {
         newToken.type = tokType;
-    }
     return true;
 }
 
 bool Lexer::ProcessString(const lexertk::token&, Token& newToken)
 {
     newToken.type = Token::String;
-    newToken.value = m_helper->GetAsValue(newToken.range, newToken.type);
     return true;
 }
 
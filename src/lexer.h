@@ -108,9 +108,10 @@ struct Token
         ExprEnd,
     };
     
+    // Token refers to the template source only. Values of the literals and names of the identifiers are materialized by LexScanner
+    // when the parser consumes them
     Type type = Unknown;
     CharRange range = {0, 0};
-    InternalValue value;
 
     bool IsEof() const
     {
@@ -181,7 +182,8 @@ enum class Keyword
 
 struct LexerHelper
 {
-    virtual std::string GetAsString(const CharRange& range) = 0;
+    // Returns the interned name, so the repeated identifiers are converted once per template
+    virtual const std::string& GetAsString(const CharRange& range) = 0;
     virtual InternalValue GetAsValue(const CharRange& range, Token::Type type) = 0;
     virtual Keyword GetKeyword(const CharRange& range) = 0;
     virtual char GetCharAt(size_t pos) = 0;
@@ -196,6 +198,12 @@ public:
         , m_helper(helper)
     {
     }
+    // Lexer over the already preprocessed tokens, e.g. ones from the precompiled template layout
+    Lexer(TokensList tokens, LexerHelper* helper)
+        : m_tokens(std::move(tokens))
+        , m_helper(helper)
+    {
+    }
 
     bool Preprocess();
     const TokensList& GetTokens() const
@@ -322,6 +330,21 @@ public:
     {
         return m_helper->GetKeyword(tok.range);
     }
+
+    // Name of the identifier or the value of the string literal
+    std::string GetAsString(const Token& tok) const
+    {
+        if (tok.type == Token::Identifier)
+            return m_helper->GetAsString(tok.range);
+
+        return AsString(GetAsValue(tok));
+    }
+
+    // Value of the number or string literal
+    InternalValue GetAsValue(const Token& tok) const
+    {
+        return m_helper->GetAsValue(tok.range, tok.type);
+    }
     
     bool EatIfEqual(Keyword kwType, Token* tok = nullptr)
     {
@@ -0,0 +1,230 @@
+#ifndef LOOP_USAGE_ANALYZER_H
+#define LOOP_USAGE_ANALYZER_H
+
+#include "expression_evaluator.h"
+#include "renderer.h"
+#include "statements.h"
+
+namespace jinja2
+{
+// Parse-time pass which finds the `for` loops whose bodies can't read the `loop` variable, so such loops don't bind it and don't
+// update it on every iteration. Loop variable is considered to be used if the body refers to `loop` or can render the code which
+// isn't visible here: calls of the macros and callables, filters and testers which invoke the user callables, other templates and blocks
+class LoopUsageAnalyzer : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    void Analyze(const RendererPtr& renderer)
+    {
+        Process(renderer);
+    }
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        for (auto& r : renderer->GetRenderers())
+            Process(r);
+    }
+
+    void DoVisit(IfStatement* stmt) override
+    {
+        Process(stmt->GetMainBody());
+        for (auto& branch : stmt->GetElseBranches())
+            Process(branch->GetMainBody());
+    }
+
+    void DoVisit(ForStatement* stmt) override
+    {
+        UsageChecker checker;
+        stmt->SetLoopVarUsed(stmt->IsRecursive() || checker.Check(stmt));
+
+        Process(stmt->GetMainBody());
+        Process(stmt->GetElseBody());
+    }
+
+    void DoVisit(SetRawBlockStatement* stmt) override { Process(stmt->GetBody()); }
+    void DoVisit(SetFilteredBlockStatement* stmt) override { Process(stmt->GetBody()); }
+    void DoVisit(MacroStatement* stmt) override { Process(stmt->GetMainBody()); }
+    void DoVisit(MacroCallStatement* stmt) override { Process(stmt->GetMainBody()); }
+    void DoVisit(ParentBlockStatement* stmt) override { Process(stmt->GetMainBody()); }
+    void DoVisit(BlockStatement* stmt) override { Process(stmt->GetMainBody()); }
+    void DoVisit(WithStatement* stmt) override { Process(stmt->GetMainBody()); }
+    void DoVisit(FilterStatement* stmt) override { Process(stmt->GetBody()); }
+
+private:
+    // Checks whether the statements rendered in the scope of the loop can read its `loop` variable
+    class UsageChecker : public StatementVisitor
+    {
+    public:
+        using StatementVisitor::DoVisit;
+
+        bool Check(ForStatement* stmt)
+        {
+            CheckExpression(stmt->GetIfExpr());
+            Check(stmt->GetMainBody());
+            Check(stmt->GetElseBody());
+            return m_isUsed;
+        }
+
+        // Macros render in the scope of the caller, and the other templates and blocks can't be inspected here
+        void DoVisit(ParentBlockStatement*) override { m_isUsed = true; }
+        void DoVisit(BlockStatement*) override { m_isUsed = true; }
+        void DoVisit(ExtendsStatement*) override { m_isUsed = true; }
+        void DoVisit(IncludeStatement*) override { m_isUsed = true; }
+        void DoVisit(ImportStatement*) override { m_isUsed = true; }
+        void DoVisit(MacroCallStatement*) override { m_isUsed = true; }
+
+        // Definition doesn't render anything. Calls of the macro are checked at the call sites
+        void DoVisit(MacroStatement*) override {}
+
+        void DoVisit(InlinedMacroCallStatement* stmt) override
+        {
+            for (auto& arg : stmt->GetArgs())
+                CheckExpression(arg.value);
+            Check(stmt->GetMacro()->GetMainBody());
+        }
+
+        void DoVisit(ComposedRenderer* renderer) override
+        {
+            for (auto& r : renderer->GetRenderers())
+                Check(r);
+        }
+
+        void DoVisit(RawTextRenderer*) override {}
+
+        void DoVisit(ExpressionRenderer* renderer) override
+        {
+            CheckExpression(renderer->GetExpression());
+        }
+
+        void DoVisit(IfStatement* stmt) override
+        {
+            CheckExpression(stmt->GetCondition());
+            Check(stmt->GetMainBody());
+            for (auto& branch : stmt->GetElseBranches())
+            {
+                CheckExpression(branch->GetCondition());
+                Check(branch->GetMainBody());
+            }
+        }
+
+        // Nested loop binds its own `loop` variable, so only the loop range is evaluated in the scope of the outer loop
+        void DoVisit(ForStatement* stmt) override
+        {
+            CheckExpression(stmt->GetValue());
+        }
+
+        void DoVisit(SetLineStatement* stmt) override
+        {
+            CheckExpression(stmt->GetExpression());
+        }
+
+        void DoVisit(SetRawBlockStatement* stmt) override
+        {
+            Check(stmt->GetBody());
+        }
+
+        void DoVisit(SetFilteredBlockStatement* stmt) override
+        {
+            CheckFilter(stmt->GetFilter());
+            Check(stmt->GetBody());
+        }
+
+        void DoVisit(DoStatement* stmt) override
+        {
+            CheckExpression(stmt->GetExpression());
+        }
+
+        void DoVisit(WithStatement* stmt) override
+        {
+            for (auto& v : stmt->GetScopeVars())
+                CheckExpression(v.second);
+            Check(stmt->GetMainBody());
+        }
+
+        void DoVisit(FilterStatement* stmt) override
+        {
+            CheckFilter(stmt->GetFilter());
+            Check(stmt->GetBody());
+        }
+
+    private:
+        void Check(const RendererPtr& renderer)
+        {
+            if (!renderer || m_isUsed)
+                return;
+
+            auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+            if (stmt)
+                Visit(stmt);
+            else
+                m_isUsed = true;
+        }
+
+        void CheckExpression(const ExpressionEvaluatorPtr<>& expr)
+        {
+            if (!expr || m_isUsed)
+                return;
+
+            if (auto ref = dynamic_cast<ValueRefExpression*>(expr.get()))
+            {
+                if (ref->GetValueName() == "loop")
+                    m_isUsed = true;
+                return;
+            }
+
+            // Called macros and callables get the render context, so they can read the variable as well
+            if (dynamic_cast<CallExpression*>(expr.get()))
+            {
+                m_isUsed = true;
+                return;
+            }
+
+            // Arguments of the filters and testers aren't subexpressions, so they are checked separately
+            if (auto filtered = dynamic_cast<FilteredExpression*>(expr.get()))
+            {
+                CheckFilter(filtered->GetFilter());
+            }
+            else if (auto isExpr = dynamic_cast<IsExpression*>(expr.get()))
+            {
+                if (isExpr->InvokesCallables())
+                    m_isUsed = true;
+                CheckParams(isExpr->GetParams());
+            }
+
+            expr->FoldSubexpressions([this](ExpressionEvaluatorPtr<>& subexpr) { CheckExpression(subexpr); });
+        }
+
+        void CheckFilter(const ExpressionEvaluatorPtr<ExpressionFilter>& filter)
+        {
+            if (!filter)
+                return;
+
+            if (filter->InvokesCallables())
+                m_isUsed = true;
+            for (auto f = filter.get(); f; f = f->GetParentFilter().get())
+                CheckParams(f->GetParams());
+        }
+
+        void CheckParams(const CallParamsInfo& params)
+        {
+            for (auto& p : params.posParams)
+                CheckExpression(p);
+            for (auto& p : params.kwParams)
+                CheckExpression(p.second);
+        }
+
+    private:
+        bool m_isUsed = false;
+    };
+
+    void Process(const RendererPtr& renderer)
+    {
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+        if (stmt)
+            Visit(stmt);
+    }
+};
+} // jinja2
+
+#endif // LOOP_USAGE_ANALYZER_H
@@ -0,0 +1,364 @@
+#ifndef MACRO_INLINER_H
+#define MACRO_INLINER_H
+
+#include "expression_evaluator.h"
+#include "renderer.h"
+#include "statements.h"
+#include "template_names_collector.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace jinja2
+{
+// Parse-time pass which replaces the `{{ macro(args) }}` calls of the simple macros with the direct rendering of the macro body. Arguments
+// are bound to the macro parameters at parse time, so the call site doesn't look up the macro and doesn't build the call arguments maps,
+// `varargs`, `kwargs` and introspection values. Macro is inlined only if:
+// - it's defined at the top level of the template, the call follows the definition, and no other statement can assign the macro name.
+//   Templates which are included with the context and the parent templates can assign any name, so the call isn't inlined if such
+//   template is rendered between the definition and the call, or if the call is within the macro body and the template has such statements;
+// - its body isn't recursive and doesn't refer to `varargs`, `kwargs`, `caller` and the introspection names;
+// - its body consists of the statements which expressions can be inspected, and the defaults of the parameters are constant.
+// Must be run after the slot resolution, because inlined calls reuse the resolved expressions of the call site
+class MacroInliner : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    void Inline(const RendererPtr& renderer)
+    {
+        TemplateNamesCollector collector(m_assigned);
+        collector.Collect(renderer);
+        m_assignsAny = collector.AssignsAny();
+
+        auto composed = dynamic_cast<ComposedRenderer*>(renderer.get());
+        if (!composed)
+            return;
+
+        // Only the macros of the root scope are inlined, because the nested definitions are conditional
+        m_isRootScope = true;
+        DoVisit(composed);
+    }
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        auto isRootScope = m_isRootScope;
+        m_isRootScope = false;
+
+        auto renderers = renderer->GetRenderers();
+        for (auto& r : renderers)
+        {
+            auto exprRenderer = dynamic_cast<ExpressionRenderer*>(r.get());
+            if (exprRenderer)
+            {
+                auto inlined = InlineCall(exprRenderer);
+                if (inlined)
+                    r = std::move(inlined);
+                continue;
+            }
+
+            auto macro = std::dynamic_pointer_cast<MacroStatement>(r);
+            if (isRootScope && macro && !dynamic_cast<MacroCallStatement*>(macro.get()))
+            {
+                // Inlinability is checked before the body is processed, so the inlined calls never form a cycle
+                bool canInline = CanInline(macro.get());
+                ProcessMacroBody(macro->GetMainBody());
+                if (canInline)
+                    m_macros[macro->GetName()] = InlinableMacro{macro, m_rebindingsCount};
+                continue;
+            }
+
+            Process(r);
+        }
+
+        renderer->SetRenderers(std::move(renderers));
+        m_isRootScope = isRootScope;
+    }
+
+    void DoVisit(IfStatement* stmt) override
+    {
+        Process(stmt->GetMainBody());
+        for (auto& branch : stmt->GetElseBranches())
+            Process(branch->GetMainBody());
+    }
+
+    void DoVisit(ForStatement* stmt) override
+    {
+        // Recursive calls render the body within the scope of the outer iteration, so the names which are assigned by the included
+        // templates are visible there before the include statement
+        if (stmt->IsRecursive() && AssignsAny(stmt->GetMainBody()))
+            ++ m_rebindingsCount;
+        Process(stmt->GetMainBody());
+        Process(stmt->GetElseBody());
+    }
+
+    void DoVisit(SetRawBlockStatement* stmt) override
+    {
+        Process(stmt->GetBody());
+    }
+
+    void DoVisit(SetFilteredBlockStatement* stmt) override
+    {
+        Process(stmt->GetBody());
+    }
+
+    void DoVisit(MacroStatement* stmt) override
+    {
+        ProcessMacroBody(stmt->GetMainBody());
+    }
+
+    void DoVisit(WithStatement* stmt) override
+    {
+        Process(stmt->GetMainBody());
+    }
+
+    void DoVisit(FilterStatement* stmt) override
+    {
+        Process(stmt->GetBody());
+    }
+
+    void DoVisit(IncludeStatement* stmt) override
+    {
+        if (stmt->IsWithContext())
+            ++ m_rebindingsCount;
+    }
+
+    void DoVisit(ExtendsStatement*) override
+    {
+        ++ m_rebindingsCount;
+    }
+
+private:
+    struct InlinableMacro
+    {
+        std::shared_ptr<MacroStatement> macro;
+        // Number of the statements which can assign any name before the definition
+        size_t rebindingsCount;
+    };
+
+    // Checks whether the macro body can be rendered without the values which are set up by the regular macro invocation
+    class InlinabilityChecker : public StatementVisitor
+    {
+    public:
+        using StatementVisitor::DoVisit;
+
+        bool Check(MacroStatement* macro)
+        {
+            m_forbiddenNames = {"name", "arguments", "defaults", macro->GetName()};
+            for (auto& p : macro->GetParams())
+            {
+                if (p.defaultValue && !p.defaultValue->IsConstant())
+                    return false;
+                // Parameters shadow the introspection values and the macro itself
+                m_forbiddenNames.erase(p.paramName);
+            }
+            m_forbiddenNames.insert({"varargs", "kwargs", "caller"});
+
+            Check(macro->GetMainBody());
+            return m_isInlinable;
+        }
+
+        // Nested definitions, blocks and other templates can refer to the rejected names in the ways which aren't visible here
+        void DoVisit(SetFilteredBlockStatement*) override { m_isInlinable = false; }
+        void DoVisit(ParentBlockStatement*) override { m_isInlinable = false; }
+        void DoVisit(BlockStatement*) override { m_isInlinable = false; }
+        void DoVisit(ExtendsStatement*) override { m_isInlinable = false; }
+        void DoVisit(IncludeStatement*) override { m_isInlinable = false; }
+        void DoVisit(ImportStatement*) override { m_isInlinable = false; }
+        void DoVisit(MacroStatement*) override { m_isInlinable = false; }
+        void DoVisit(MacroCallStatement*) override { m_isInlinable = false; }
+        void DoVisit(InlinedMacroCallStatement*) override { m_isInlinable = false; }
+        void DoVisit(DoStatement*) override { m_isInlinable = false; }
+        void DoVisit(FilterStatement*) override { m_isInlinable = false; }
+
+        void DoVisit(ComposedRenderer* renderer) override
+        {
+            for (auto& r : renderer->GetRenderers())
+                Check(r);
+        }
+
+        void DoVisit(ExpressionRenderer* renderer) override
+        {
+            CheckExpression(renderer->GetExpression());
+        }
+
+        void DoVisit(IfStatement* stmt) override
+        {
+            CheckExpression(stmt->GetCondition());
+            Check(stmt->GetMainBody());
+            for (auto& branch : stmt->GetElseBranches())
+            {
+                CheckExpression(branch->GetCondition());
+                Check(branch->GetMainBody());
+            }
+        }
+
+        void DoVisit(ForStatement* stmt) override
+        {
+            CheckExpression(stmt->GetValue());
+            CheckExpression(stmt->GetIfExpr());
+            Check(stmt->GetMainBody());
+            Check(stmt->GetElseBody());
+        }
+
+        void DoVisit(SetLineStatement* stmt) override
+        {
+            CheckExpression(stmt->GetExpression());
+        }
+
+        void DoVisit(SetRawBlockStatement* stmt) override
+        {
+            Check(stmt->GetBody());
+        }
+
+        void DoVisit(WithStatement* stmt) override
+        {
+            for (auto& v : stmt->GetScopeVars())
+                CheckExpression(v.second);
+            Check(stmt->GetMainBody());
+        }
+
+    private:
+        void Check(const RendererPtr& renderer)
+        {
+            if (!renderer || !m_isInlinable)
+                return;
+
+            auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+            if (stmt)
+                Visit(stmt);
+            else
+                m_isInlinable = false;
+        }
+
+        void CheckExpression(const ExpressionEvaluatorPtr<>& expr)
+        {
+            if (!expr || !m_isInlinable)
+                return;
+
+            if (auto ref = dynamic_cast<ValueRefExpression*>(expr.get()))
+            {
+                if (m_forbiddenNames.count(ref->GetValueName()) != 0)
+                    m_isInlinable = false;
+                return;
+            }
+
+            // Arguments of the filters and testers aren't subexpressions, so they are checked separately
+            if (auto filtered = dynamic_cast<FilteredExpression*>(expr.get()))
+            {
+                for (auto filter = filtered->GetFilter(); filter; filter = filter->GetParentFilter())
+                    CheckParams(filter->GetParams());
+            }
+            else if (auto isExpr = dynamic_cast<IsExpression*>(expr.get()))
+            {
+                CheckParams(isExpr->GetParams());
+            }
+
+            expr->FoldSubexpressions([this](ExpressionEvaluatorPtr<>& subexpr) { CheckExpression(subexpr); });
+        }
+
+        void CheckParams(const CallParamsInfo& params)
+        {
+            for (auto& p : params.posParams)
+                CheckExpression(p);
+            for (auto& p : params.kwParams)
+                CheckExpression(p.second);
+        }
+
+    private:
+        std::unordered_set<std::string> m_forbiddenNames;
+        bool m_isInlinable = true;
+    };
+
+    void Process(const RendererPtr& renderer)
+    {
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+        if (stmt)
+            Visit(stmt);
+    }
+
+    // Macro body is rendered at the time of the call, so it isn't known which statements are rendered before it
+    void ProcessMacroBody(const RendererPtr& renderer)
+    {
+        ++ m_macroBodyLevel;
+        Process(renderer);
+        -- m_macroBodyLevel;
+    }
+
+    static bool AssignsAny(const RendererPtr& renderer)
+    {
+        std::unordered_multiset<std::string> names;
+        TemplateNamesCollector collector(names);
+        collector.Collect(renderer);
+        return collector.AssignsAny();
+    }
+
+    bool CanInline(MacroStatement* macro) const
+    {
+        if (m_assigned.count(macro->GetName()) != 1)
+            return false;
+
+        InlinabilityChecker checker;
+        return checker.Check(macro);
+    }
+
+    // Returns nullptr if the renderer doesn't output the call of the inlinable macro
+    RendererPtr InlineCall(ExpressionRenderer* renderer) const
+    {
+        auto fullExpr = dynamic_cast<FullExpressionEvaluator*>(renderer->GetExpression().get());
+        if (!fullExpr || fullExpr->GetTester())
+            return RendererPtr();
+
+        auto callExpr = dynamic_cast<CallExpression*>(fullExpr->GetExpression().get());
+        if (!callExpr)
+            return RendererPtr();
+
+        auto ref = dynamic_cast<ValueRefExpression*>(callExpr->GetValueRef().get());
+        if (!ref)
+            return RendererPtr();
+
+        auto p = m_macros.find(ref->GetValueName());
+        if (p == m_macros.end())
+            return RendererPtr();
+
+        if (m_macroBodyLevel != 0 ? m_assignsAny : p->second.rebindingsCount != m_rebindingsCount)
+            return RendererPtr();
+
+        // Arguments are mapped to the parameters the same way as the regular invocation does. Missing mandatory parameters are
+        // looked up in the outer scopes in both cases
+        auto& macro = p->second.macro;
+        auto& params = macro->GetParams();
+        std::vector<ArgumentInfo> argsInfo;
+        for (auto& param : params)
+            argsInfo.emplace_back(param.paramName, !param.defaultValue);
+
+        bool isSucceeded = true;
+        auto parsedArgs = helpers::ParseCallParamsInfo(argsInfo, callExpr->GetParams(), isSucceeded);
+
+        std::vector<InlinedMacroArg> args;
+        for (auto& param : params)
+        {
+            auto arg = parsedArgs[param.paramName];
+            if (arg)
+                args.push_back(InlinedMacroArg{arg, false});
+            else
+                args.push_back(InlinedMacroArg{param.defaultValue, true});
+        }
+
+        return std::make_shared<InlinedMacroCallStatement>(macro, std::move(args));
+    }
+
+private:
+    std::unordered_multiset<std::string> m_assigned;
+    std::unordered_map<std::string, InlinableMacro> m_macros;
+    bool m_isRootScope = false;
+    bool m_assignsAny = false;
+    // Number of the visited statements which can assign any name
+    size_t m_rebindingsCount = 0;
+    int m_macroBodyLevel = 0;
+};
+} // jinja2
+
+#endif // MACRO_INLINER_H
@@ -0,0 +1,22 @@
+#include "out_stream.h"
+
+#include "value_visitors.h"
+
+namespace jinja2
+{
+
+size_t OutStream::WriteValue(std::string& target, const InternalValue& val)
+{
+    auto offset = target.size();
+    Apply<visitors::ValueRenderer<char>>(val, target);
+    return target.size() - offset;
+}
+
+size_t OutStream::WriteValue(std::wstring& target, const InternalValue& val)
+{
+    auto offset = target.size();
+    Apply<visitors::ValueRenderer<wchar_t>>(val, target);
+    return target.size() - offset;
+}
+
+} // jinja2
@@ -4,6 +4,7 @@
 #include "internal_value.h"
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
 namespace jinja2
@@ -16,25 +17,65 @@ public:
         virtual ~StreamWriter() {}
 
         virtual void WriteBuffer(const void* ptr, size_t length) = 0;
-        virtual void WriteValue(const InternalValue &val) = 0;
+        // Returns the number of the characters the value is rendered to
+        virtual size_t WriteValue(const InternalValue &val) = 0;
+        // Returns true if the writer needs the values as is rather than their text, i.e. it passes them to the render sink
+        virtual bool KeepsValues() const { return false; }
     };
 
-    OutStream(std::function<StreamWriter*()> writerGetter)
-        : m_writerGetter(std::move(writerGetter))
+    // String targets are written directly, without any indirect calls
+    explicit OutStream(std::string* target)
+        : m_narrowTarget(target)
+    {}
+
+    explicit OutStream(std::wstring* target)
+        : m_wideTarget(target)
+    {}
+
+    explicit OutStream(StreamWriter* writer)
+        : m_writer(writer)
+    {}
+
+    // Stream which keeps the writer alive while any of its copies exists
+    explicit OutStream(std::shared_ptr<StreamWriter> writer)
+        : m_writer(writer.get())
+        , m_ownedWriter(std::move(writer))
     {}
 
     void WriteBuffer(const void* ptr, size_t length)
     {
-        m_writerGetter()->WriteBuffer(ptr, length);
+        if (m_narrowTarget != nullptr)
+            m_narrowTarget->append(static_cast<const char*>(ptr), length);
+        else if (m_wideTarget != nullptr)
+            m_wideTarget->append(static_cast<const wchar_t*>(ptr), length);
+        else
+            m_writer->WriteBuffer(ptr, length);
     }
 
-    void WriteValue(const InternalValue& val)
+    size_t WriteValue(const InternalValue& val)
     {
-        m_writerGetter()->WriteValue(val);
+        if (m_narrowTarget != nullptr)
+            return WriteValue(*m_narrowTarget, val);
+        else if (m_wideTarget != nullptr)
+            return WriteValue(*m_wideTarget, val);
+        else
+            return m_writer->WriteValue(val);
     }
 
+    bool KeepsValues() const
+    {
+        return m_writer != nullptr && m_writer->KeepsValues();
+    }
+
+private:
+    static size_t WriteValue(std::string& target, const InternalValue& val);
+    static size_t WriteValue(std::wstring& target, const InternalValue& val);
+
 private:
-    std::function<StreamWriter*()> m_writerGetter;
+    std::string* m_narrowTarget = nullptr;
+    std::wstring* m_wideTarget = nullptr;
+    StreamWriter* m_writer = nullptr;
+    std::shared_ptr<StreamWriter> m_ownedWriter;
 };
 
 } // jinja2
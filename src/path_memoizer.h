@@ -0,0 +1,361 @@
+#ifndef PATH_MEMOIZER_H
+#define PATH_MEMOIZER_H
+
+#include "expression_evaluator.h"
+#include "renderer.h"
+#include "statements.h"
+#include "template_names_collector.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace jinja2
+{
+// Parse-time pass which finds the attribute paths like `order.customer.address.city` used more than once and makes them share the memo
+// cell of the render context, so the path is evaluated once until its root variable is rebound. Path is memoized only if all its
+// subscripts are constant and every statement which can bind its root variable invalidates the memo, i.e. the variable is a render param
+// or a global, the loop variable or the target of the `set` or `import` statement of the template top level. Included template with the
+// context invalidates the memos of the names it binds, so such include is allowed at the top level only. Templates which extend other
+// templates aren't processed, because the names assigned by the parent template aren't known at parse time. Templates which can invoke
+// the user callables aren't processed as well, because the callables can change the reflected objects behind the paths
+class PathMemoizer : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    // `owner` is the renderer which is passed to RenderContext::SetMemoOwner by the top-level rendering of the template
+    explicit PathMemoizer(const void* owner)
+        : m_owner(owner)
+    {
+    }
+
+    void Memoize(const RendererPtr& renderer)
+    {
+        std::unordered_multiset<std::string> assigned;
+        TemplateNamesCollector collector(assigned);
+        collector.Collect(renderer);
+
+        Process(renderer);
+        if (m_callsUnknown || m_assignsUnknown)
+            return;
+        for (auto& name : m_calledNames)
+        {
+            if (!m_macroNames.count(name))
+                return;
+        }
+
+        std::unordered_map<std::string, size_t> roots;
+        size_t memo = 0;
+        for (auto& p : m_paths)
+        {
+            auto& path = p.second;
+            if (path.exprs.size() < 2 || assigned.count(path.rootName) != m_tracked.count(path.rootName))
+                continue;
+
+            auto root = roots.emplace(path.rootName, roots.size()).first->second;
+            for (auto expr : path.exprs)
+                expr->SetMemo(m_owner, memo, root);
+            ++ memo;
+        }
+
+        for (auto& t : m_trackers)
+        {
+            auto p = roots.find(t.name);
+            if (p != roots.end())
+                t.assign(p->second);
+        }
+
+        for (auto include : m_contextIncludes)
+            include->SetMemoRoots(roots);
+    }
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        for (auto& r : renderer->GetRenderers())
+            Process(r);
+    }
+
+    void DoVisit(ExpressionRenderer* renderer) override
+    {
+        ProcessExpression(renderer->GetExpression());
+    }
+
+    void DoVisit(IfStatement* stmt) override
+    {
+        ProcessExpression(stmt->GetCondition());
+        Process(stmt->GetMainBody());
+        for (auto& branch : stmt->GetElseBranches())
+        {
+            ProcessExpression(branch->GetCondition());
+            Process(branch->GetMainBody());
+        }
+    }
+
+    void DoVisit(ForStatement* stmt) override
+    {
+        ProcessExpression(stmt->GetValue());
+        ProcessExpression(stmt->GetIfExpr());
+
+        // Loop invalidates the memos of its variables on every iteration and when the loop scope is left
+        auto& vars = stmt->GetVars();
+        for (size_t idx = 0; idx != vars.size(); ++ idx)
+            Track(vars[idx], [stmt, idx](size_t root) { stmt->SetVarMemoRoot(idx, root); });
+
+        ProcessNested(stmt->GetMainBody());
+        ProcessNested(stmt->GetElseBody());
+    }
+
+    void DoVisit(SetLineStatement* stmt) override
+    {
+        ProcessExpression(stmt->GetExpression());
+        TrackFields(stmt);
+    }
+
+    void DoVisit(SetRawBlockStatement* stmt) override
+    {
+        ProcessNested(stmt->GetBody());
+        TrackFields(stmt);
+    }
+
+    void DoVisit(SetFilteredBlockStatement* stmt) override
+    {
+        ProcessFilter(stmt->GetFilter().get());
+        ProcessNested(stmt->GetBody());
+        TrackFields(stmt);
+    }
+
+    void DoVisit(MacroStatement* stmt) override
+    {
+        m_macroNames.insert(stmt->GetName());
+        for (auto& p : stmt->GetParams())
+            ProcessExpression(p.defaultValue);
+        ProcessNested(stmt->GetMainBody());
+    }
+
+    void DoVisit(MacroCallStatement* stmt) override
+    {
+        m_calledNames.insert(stmt->GetMacroName());
+        ProcessNested(stmt->GetMainBody());
+    }
+
+    void DoVisit(InlinedMacroCallStatement* stmt) override
+    {
+        for (auto& arg : stmt->GetArgs())
+            ProcessExpression(arg.value);
+    }
+
+    void DoVisit(ParentBlockStatement* stmt) override
+    {
+        ProcessNested(stmt->GetMainBody());
+    }
+
+    void DoVisit(BlockStatement* stmt) override
+    {
+        ProcessNested(stmt->GetMainBody());
+    }
+
+    void DoVisit(WithStatement* stmt) override
+    {
+        for (auto& v : stmt->GetScopeVars())
+            ProcessExpression(v.second);
+        ProcessNested(stmt->GetMainBody());
+    }
+
+    void DoVisit(DoStatement* stmt) override
+    {
+        ProcessExpression(stmt->GetExpression());
+    }
+
+    void DoVisit(FilterStatement* stmt) override
+    {
+        ProcessFilter(stmt->GetFilter().get());
+        ProcessNested(stmt->GetBody());
+    }
+
+    void DoVisit(ImportStatement* stmt) override
+    {
+        if (m_nestingLevel != 0)
+            return;
+
+        auto assign = [stmt](size_t root) { stmt->AddMemoRoot(root); };
+        if (stmt->GetNamespace())
+            Track(stmt->GetNamespace().value(), assign);
+        for (auto& name : stmt->GetNamesToImport())
+            Track(name.second, assign);
+    }
+
+    // Names bound by the included template aren't known at parse time, so it invalidates the memos of any root it binds. Bindings
+    // made in the nested scope are reverted without the invalidation, so such include disables the memoization
+    void DoVisit(IncludeStatement* stmt) override
+    {
+        if (!stmt->IsWithContext())
+            return;
+
+        if (m_nestingLevel != 0)
+            m_assignsUnknown = true;
+        else
+            m_contextIncludes.push_back(stmt);
+    }
+
+    void DoVisit(ExtendsStatement*) override
+    {
+        m_assignsUnknown = true;
+    }
+
+private:
+    struct Path
+    {
+        std::string rootName;
+        std::vector<SubscriptExpression*> exprs;
+    };
+
+    struct Tracker
+    {
+        std::string name;
+        std::function<void (size_t)> assign;
+    };
+
+    void Process(const RendererPtr& renderer)
+    {
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+        if (stmt)
+            Visit(stmt);
+    }
+
+    // Renders in the nested scope, so the assignments made there are reverted without the memos invalidation
+    void ProcessNested(const RendererPtr& renderer)
+    {
+        ++ m_nestingLevel;
+        Process(renderer);
+        -- m_nestingLevel;
+    }
+
+    void Track(const std::string& name, std::function<void (size_t)> assign)
+    {
+        m_tracked.insert(name);
+        m_trackers.push_back(Tracker{name, std::move(assign)});
+    }
+
+    void TrackFields(SetStatement* stmt)
+    {
+        if (m_nestingLevel != 0)
+            return;
+
+        auto& fields = stmt->GetFields();
+        for (size_t idx = 0; idx != fields.size(); ++ idx)
+            Track(fields[idx], [stmt, idx](size_t root) { stmt->SetFieldMemoRoot(idx, root); });
+    }
+
+    void ProcessExpression(const ExpressionEvaluatorPtr<>& expr)
+    {
+        if (!expr)
+            return;
+
+        if (auto subscript = dynamic_cast<SubscriptExpression*>(expr.get()))
+            AddPath(subscript);
+        else if (auto call = dynamic_cast<CallExpression*>(expr.get()))
+            AddCall(call);
+
+        // Arguments of the filters and testers aren't subexpressions, so they are processed separately
+        if (auto filtered = dynamic_cast<FilteredExpression*>(expr.get()))
+        {
+            ProcessFilter(filtered->GetFilter().get());
+        }
+        else if (auto isExpr = dynamic_cast<IsExpression*>(expr.get()))
+        {
+            if (isExpr->InvokesCallables())
+                m_callsUnknown = true;
+            ProcessParams(isExpr->GetParams());
+        }
+
+        expr->FoldSubexpressions([this](ExpressionEvaluatorPtr<>& subexpr) { ProcessExpression(subexpr); });
+    }
+
+    void ProcessFilter(ExpressionFilter* filter)
+    {
+        if (filter && filter->InvokesCallables())
+            m_callsUnknown = true;
+        for (; filter; filter = filter->GetParentFilter().get())
+            ProcessParams(filter->GetParams());
+    }
+
+    // Macros of this template and the `loop` callables render the template code only, which is checked here as well
+    void AddCall(CallExpression* expr)
+    {
+        auto& callee = expr->GetValueRef();
+        ValueRefExpression* ref = dynamic_cast<ValueRefExpression*>(callee.get());
+        if (!ref)
+        {
+            if (auto subscript = dynamic_cast<SubscriptExpression*>(callee.get()))
+                ref = dynamic_cast<ValueRefExpression*>(subscript->GetValue().get());
+            if (!ref || ref->GetValueName() != "loop")
+                m_callsUnknown = true;
+            return;
+        }
+
+        if (ref->GetValueName() != "loop")
+            m_calledNames.insert(ref->GetValueName());
+    }
+
+    void ProcessParams(const CallParamsInfo& params)
+    {
+        for (auto& p : params.posParams)
+            ProcessExpression(p);
+        for (auto& p : params.kwParams)
+            ProcessExpression(p.second);
+    }
+
+    void AddPath(SubscriptExpression* expr)
+    {
+        auto ref = dynamic_cast<ValueRefExpression*>(expr->GetValue().get());
+        if (!ref || !m_visited.insert(expr).second)
+            return;
+
+        // Subscripts are length-prefixed, so the different paths never produce the same key
+        std::string key = ref->GetValueName();
+        for (auto& idx : expr->GetIndexes())
+        {
+            auto constant = dynamic_cast<ConstantExpression*>(idx.get());
+            if (!constant)
+                return;
+
+            auto& value = constant->GetValue();
+            if (auto str = GetIf<std::string>(&value))
+                key += "|s" + std::to_string(str->size()) + ":" + *str;
+            else if (auto num = GetIf<int64_t>(&value))
+                key += "|i" + std::to_string(*num);
+            else if (auto targetStr = GetIf<TargetString>(&value))
+            {
+                auto str = nonstd::get_if<std::string>(targetStr);
+                if (!str)
+                    return;
+                key += "|t" + std::to_string(str->size()) + ":" + *str;
+            }
+            else
+                return;
+        }
+
+        auto& path = m_paths[key];
+        path.rootName = ref->GetValueName();
+        path.exprs.push_back(expr);
+    }
+
+private:
+    const void* m_owner;
+    std::unordered_map<std::string, Path> m_paths;
+    std::unordered_set<SubscriptExpression*> m_visited;
+    std::unordered_multiset<std::string> m_tracked;
+    std::vector<Tracker> m_trackers;
+    std::unordered_set<std::string> m_macroNames;
+    std::unordered_set<std::string> m_calledNames;
+    std::vector<IncludeStatement*> m_contextIncludes;
+    bool m_callsUnknown = false;
+    bool m_assignsUnknown = false;
+    int m_nestingLevel = 0;
+};
+} // jinja2
+
+#endif // PATH_MEMOIZER_H
@@ -5,9 +5,14 @@
 
 #include <nonstd/expected.hpp>
 #include <jinja2cpp/error_info.h>
+#include <jinja2cpp/render_limits.h>
 
+#include <chrono>
+#include <cstdint>
+#include <limits>
 #include <list>
 #include <deque>
+#include <vector>
 
 namespace jinja2
 {
@@ -27,6 +32,82 @@ struct IRendererCallback
     virtual void ThrowRuntimeError(ErrorCode code, ValuesList extraParams) = 0;
 };
 
+// Tracks resources consumed by the single rendering and aborts it when one of the limits is exceeded. Render context has no
+// budget at all if no limits are set, so unlimited renderings pay only for the null pointer checks
+class RenderBudget
+{
+public:
+    explicit RenderBudget(const RenderLimits& limits)
+        : m_limits(limits)
+    {
+        RestartTimer();
+    }
+
+    static bool HasLimits(const RenderLimits& limits)
+    {
+        return limits.maxOutputSize != 0 || limits.maxLoopIterations != 0 || limits.maxCallDepth != 0 || limits.timeout.count() != 0;
+    }
+
+    bool HasOutputLimit() const { return m_limits.maxOutputSize != 0; }
+
+    void RestartTimer()
+    {
+        if (m_limits.timeout.count() != 0)
+            m_deadline = std::chrono::steady_clock::now() + m_limits.timeout;
+    }
+
+    void OnOutput(size_t size, IRendererCallback* callback)
+    {
+        m_outputSize += size;
+        if (m_outputSize > m_limits.maxOutputSize)
+            callback->ThrowRuntimeError(ErrorCode::RenderLimitExceeded, ValuesList{Value("maxOutputSize")});
+    }
+
+    void OnLoopIteration(IRendererCallback* callback)
+    {
+        if (m_limits.maxLoopIterations != 0 && ++ m_loopIterations > m_limits.maxLoopIterations)
+            callback->ThrowRuntimeError(ErrorCode::RenderLimitExceeded, ValuesList{Value("maxLoopIterations")});
+        CheckDeadline(callback);
+    }
+
+    void EnterCall(IRendererCallback* callback)
+    {
+        if (m_limits.maxCallDepth != 0 && ++ m_callDepth > m_limits.maxCallDepth)
+        {
+            -- m_callDepth;
+            callback->ThrowRuntimeError(ErrorCode::RenderLimitExceeded, ValuesList{Value("maxCallDepth")});
+        }
+        CheckDeadline(callback);
+    }
+
+    void ExitCall()
+    {
+        if (m_limits.maxCallDepth != 0)
+            -- m_callDepth;
+    }
+
+private:
+    void CheckDeadline(IRendererCallback* callback)
+    {
+        if (m_limits.timeout.count() != 0 && std::chrono::steady_clock::now() > m_deadline)
+            callback->ThrowRuntimeError(ErrorCode::RenderLimitExceeded, ValuesList{Value("timeout")});
+    }
+
+private:
+    RenderLimits m_limits;
+    size_t m_outputSize = 0;
+    size_t m_loopIterations = 0;
+    size_t m_callDepth = 0;
+    std::chrono::steady_clock::time_point m_deadline;
+};
+
+#if !defined(_MSC_VER) || _MSC_VER > 1900
+static_assert(!InternalValueMap::is_flat_map, "Slot bindings require the stable addresses of the scope values");
+#endif
+
+// Index of the variable slot which is assigned by the SlotResolver to the statically resolved variable references
+constexpr size_t InvalidSlot = std::numeric_limits<size_t>::max();
+
 class RenderContext
 {
 public:
@@ -43,15 +124,22 @@ public:
         : m_externalScope(other.m_externalScope)
         , m_globalScope(other.m_globalScope)
         , m_scopes(other.m_scopes)
+        , m_scopeIds(other.m_scopeIds)
+        , m_lastScopeId(other.m_lastScopeId)
         , m_rendererCallback(other.m_rendererCallback)
         , m_boundScope(other.m_boundScope)
+        , m_budget(other.m_budget)
+        , m_memoOwner(other.m_memoOwner)
     {   
+        // Slot bindings refer to the values of the source context, so they aren't copied. Memoized paths are evaluated again, because
+        // the copy can change the bindings independently
         m_currentScope = &m_scopes.back();
     }
 
     InternalValueMap& EnterScope()
     {
         m_scopes.push_back(InternalValueMap());
+        m_scopeIds.push_back(++ m_lastScopeId);
         m_currentScope = &m_scopes.back();
         return *m_currentScope;
     }
@@ -59,6 +147,7 @@ public:
     void ExitScope()
     {
         m_scopes.pop_back();
+        m_scopeIds.pop_back();
         if (!m_scopes.empty())
             m_currentScope = &m_scopes.back();
         else
@@ -97,6 +186,21 @@ public:
         return finder(*m_globalScope);
     }
 
+    // Returns true if the value is set within the context or passed with the render params, so it shadows the global value with the
+    // same name
+    bool IsShadowed(const std::string& val) const
+    {
+        if (m_boundScope && m_boundScope->count(val) != 0)
+            return true;
+
+        for (auto& scope : m_scopes)
+        {
+            if (scope.count(val) != 0)
+                return true;
+        }
+        return m_externalScope->count(val) != 0;
+    }
+
     auto& GetCurrentScope() const
     {
         return *m_currentScope;
@@ -117,7 +221,11 @@ public:
     RenderContext Clone(bool includeCurrentContext) const
     {
         if (!includeCurrentContext)
-            return RenderContext(m_emptyScope, *m_globalScope, m_rendererCallback);
+        {
+            RenderContext result(m_emptyScope, *m_globalScope, m_rendererCallback);
+            result.m_budget = m_budget;
+            return result;
+        }
 
         return RenderContext(*this);
     }
@@ -126,14 +234,142 @@ public:
     {
         m_boundScope = scope;
     }
+
+    // Binds the slot to the value which is stored in the current scope by the `binder` statement
+    void BindSlot(size_t slot, const void* binder, const InternalValue& value)
+    {
+        if (m_slots.size() <= slot)
+            m_slots.resize(slot + 1);
+
+        auto& binding = m_slots[slot];
+        binding.binder = binder;
+        binding.value = &value;
+        binding.scopeIdx = m_scopeIds.size() - 1;
+        binding.scopeId = m_scopeIds.back();
+    }
+    void UnbindSlot(size_t slot)
+    {
+        if (slot < m_slots.size())
+            m_slots[slot].binder = nullptr;
+    }
+    // Returns nullptr if the slot isn't bound by the `binder` or its scope has already gone (e.g. binding was made by the finished
+    // recursive call). Caller should fall back to the FindValue in this case
+    const InternalValue* FindSlot(size_t slot, const void* binder) const
+    {
+        if (slot >= m_slots.size() || m_boundScope)
+            return nullptr;
+
+        auto& binding = m_slots[slot];
+        if (binding.binder != binder || binding.scopeIdx >= m_scopeIds.size() || m_scopeIds[binding.scopeIdx] != binding.scopeId)
+            return nullptr;
+
+        return binding.value;
+    }
+
+    // Enables the memoized paths of the renderers tree of the `owner`. Paths of the other trees (included or parent templates, imported
+    // macros) are evaluated as usual, because their roots can be rebound by the statements which don't invalidate them
+    void SetMemoOwner(const void* owner)
+    {
+        m_memoOwner = owner;
+    }
+    // Returns nullptr if the path isn't evaluated yet or the binding of its root variable is changed since the evaluation
+    const InternalValue* FindMemo(const void* owner, size_t memo, size_t root) const
+    {
+        if (owner != m_memoOwner || memo >= m_memos.size())
+            return nullptr;
+
+        auto& entry = m_memos[memo];
+        if (!entry.isValid || entry.epoch != m_memoEpochs[root])
+            return nullptr;
+
+        return &entry.value;
+    }
+    void StoreMemo(const void* owner, size_t memo, size_t root, InternalValue value)
+    {
+        if (owner != m_memoOwner)
+            return;
+
+        if (m_memos.size() <= memo)
+            m_memos.resize(memo + 1);
+        if (m_memoEpochs.size() <= root)
+            m_memoEpochs.resize(root + 1);
+
+        auto& entry = m_memos[memo];
+        entry.value = std::move(value);
+        entry.epoch = m_memoEpochs[root];
+        entry.isValid = true;
+    }
+    // Drops the memoized paths of the `root` variable. Should be called every time the variable is bound, rebound or goes out of scope
+    void InvalidateMemos(size_t root)
+    {
+        if (root < m_memoEpochs.size())
+            ++ m_memoEpochs[root];
+    }
+
+    void SetRenderBudget(RenderBudget* budget)
+    {
+        m_budget = budget;
+    }
+    RenderBudget* GetRenderBudget() const
+    {
+        return m_budget;
+    }
+    void OnLoopIteration()
+    {
+        if (m_budget)
+            m_budget->OnLoopIteration(m_rendererCallback);
+    }
+
+    // Accounts nesting of the macro calls, recursive loops and included templates
+    class CallGuard
+    {
+    public:
+        explicit CallGuard(RenderContext& context)
+            : m_budget(context.m_budget)
+        {
+            if (m_budget)
+                m_budget->EnterCall(context.m_rendererCallback);
+        }
+        CallGuard(const CallGuard&) = delete;
+        CallGuard& operator=(const CallGuard&) = delete;
+        ~CallGuard()
+        {
+            if (m_budget)
+                m_budget->ExitCall();
+        }
+
+    private:
+        RenderBudget* m_budget;
+    };
 private:
+    struct SlotBinding
+    {
+        const void* binder = nullptr;
+        const InternalValue* value = nullptr;
+        size_t scopeIdx = 0;
+        uint64_t scopeId = 0;
+    };
+    struct MemoEntry
+    {
+        InternalValue value;
+        uint64_t epoch = 0;
+        bool isValid = false;
+    };
+
     InternalValueMap* m_currentScope;
     const InternalValueMap* m_externalScope;
     const InternalValueMap* m_globalScope;
     InternalValueMap m_emptyScope;
     std::deque<InternalValueMap> m_scopes;
+    std::vector<uint64_t> m_scopeIds;
+    uint64_t m_lastScopeId = 0;
+    std::vector<SlotBinding> m_slots;
     IRendererCallback* m_rendererCallback;
     const InternalValueMap* m_boundScope = nullptr;
+    RenderBudget* m_budget = nullptr;
+    const void* m_memoOwner = nullptr;
+    std::vector<MemoEntry> m_memos;
+    std::vector<uint64_t> m_memoEpochs;
 };
 } // jinja2
 
@@ -8,6 +8,9 @@
 #include "render_context.h"
 #include "ast_visitor.h"
 
+#include <algorithm>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -15,11 +18,59 @@
 
 namespace jinja2
 {
+// Rendering which can be suspended and continued later. Renderers tree is shared between the renderings, so the renderers which can be
+// suspended in the middle keep their resume points in the frames of the rendering. Frames are stacked in the order of the renderers nesting
+class ResumableRender
+{
+public:
+    struct Frame
+    {
+        virtual ~Frame() = default;
+    };
+
+    virtual ~ResumableRender() = default;
+
+    // Checked by the renderers before the next part of the output
+    virtual bool ShouldSuspend() const = 0;
+
+    // Returns the frame of the entered renderer. Frame is created on the first entry and is kept until the renderer is finished
+    template<typename FrameT>
+    FrameT& EnterFrame()
+    {
+        if (m_depth == m_frames.size())
+            m_frames.push_back(std::make_unique<FrameT>());
+        return static_cast<FrameT&>(*m_frames[m_depth ++]);
+    }
+    // Leaves the frame of the suspended renderer. Its resume point is used by the next resume
+    bool Suspend()
+    {
+        -- m_depth;
+        return false;
+    }
+    // Removes the frame of the finished renderer
+    bool Finish()
+    {
+        m_frames.resize(-- m_depth);
+        return true;
+    }
+
+private:
+    std::vector<std::unique_ptr<Frame>> m_frames;
+    size_t m_depth = 0;
+};
+
 class RendererBase
 {
 public:
     virtual ~RendererBase() = default;
     virtual void Render(OutStream& os, RenderContext& values) = 0;
+    // Renders the output until the suspension is requested. Returns false if the renderer is suspended. By default renderer is rendered
+    // at once
+    virtual bool Resume(OutStream& os, RenderContext& values, ResumableRender&)
+    {
+        Render(os, values);
+        return true;
+    }
 };
 
 class VisitableRendererBase : public RendererBase,  public VisitableStatement
@@ -37,13 +88,37 @@ public:
     {
         m_renderers.push_back(std::move(r));
     }
+    auto& GetRenderers() const
+    {
+        return m_renderers;
+    }
+    void SetRenderers(std::vector<RendererPtr> renderers)
+    {
+        m_renderers = std::move(renderers);
+    }
     void Render(OutStream& os, RenderContext& values) override
     {
         for (auto& r : m_renderers)
             r->Render(os, values);
     }
+    bool Resume(OutStream& os, RenderContext& values, ResumableRender& render) override
+    {
+        auto& frame = render.EnterFrame<Frame>();
+        for (; frame.index != m_renderers.size(); ++ frame.index)
+        {
+            if (render.ShouldSuspend() || !m_renderers[frame.index]->Resume(os, values, render))
+                return render.Suspend();
+        }
+        return render.Finish();
+    }
 
 private:
+    // Index of the renderer to resume with
+    struct Frame : ResumableRender::Frame
+    {
+        size_t index = 0;
+    };
+
     std::vector<RendererPtr> m_renderers;
 };
 
@@ -58,15 +133,80 @@ public:
     {
     }
 
+    auto GetData() const {return m_ptr;}
+    auto GetLength() const {return m_length;}
+
     void Render(OutStream& os, RenderContext&) override
     {
         os.WriteBuffer(m_ptr, m_length);
     }
+protected:
+    void SetData(const void* ptr, size_t len)
+    {
+        m_ptr = ptr;
+        m_length = len;
+    }
 private:
     const void* m_ptr;
     size_t m_length;
 };
 
+// Storage of the raw text which isn't the part of the template source (i.e. produced by the parse-time optimizations). Text is kept
+// while the storage exists, so the rendered segments can refer to it the same way as to the template source
+template<typename CharT>
+class OwnedTextPool
+{
+public:
+    const std::basic_string<CharT>& Add(std::basic_string<CharT> text)
+    {
+        m_texts.push_back(std::move(text));
+        auto& added = m_texts.back();
+        Range range{added.data(), added.data() + added.size()};
+        m_ranges.insert(std::upper_bound(m_ranges.begin(), m_ranges.end(), range.begin, IsBefore), range);
+        return added;
+    }
+
+    bool Contains(const CharT* ptr, size_t length) const
+    {
+        auto p = std::upper_bound(m_ranges.begin(), m_ranges.end(), ptr, IsBefore);
+        if (p == m_ranges.begin())
+            return false;
+        -- p;
+        return !std::greater<const CharT*>()(ptr + length, p->end);
+    }
+
+private:
+    struct Range
+    {
+        const CharT* begin;
+        const CharT* end;
+    };
+
+    // Texts live in the unrelated arrays, so the pointers are compared with std::less which gives the total order for them
+    static bool IsBefore(const CharT* ptr, const Range& range) { return std::less<const CharT*>()(ptr, range.begin); }
+
+private:
+    std::deque<std::basic_string<CharT>> m_texts;
+    std::vector<Range> m_ranges;
+};
+
+// Raw text which isn't the part of the template source. Text is kept by the pool of the renderers tree
+template<typename CharT>
+class OwnedTextRenderer : public RawTextRenderer
+{
+public:
+    OwnedTextRenderer(std::shared_ptr<OwnedTextPool<CharT>> pool, std::basic_string<CharT> text)
+        : RawTextRenderer(nullptr, 0)
+        , m_pool(std::move(pool))
+    {
+        auto& owned = m_pool->Add(std::move(text));
+        SetData(owned.data(), owned.size());
+    }
+
+private:
+    std::shared_ptr<OwnedTextPool<CharT>> m_pool;
+};
+
 class ExpressionRenderer : public VisitableRendererBase
 {
 public:
@@ -77,6 +217,8 @@ public:
     {
     }
 
+    auto& GetExpression() const {return m_expression;}
+
     void Render(OutStream& os, RenderContext& values) override
     {
         m_expression->Render(os, values);
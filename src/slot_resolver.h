@@ -0,0 +1,318 @@
+#ifndef SLOT_RESOLVER_H
+#define SLOT_RESOLVER_H
+
+#include "renderer.h"
+#include "statements.h"
+
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace jinja2
+{
+// Parse-time pass which resolves the references to the loop variables, `set` targets and macro parameters to the frame slots. Reference
+// gets the slot only if no other scope between the reference and the binding statement can contain the variable of the same name, so
+// the slot value is the same as the name lookup result. The rest of the references (render params, globals, variables which can be
+// assigned dynamically) are looked up by name as usual
+class SlotResolver : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    void Resolve(const RendererPtr& renderer)
+    {
+        EnterRegion(true);
+        Process(renderer);
+        ExitRegion();
+
+        for (auto& b : m_bindings)
+        {
+            if (b.slot != InvalidSlot)
+                b.assign(b.slot);
+        }
+    }
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        auto visibleCount = m_visible.size();
+        for (auto& r : renderer->GetRenderers())
+            Process(r);
+        m_visible.resize(visibleCount);
+    }
+
+    void DoVisit(ExpressionRenderer* renderer) override
+    {
+        ResolveExpression(renderer->GetExpression());
+    }
+
+    void DoVisit(IfStatement* stmt) override
+    {
+        ResolveExpression(stmt->GetCondition());
+        Process(stmt->GetMainBody());
+        for (auto& branch : stmt->GetElseBranches())
+        {
+            ResolveExpression(branch->GetCondition());
+            Process(branch->GetMainBody());
+        }
+    }
+
+    void DoVisit(ForStatement* stmt) override
+    {
+        ResolveExpression(stmt->GetValue());
+
+        // Loop variables live in the loop scope, and the body is rendered in the nested scope which is recreated for every iteration
+        auto& vars = stmt->GetVars();
+        EnterRegion(false);
+        for (auto& v : vars)
+            m_regions.back().assigned.insert(v);
+        m_regions.back().assigned.insert("loop");
+        CollectAssigned(stmt->GetElseBody());
+
+        auto visibleCount = m_visible.size();
+        for (size_t idx = 0; idx != vars.size(); ++ idx)
+            AddBinding(vars[idx], stmt, [stmt, idx](size_t slot) { stmt->SetVarSlot(idx, slot); });
+        AddBinding("loop", stmt, [stmt](size_t slot) { stmt->SetLoopSlot(slot); });
+
+        EnterRegion(false);
+        CollectAssigned(stmt->GetMainBody());
+        Process(stmt->GetMainBody());
+        ExitRegion();
+
+        m_visible.resize(visibleCount);
+        Process(stmt->GetElseBody());
+        ExitRegion();
+    }
+
+    void DoVisit(SetLineStatement* stmt) override
+    {
+        ResolveExpression(stmt->GetExpression());
+        AddSetBindings(stmt);
+    }
+
+    void DoVisit(SetRawBlockStatement* stmt) override
+    {
+        ProcessIsolated(stmt->GetBody());
+        AddSetBindings(stmt);
+    }
+
+    void DoVisit(SetFilteredBlockStatement* stmt) override
+    {
+        ProcessIsolated(stmt->GetBody());
+        AddSetBindings(stmt);
+    }
+
+    void DoVisit(MacroStatement* stmt) override
+    {
+        ProcessMacro(stmt);
+    }
+
+    void DoVisit(MacroCallStatement* stmt) override
+    {
+        ProcessMacro(stmt);
+    }
+
+    void DoVisit(ParentBlockStatement* stmt) override
+    {
+        ProcessIsolated(stmt->GetMainBody());
+    }
+
+    void DoVisit(BlockStatement* stmt) override
+    {
+        ProcessIsolated(stmt->GetMainBody());
+    }
+
+    void DoVisit(ExtendsStatement* stmt) override
+    {
+        for (auto& block : stmt->GetBlocks())
+            Visit(block.second.get());
+    }
+
+    void DoVisit(WithStatement* stmt) override
+    {
+        ProcessIsolated(stmt->GetMainBody());
+    }
+
+    void DoVisit(FilterStatement* stmt) override
+    {
+        ProcessIsolated(stmt->GetBody());
+    }
+
+private:
+    struct Binding
+    {
+        std::string name;
+        const void* binder;
+        size_t regionIdx;
+        std::function<void (size_t)> assign;
+        size_t slot;
+    };
+
+    struct Region
+    {
+        std::unordered_set<std::string> assigned;
+        bool assignsAny = false;
+        // Isolated regions are rendered with the context copy, so the bindings of the outer regions aren't visible inside
+        bool isIsolated;
+        size_t visibleBegin;
+    };
+
+    // Collects names which can be assigned to the scope of the current region by the statements of the body
+    class AssignedNamesCollector : public StatementVisitor
+    {
+    public:
+        using StatementVisitor::DoVisit;
+
+        explicit AssignedNamesCollector(Region& region)
+            : m_region(region)
+        {
+        }
+
+        void Collect(const RendererPtr& renderer)
+        {
+            auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+            if (stmt)
+                Visit(stmt);
+        }
+
+        void DoVisit(ComposedRenderer* renderer) override
+        {
+            for (auto& r : renderer->GetRenderers())
+                Collect(r);
+        }
+
+        void DoVisit(IfStatement* stmt) override
+        {
+            Collect(stmt->GetMainBody());
+            for (auto& branch : stmt->GetElseBranches())
+                Collect(branch->GetMainBody());
+        }
+
+        void DoVisit(SetLineStatement* stmt) override { AddFields(stmt); }
+        void DoVisit(SetRawBlockStatement* stmt) override { AddFields(stmt); }
+        void DoVisit(SetFilteredBlockStatement* stmt) override { AddFields(stmt); }
+        void DoVisit(MacroStatement* stmt) override { m_region.assigned.insert(stmt->GetName()); }
+        void DoVisit(MacroCallStatement*) override { m_region.assigned.insert("caller"); }
+        // Imported names and the variables of the included templates aren't known at parse time
+        void DoVisit(ImportStatement*) override { m_region.assignsAny = true; }
+        void DoVisit(IncludeStatement*) override { m_region.assignsAny = true; }
+        void DoVisit(ExtendsStatement*) override { m_region.assignsAny = true; }
+
+    private:
+        void AddFields(const SetStatement* stmt)
+        {
+            for (auto& f : stmt->GetFields())
+                m_region.assigned.insert(f);
+        }
+
+    private:
+        Region& m_region;
+    };
+
+    void Process(const RendererPtr& renderer)
+    {
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+        if (stmt)
+            Visit(stmt);
+    }
+
+    void ProcessIsolated(const RendererPtr& renderer)
+    {
+        EnterRegion(true);
+        Process(renderer);
+        ExitRegion();
+    }
+
+    void ProcessMacro(MacroStatement* stmt)
+    {
+        // Macro is invoked with the context of the call site, so only own parameters and variables are resolved
+        EnterRegion(true);
+        auto& params = stmt->GetParams();
+        for (size_t idx = 0; idx != params.size(); ++ idx)
+            AddBinding(params[idx].paramName, stmt, [stmt, idx](size_t slot) { stmt->SetParamSlot(idx, slot); });
+        Process(stmt->GetMainBody());
+        ExitRegion();
+    }
+
+    void AddSetBindings(SetStatement* stmt)
+    {
+        auto& fields = stmt->GetFields();
+        for (size_t idx = 0; idx != fields.size(); ++ idx)
+            AddBinding(fields[idx], stmt, [stmt, idx](size_t slot) { stmt->SetFieldSlot(idx, slot); });
+    }
+
+    void EnterRegion(bool isIsolated)
+    {
+        Region region;
+        region.isIsolated = isIsolated;
+        region.visibleBegin = isIsolated ? m_visible.size() : m_regions.back().visibleBegin;
+        m_regions.push_back(std::move(region));
+    }
+
+    void ExitRegion()
+    {
+        if (m_regions.back().isIsolated)
+            m_visible.resize(m_regions.back().visibleBegin);
+        m_regions.pop_back();
+    }
+
+    void CollectAssigned(const RendererPtr& renderer)
+    {
+        AssignedNamesCollector collector(m_regions.back());
+        collector.Collect(renderer);
+    }
+
+    void AddBinding(const std::string& name, const void* binder, std::function<void (size_t)> assign)
+    {
+        m_visible.push_back(m_bindings.size());
+        m_bindings.push_back(Binding{name, binder, m_regions.size() - 1, std::move(assign), InvalidSlot});
+    }
+
+    void ResolveExpression(const ExpressionEvaluatorPtr<>& expr)
+    {
+        if (!expr)
+            return;
+
+        if (auto ref = dynamic_cast<ValueRefExpression*>(expr.get()))
+        {
+            ResolveReference(ref);
+            return;
+        }
+
+        expr->FoldSubexpressions([this](ExpressionEvaluatorPtr<>& subexpr) { ResolveExpression(subexpr); });
+    }
+
+    void ResolveReference(ValueRefExpression* ref)
+    {
+        auto& name = ref->GetValueName();
+        auto visibleBegin = m_regions.back().visibleBegin;
+        for (auto idx = m_visible.size(); idx != visibleBegin; -- idx)
+        {
+            auto& binding = m_bindings[m_visible[idx - 1]];
+            if (binding.name != name)
+                continue;
+
+            // Variable can be shadowed in the scopes of the nested regions
+            for (auto regionIdx = binding.regionIdx + 1; regionIdx < m_regions.size(); ++ regionIdx)
+            {
+                auto& region = m_regions[regionIdx];
+                if (region.assignsAny || region.assigned.count(name) != 0)
+                    return;
+            }
+
+            if (binding.slot == InvalidSlot)
+                binding.slot = m_slotsCount ++;
+            ref->SetSlot(binding.slot, binding.binder);
+            return;
+        }
+    }
+
+private:
+    std::vector<Region> m_regions;
+    std::vector<Binding> m_bindings;
+    std::vector<size_t> m_visible;
+    size_t m_slotsCount = 0;
+};
+} // jinja2
+
+#endif // SLOT_RESOLVER_H
@@ -1,11 +1,14 @@
 #include "statements.h"
 
 #include "expression_evaluator.h"
+#include "generic_adapters.h"
 #include "template_impl.h"
 #include "value_visitors.h"
 
+#include <boost/container/small_vector.hpp>
 #include <boost/core/null_deleter.hpp>
 
+#include <algorithm>
 #include <string>
 
 using namespace std::string_literals;
@@ -20,15 +23,233 @@ void ForStatement::Render(OutStream& os, RenderContext& values)
     RenderLoop(loopVal, os, values, 0);
 }
 
+namespace
+{
+// Value of the `loop` variable. Members are computed on request from the state of the current iteration, so the iterations don't
+// update any map
+class LoopAccessor : public MapAccessorImpl<LoopAccessor>
+{
+public:
+    struct State
+    {
+        bool isStarted = false;
+        bool isLast = false;
+        size_t index0 = 0;
+        bool hasLength = false;
+        InternalValue length;
+        const InternalValue* prevItem = nullptr;
+        const InternalValue* nextItem = nullptr;
+        // Empty if the loop isn't recursive
+        InternalValue recursiveCall;
+        int level = 0;
+    };
+
+    explicit LoopAccessor(const State* state)
+        : m_state(state)
+    {
+    }
+
+    size_t GetSize() const override { return GetKeys().size(); }
+    bool HasValue(const std::string& name) const override { return FindItem(name, nullptr); }
+    InternalValue GetItem(const std::string& name) const override
+    {
+        InternalValue result;
+        FindItem(name, &result);
+        return result;
+    }
+    std::vector<std::string> GetKeys() const override
+    {
+        std::vector<std::string> result;
+        for (auto& key : {"index"s, "index0"s, "first"s, "last"s, "previtem"s, "nextitem"s, "length"s, "cycle"s, "operator()"s, "depth"s, "depth0"s})
+        {
+            if (FindItem(key, nullptr))
+                result.push_back(key);
+        }
+        return result;
+    }
+    bool ShouldExtendLifetime() const override { return false; }
+    GenericMap CreateGenericMap() const override
+    {
+        return GenericMap([accessor = *this]() -> const MapItemAccessor* { return &accessor; });
+    }
+
+private:
+    // Returns false if the loop has no such member at the moment. Value is stored to `value` if it isn't nullptr
+    bool FindItem(const std::string& name, InternalValue* value) const
+    {
+        auto& state = *m_state;
+        auto found = [value](InternalValue val) {
+            if (value)
+                *value = std::move(val);
+            return true;
+        };
+
+        if (state.isStarted)
+        {
+            if (name == "index")
+                return found(static_cast<int64_t>(state.index0 + 1));
+            if (name == "index0")
+                return found(static_cast<int64_t>(state.index0));
+            if (name == "first")
+                return found(state.index0 == 0);
+            if (name == "last")
+                return found(state.isLast);
+            if (name == "previtem" && state.index0 != 0)
+                return found(*state.prevItem);
+            if (name == "nextitem" && !state.isLast)
+                return found(*state.nextItem);
+        }
+        if (state.hasLength)
+        {
+            if (name == "length")
+                return found(state.length);
+            if (name == "cycle")
+                return found(static_cast<int64_t>(LoopCycleFn));
+        }
+        if (!state.recursiveCall.IsEmpty())
+        {
+            if (name == "operator()")
+                return found(state.recursiveCall);
+            if (name == "depth")
+                return found(static_cast<int64_t>(state.level + 1));
+            if (name == "depth0")
+                return found(static_cast<int64_t>(state.level));
+        }
+        return false;
+    }
+
+private:
+    const State* m_state;
+};
+} // namespace
+
+// State of the loop between the iterations. It's kept on the stack by the regular rendering and in the frame by the resumable one
+struct ForStatement::LoopFrame : ResumableRender::Frame
+{
+    enum class Stage
+    {
+        Start,
+        Items,
+        Body,
+        Else
+    };
+
+    // Reads the rest of the items to find out the size of the filtered list
+    void MakeIndexedList()
+    {
+        if (isLast)
+            listSize = itemIdx;
+
+        InternalValueList items;
+        do
+        {
+            items.push_back(enumerator->GetCurrent());
+        } while (enumerator->MoveNext());
+
+        listSize = itemIdx + items.size() + 1;
+        indexedList = ListAdapter::CreateAdapter(std::move(items));
+        enumerator = indexedList.GetEnumerator();
+        isLast = !enumerator->MoveNext();
+    }
+
+    Stage stage = Stage::Start;
+    LoopAccessor::State loopState;
+    ListAdapter loopItems;
+    ListAdapter filteredList;
+    ListAdapter indexedList;
+    ListAccessorEnumeratorPtr enumerator;
+    nonstd::optional<size_t> listSize;
+    size_t itemIdx = 0;
+    // Also set if the loop value isn't iterable
+    bool isLast = true;
+    InternalValue prevValue;
+    InternalValue curValue;
+    InternalValue nextValue;
+};
+
 void ForStatement::RenderLoop(const InternalValue& loopVal, OutStream& os, RenderContext& values, int level)
+{
+    LoopFrame frame;
+    StartLoop(frame, loopVal, values, level);
+    while (NextItem(frame, values))
+    {
+        values.EnterScope();
+        m_mainBody->Render(os, values);
+        values.ExitScope();
+    }
+
+    if (!frame.loopState.isStarted && m_elseBody)
+        m_elseBody->Render(os, values);
+
+    values.ExitScope();
+    InvalidateVarMemos(values);
+}
+
+bool ForStatement::Resume(OutStream& os, RenderContext& values, ResumableRender& render)
+{
+    using Stage = LoopFrame::Stage;
+
+    auto& frame = render.EnterFrame<LoopFrame>();
+    if (frame.stage == Stage::Start)
+    {
+        StartLoop(frame, m_value->Evaluate(values), values, 0);
+        frame.stage = Stage::Items;
+    }
+
+    while (frame.stage != Stage::Else)
+    {
+        if (frame.stage == Stage::Body)
+        {
+            if (!m_mainBody->Resume(os, values, render))
+                return render.Suspend();
+            values.ExitScope();
+            frame.stage = Stage::Items;
+        }
+
+        if (render.ShouldSuspend())
+            return render.Suspend();
+
+        if (!NextItem(frame, values))
+        {
+            frame.stage = Stage::Else;
+            break;
+        }
+        values.EnterScope();
+        frame.stage = Stage::Body;
+    }
+
+    if (!frame.loopState.isStarted && m_elseBody && !m_elseBody->Resume(os, values, render))
+        return render.Suspend();
+
+    values.ExitScope();
+    InvalidateVarMemos(values);
+    return render.Finish();
+}
+
+// Enters the loop scope and prepares the items enumeration
+void ForStatement::StartLoop(LoopFrame& frame, const InternalValue& loopVal, RenderContext& values, int level)
 {
     auto& context = values.EnterScope();
 
-    InternalValueMap loopVar;
-    context["loop"s] = CreateMapAdapter(&loopVar);
+    auto& loopState = frame.loopState;
+    if (m_isLoopVarUsed || m_isRecursive)
+    {
+        auto& loopRef = context["loop"s];
+        loopRef = MapAdapter([accessor = LoopAccessor(&loopState)]() mutable { return &accessor; });
+        if (m_loopSlot != InvalidSlot)
+            values.BindSlot(m_loopSlot, this, loopRef);
+    }
+    // Variables of the outer recursive call shouldn't be visible through the slots until they are assigned
+    for (auto slot : m_varSlots)
+    {
+        if (slot != InvalidSlot)
+            values.UnbindSlot(slot);
+    }
+    InvalidateVarMemos(values);
     if (m_isRecursive)
     {
-        loopVar["operator()"s] = Callable(Callable::GlobalFunc, [this, level](const CallParams& params, OutStream& stream, RenderContext& context) {
+        loopState.level = level;
+        loopState.recursiveCall = Callable(Callable::GlobalFunc, [this, level](const CallParams& params, OutStream& stream, RenderContext& context) {
             bool isSucceeded = false;
             auto parsedParams = helpers::ParseCallParams({ { "var", true } }, params, isSucceeded);
             if (!isSucceeded)
@@ -38,129 +259,108 @@ void ForStatement::RenderLoop(const InternalValue& loopVal, OutStream& os, Rende
             if (var.IsEmpty())
                 return;
 
+            RenderContext::CallGuard callGuard(context);
             RenderLoop(var, stream, context, level + 1);
         });
-        loopVar["depth"s] = static_cast<int64_t>(level + 1);
-        loopVar["depth0"s] = static_cast<int64_t>(level);
     }
 
     bool isConverted = false;
-    auto loopItems = ConvertToList(loopVal, isConverted, false);
-    ListAdapter filteredList;
-    ListAdapter indexedList;
-    ListAccessorEnumeratorPtr enumerator;
-    size_t itemIdx = 0;
+    frame.loopItems = ConvertToList(loopVal, isConverted, false);
     if (!isConverted)
-    {
-        if (m_elseBody)
-            m_elseBody->Render(os, values);
-        values.ExitScope();
         return;
-    }
 
-    nonstd::optional<size_t> listSize;
     if (m_ifExpr)
     {
-        filteredList = CreateFilteredAdapter(loopItems, values);
-        enumerator = filteredList.GetEnumerator();
+        frame.filteredList = CreateFilteredAdapter(frame.loopItems, values);
+        frame.enumerator = frame.filteredList.GetEnumerator();
     }
     else
     {
-        enumerator = loopItems.GetEnumerator();
-        listSize = loopItems.GetSize();
+        frame.enumerator = frame.loopItems.GetEnumerator();
+        frame.listSize = frame.loopItems.GetSize();
     }
 
-    bool isLast = false;
-    auto makeIndexedList = [&enumerator, &listSize, &indexedList, &itemIdx, &isLast] {
-        if (isLast)
-            listSize = itemIdx;
-
-        InternalValueList items;
-        do
-        {
-            items.push_back(enumerator->GetCurrent());
-        } while (enumerator->MoveNext());
-
-        listSize = itemIdx + items.size() + 1;
-        indexedList = ListAdapter::CreateAdapter(std::move(items));
-        enumerator = indexedList.GetEnumerator();
-        isLast = !enumerator->MoveNext();
-    };
-
-    if (listSize)
+    if (frame.listSize)
     {
-        int64_t itemsNum = static_cast<int64_t>(listSize.value());
-        loopVar["length"s] = InternalValue(itemsNum);
+        int64_t itemsNum = static_cast<int64_t>(frame.listSize.value());
+        loopState.length = InternalValue(itemsNum);
     }
     else
     {
-        loopVar["length"s] = MakeDynamicProperty([&listSize, &makeIndexedList](const CallParams& /*params*/, RenderContext & /*context*/) -> InternalValue {
-            if (!listSize)
-                makeIndexedList();
-            return static_cast<int64_t>(listSize.value());
+        loopState.length = MakeDynamicProperty([&frame](const CallParams& /*params*/, RenderContext & /*context*/) -> InternalValue {
+            if (!frame.listSize)
+                frame.MakeIndexedList();
+            return static_cast<int64_t>(frame.listSize.value());
         });
     }
-    bool loopRendered = false;
-    isLast = !enumerator->MoveNext();
-    InternalValue prevValue;
-    InternalValue curValue;
-    InternalValue nextValue;
-    loopVar["cycle"s] = static_cast<int64_t>(LoopCycleFn);
-    for (; !isLast; ++itemIdx)
+    frame.isLast = !frame.enumerator->MoveNext();
+    loopState.hasLength = true;
+    loopState.prevItem = &frame.prevValue;
+    loopState.nextItem = &frame.nextValue;
+}
+
+// Moves to the next item and assigns the loop variables. Returns false if there are no more items
+bool ForStatement::NextItem(LoopFrame& frame, RenderContext& values)
+{
+    auto& loopState = frame.loopState;
+    while (!frame.isLast)
     {
-        prevValue = std::move(curValue);
-        if (itemIdx != 0)
-        {
-            std::swap(curValue, nextValue);
-            loopVar["previtem"s] = prevValue;
-        }
-        else
-            curValue = enumerator->GetCurrent();
+        if (loopState.isStarted)
+            ++ frame.itemIdx;
 
-        isLast = !enumerator->MoveNext();
-        if (!isLast)
-        {
-            nextValue = enumerator->GetCurrent();
-            loopVar["nextitem"s] = nextValue;
-        }
+        values.OnLoopIteration();
+        frame.prevValue = std::move(frame.curValue);
+        if (frame.itemIdx != 0)
+            std::swap(frame.curValue, frame.nextValue);
         else
-            loopVar.erase("nextitem"s);
+            frame.curValue = frame.enumerator->GetCurrent();
 
-        loopRendered = true;
-        loopVar["index"s] = static_cast<int64_t>(itemIdx + 1);
-        loopVar["index0"s] = static_cast<int64_t>(itemIdx);
-        loopVar["first"s] = itemIdx == 0;
-        loopVar["last"s] = isLast;
+        frame.isLast = !frame.enumerator->MoveNext();
+        if (!frame.isLast)
+            frame.nextValue = frame.enumerator->GetCurrent();
+
+        loopState.isStarted = true;
+        loopState.isLast = frame.isLast;
+        loopState.index0 = frame.itemIdx;
 
         if (m_vars.size() > 1)
         {
-            const auto& valList = ConvertToList(curValue, isConverted);
+            bool isConverted = false;
+            const auto& valList = ConvertToList(frame.curValue, isConverted);
             if (!isConverted)
                 continue;
 
             auto b = valList.begin();
             auto e = valList.end();
 
-            for (auto& varName : m_vars)
-            {
-                if (b == e)
-                    continue;
-                context[varName] = *b;
-                ++ b;
-            }
+            for (size_t varIdx = 0; varIdx != m_vars.size() && b != e; ++ varIdx, ++ b)
+                AssignVar(varIdx, *b, values);
         }
         else
-            context[m_vars[0]] = curValue;
+            AssignVar(0, frame.curValue, values);
 
-        values.EnterScope();
-        m_mainBody->Render(os, values);
-        values.ExitScope();
+        return true;
     }
+    return false;
+}
 
-    if (!loopRendered && m_elseBody)
-        m_elseBody->Render(os, values);
+void ForStatement::AssignVar(size_t varIdx, const InternalValue& value, RenderContext& values)
+{
+    auto& var = values.GetCurrentScope()[m_vars[varIdx]];
+    var = value;
+    if (m_varSlots[varIdx] != InvalidSlot)
+        values.BindSlot(m_varSlots[varIdx], this, var);
+    if (m_varMemoRoots[varIdx] != InvalidSlot)
+        values.InvalidateMemos(m_varMemoRoots[varIdx]);
+}
 
-    values.ExitScope();
+void ForStatement::InvalidateVarMemos(RenderContext& values) const
+{
+    for (auto root : m_varMemoRoots)
+    {
+        if (root != InvalidSlot)
+            values.InvalidateMemos(root);
+    }
 }
 
 ListAdapter ForStatement::CreateFilteredAdapter(const ListAdapter& loopItems, RenderContext& values) const
@@ -181,38 +381,68 @@ ListAdapter ForStatement::CreateFilteredAdapter(const ListAdapter& loopItems, Re
             {
                 tempContext[m_vars[0]] = curValue;
             }
+            InvalidateVarMemos(values);
 
             if (ConvertToBool(m_ifExpr->Evaluate(values)))
             {
                 values.ExitScope();
+                InvalidateVarMemos(values);
                 return ResultType(std::move(curValue));
             }
         }
         values.ExitScope();
+        InvalidateVarMemos(values);
 
         return ResultType();
     });
 }
 
 void IfStatement::Render(OutStream& os, RenderContext& values)
+{
+    auto body = SelectBody(values);
+    if (body)
+        body->Render(os, values);
+}
+
+namespace
+{
+// Body of the branch which is selected on the first entry
+struct BranchFrame : ResumableRender::Frame
+{
+    bool isSelected = false;
+    RendererBase* body = nullptr;
+};
+} // namespace
+
+bool IfStatement::Resume(OutStream& os, RenderContext& values, ResumableRender& render)
+{
+    auto& frame = render.EnterFrame<BranchFrame>();
+    if (!frame.isSelected)
+    {
+        frame.body = SelectBody(values);
+        frame.isSelected = true;
+    }
+
+    if (frame.body && !frame.body->Resume(os, values, render))
+        return render.Suspend();
+    return render.Finish();
+}
+
+// Returns nullptr if none of the branches should be rendered
+RendererBase* IfStatement::SelectBody(RenderContext& values) const
 {
     InternalValue val = m_expr->Evaluate(values);
     bool isTrue = Apply<visitors::BooleanEvaluator>(val);
 
     if (isTrue)
-    {
-        m_mainBody->Render(os, values);
-        return;
-    }
+        return m_mainBody.get();
 
     for (auto& b : m_elseBranches)
     {
         if (b->ShouldRender(values))
-        {
-            b->Render(os, values);
-            break;
-        }
+            return b->GetMainBody().get();
     }
+    return nullptr;
 }
 
 bool ElseBranchStatement::ShouldRender(RenderContext& values) const
@@ -231,12 +461,14 @@ void ElseBranchStatement::Render(OutStream& os, RenderContext& values)
 void SetStatement::AssignBody(InternalValue body, RenderContext& values)
 {
     auto& scope = values.GetCurrentScope();
-    if (m_fields.size() == 1)
-        scope[m_fields.front()] = std::move(body);
-    else
+    for (size_t idx = 0; idx != m_fields.size(); ++ idx)
     {
-        for (const auto& name : m_fields)
-            scope[name] = Subscript(body, name, &values);
+        auto& var = scope[m_fields[idx]];
+        var = m_fields.size() == 1 ? std::move(body) : Subscript(body, m_fields[idx], &values);
+        if (m_fieldSlots[idx] != InvalidSlot)
+            values.BindSlot(m_fieldSlots[idx], this, var);
+        if (m_fieldMemoRoots[idx] != InvalidSlot)
+            values.InvalidateMemos(m_fieldMemoRoots[idx]);
     }
 }
 
@@ -268,11 +500,21 @@ void SetFilteredBlockStatement::Render(OutStream&, RenderContext& values)
     AssignBody(m_expr->Evaluate(RenderBody(values), values), values);
 }
 
+namespace
+{
+// Renderer which is created on the first entry
+struct NestedRendererFrame : ResumableRender::Frame
+{
+    RendererPtr renderer;
+};
+} // namespace
+
 class BlocksRenderer : public RendererBase
 {
 public:
     virtual bool HasBlock(const std::string& blockName) = 0;
     virtual void RenderBlock(const std::string& blockName, OutStream& os, RenderContext& values) = 0;
+    virtual bool RenderResolvedBlock(const std::string& blockName, OutStream& os, RenderContext& values) = 0;
 };
 
 void ParentBlockStatement::Render(OutStream& os, RenderContext& values)
@@ -347,6 +589,44 @@ public:
     }
 
     void Render(OutStream& os, RenderContext& values) override
+    {
+        SetupParentTemplates(values);
+        m_template->GetRootRenderer(values)->Render(os, values);
+    }
+
+    bool Resume(OutStream& os, RenderContext& values, ResumableRender& render) override
+    {
+        auto& frame = render.EnterFrame<NestedRendererFrame>();
+        if (!frame.renderer)
+        {
+            SetupParentTemplates(values);
+            frame.renderer = m_template->GetRootRenderer(values);
+        }
+
+        if (!frame.renderer->Resume(os, values, render))
+            return render.Suspend();
+        return render.Finish();
+    }
+
+    void RenderBlock(const std::string& blockName, OutStream& os, RenderContext& values) override
+    {
+        auto p = m_blocks->find(blockName);
+        if (p == m_blocks->end())
+            return;
+
+        p->second->Render(os, values);
+    }
+
+    bool RenderResolvedBlock(const std::string& blockName, OutStream& os, RenderContext& values) override
+    {
+        SetupParentTemplates(values);
+        return RenderTemplateBlock(m_template->GetRenderer().get(), blockName, os, values);
+    }
+
+    bool HasBlock(const std::string& blockName) override { return m_blocks->count(blockName) != 0; }
+
+private:
+    void SetupParentTemplates(RenderContext& values)
     {
         auto& scope = values.GetCurrentScope();
         InternalValueList parentTemplates;
@@ -364,20 +644,8 @@ public:
             }
         }
         scope["$$__parent_template"] = ListAdapter::CreateAdapter(std::move(parentTemplates));
-        m_template->GetRenderer()->Render(os, values);
     }
 
-    void RenderBlock(const std::string& blockName, OutStream& os, RenderContext& values) override
-    {
-        auto p = m_blocks->find(blockName);
-        if (p == m_blocks->end())
-            return;
-
-        p->second->Render(os, values);
-    }
-
-    bool HasBlock(const std::string& blockName) override { return m_blocks->count(blockName) != 0; }
-
 private:
     std::shared_ptr<TemplateImpl<CharT>> m_template;
     ExtendsStatement::BlocksCollection* m_blocks;
@@ -439,29 +707,134 @@ void ExtendsStatement::Render(OutStream& os, RenderContext& values)
         renderer->Render(os, values);
 }
 
+bool ExtendsStatement::Resume(OutStream& os, RenderContext& values, ResumableRender& render)
+{
+    auto& frame = render.EnterFrame<NestedRendererFrame>();
+    if (!frame.renderer)
+    {
+        if (!m_isPath)
+            return render.Finish();
+
+        auto tpl = values.GetRendererCallback()->LoadTemplate(m_templateName);
+        frame.renderer =
+          VisitTemplateImpl<RendererPtr>(tpl, true, [this](auto tplPtr) { return CreateTemplateRenderer<ParentTemplateRenderer>(tplPtr, &m_blocks); });
+        if (!frame.renderer)
+            return render.Finish();
+    }
+
+    if (!frame.renderer->Resume(os, values, render))
+        return render.Suspend();
+    return render.Finish();
+}
+
+bool ExtendsStatement::RenderBlock(const std::string& blockName, OutStream& os, RenderContext& values)
+{
+    if (!m_isPath)
+        return false;
+
+    auto tpl = values.GetRendererCallback()->LoadTemplate(m_templateName);
+    auto renderer =
+      VisitTemplateImpl<RendererPtr>(tpl, true, [this](auto tplPtr) { return CreateTemplateRenderer<ParentTemplateRenderer>(tplPtr, &m_blocks); });
+    if (!renderer)
+        return false;
+
+    return static_cast<BlocksRenderer*>(renderer.get())->RenderResolvedBlock(blockName, os, values);
+}
+
+namespace
+{
+class BlockFinder : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    explicit BlockFinder(const std::string& blockName)
+        : m_blockName(blockName)
+    {
+    }
+
+    void VisitRenderer(RendererBase* renderer)
+    {
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer);
+        if (stmt != nullptr && !IsFound())
+            Visit(stmt);
+    }
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        for (auto& r : renderer->GetRenderers())
+            VisitRenderer(r.get());
+    }
+
+    void DoVisit(ParentBlockStatement* stmt) override
+    {
+        if (stmt->GetName() == m_blockName)
+            m_block = stmt;
+        else
+            VisitRenderer(stmt->GetMainBody().get());
+    }
+
+    void DoVisit(ExtendsStatement* stmt) override
+    {
+        m_extends = stmt;
+    }
+
+    bool IsFound() const { return m_block != nullptr || m_extends != nullptr; }
+
+    ParentBlockStatement* m_block = nullptr;
+    ExtendsStatement* m_extends = nullptr;
+
+private:
+    const std::string& m_blockName;
+};
+} // namespace
+
+bool RenderTemplateBlock(RendererBase* tplRenderer, const std::string& blockName, OutStream& os, RenderContext& values)
+{
+    BlockFinder finder(blockName);
+    finder.VisitRenderer(tplRenderer);
+
+    if (finder.m_extends != nullptr)
+        return finder.m_extends->RenderBlock(blockName, os, values);
+
+    if (finder.m_block == nullptr)
+        return false;
+
+    finder.m_block->Render(os, values);
+    return true;
+}
+
 template<typename CharT>
 class IncludedTemplateRenderer : public RendererBase
 {
 public:
-    IncludedTemplateRenderer(std::shared_ptr<TemplateImpl<CharT>> tpl, bool withContext)
+    IncludedTemplateRenderer(std::shared_ptr<TemplateImpl<CharT>> tpl, bool withContext, const std::unordered_map<std::string, size_t>* memoRoots = nullptr)
         : m_template(tpl)
         , m_withContext(withContext)
+        , m_memoRoots(memoRoots)
     {
     }
 
     void Render(OutStream& os, RenderContext& values) override
     {
+        RenderContext::CallGuard callGuard(values);
         RenderContext innerContext = values.Clone(m_withContext);
         if (m_withContext)
             innerContext.EnterScope();
 
-        m_template->GetRenderer()->Render(os, innerContext);
+        m_template->GetRootRenderer(innerContext)->Render(os, innerContext);
         if (m_withContext)
         {
             auto& innerScope = innerContext.GetCurrentScope();
             auto& scope = values.GetCurrentScope();
             for (auto& v : innerScope)
             {
+                if (m_memoRoots)
+                {
+                    auto p = m_memoRoots->find(v.first);
+                    if (p != m_memoRoots->end())
+                        values.InvalidateMemos(p->second);
+                }
                 scope[v.first] = std::move(v.second);
             }
         }
@@ -470,6 +843,7 @@ public:
 private:
     std::shared_ptr<TemplateImpl<CharT>> m_template;
     bool m_withContext;
+    const std::unordered_map<std::string, size_t>* m_memoRoots;
 };
 
 void IncludeStatement::Render(OutStream& os, RenderContext& values)
@@ -484,7 +858,7 @@ void IncludeStatement::Render(OutStream& os, RenderContext& values)
         try
         {
             auto renderer = VisitTemplateImpl<RendererPtr>(
-              tpl, true, [this](auto tplPtr) { return CreateTemplateRenderer<IncludedTemplateRenderer>(tplPtr, m_withContext); });
+              tpl, true, [this](auto tplPtr) { return CreateTemplateRenderer<IncludedTemplateRenderer>(tplPtr, m_withContext, &m_memoRoots); });
 
             if (renderer)
             {
@@ -610,6 +984,8 @@ void ImportStatement::Render(OutStream& /*os*/, RenderContext& values)
     ImportNames(values, importedScope, scopeName);
     values.GetCurrentScope()[scopeName] =
       std::static_pointer_cast<RendererBase>(std::make_shared<ImportedMacroRenderer>(std::move(importedScope), m_withContext));
+    for (auto root : m_memoRoots)
+        values.InvalidateMemos(root);
 }
 
 void ImportStatement::ImportNames(RenderContext& values, InternalValueMap& importedScope, const std::string& scopeName) const
@@ -681,6 +1057,7 @@ void MacroStatement::Render(OutStream&, RenderContext& values)
 
 void MacroStatement::InvokeMacroRenderer(const std::vector<ArgumentInfo>& params, const CallParams& callParams, OutStream& stream, RenderContext& context)
 {
+    RenderContext::CallGuard callGuard(context);
     InternalValueMap callArgs;
     InternalValueMap kwArgs;
     InternalValueList varArgs;
@@ -701,15 +1078,63 @@ void MacroStatement::InvokeMacroRenderer(const std::vector<ArgumentInfo>& params
     scope["kwargs"s] = CreateMapAdapter(std::move(kwArgs));
     scope["varargs"s] = ListAdapter::CreateAdapter(std::move(varArgs));
 
-    scope["name"s] = static_cast<std::string>(m_name);
-    scope["arguments"s] = ListAdapter::CreateAdapter(std::move(arguments));
-    scope["defaults"s] = ListAdapter::CreateAdapter(std::move(defaults));
+    // Parameters with the same names shadow the introspection values
+    auto setIntrospectionValue = [this, &scope](const std::string& name, InternalValue value) {
+        auto isParam = std::any_of(m_params.begin(), m_params.end(), [&name](auto& p) { return p.paramName == name; });
+        if (!isParam)
+            scope[name] = std::move(value);
+    };
+    setIntrospectionValue("name"s, static_cast<std::string>(m_name));
+    setIntrospectionValue("arguments"s, ListAdapter::CreateAdapter(std::move(arguments)));
+    setIntrospectionValue("defaults"s, ListAdapter::CreateAdapter(std::move(defaults)));
 
+    BindParamSlots(scope, context);
     m_mainBody->Render(stream, context);
 
     context.ExitScope();
 }
 
+void MacroStatement::RenderInlined(const std::vector<InlinedMacroArg>& args, OutStream& stream, RenderContext& context)
+{
+    RenderContext::CallGuard callGuard(context);
+    // Arguments are evaluated in the scope of the call site
+    boost::container::small_vector<InternalValue, 8> argValues(args.size());
+    for (size_t idx = 0; idx != args.size(); ++ idx)
+    {
+        if (args[idx].value)
+            argValues[idx] = args[idx].value->Evaluate(context);
+    }
+
+    auto& scope = context.EnterScope();
+    for (size_t idx = 0; idx != args.size(); ++ idx)
+    {
+        if (!args[idx].value || (args[idx].isDefault && IsEmpty(argValues[idx])))
+            continue;
+        scope[m_params[idx].paramName] = std::move(argValues[idx]);
+    }
+
+    BindParamSlots(scope, context);
+    m_mainBody->Render(stream, context);
+
+    context.ExitScope();
+}
+
+void MacroStatement::BindParamSlots(InternalValueMap& scope, RenderContext& context)
+{
+    for (size_t idx = 0; idx != m_paramSlots.size(); ++ idx)
+    {
+        if (m_paramSlots[idx] == InvalidSlot)
+            continue;
+
+        // Missing parameter shouldn't be read through the binding of the outer recursive call
+        auto p = scope.find(m_params[idx].paramName);
+        if (p != scope.end())
+            context.BindSlot(m_paramSlots[idx], this, p->second);
+        else
+            context.UnbindSlot(m_paramSlots[idx]);
+    }
+}
+
 void MacroStatement::SetupCallArgs(const std::vector<ArgumentInfo>& argsInfo,
                                    const CallParams& callParams,
                                    RenderContext& /* context */,
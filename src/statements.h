@@ -29,6 +29,14 @@ struct MacroParam
 
 using MacroParams = std::vector<MacroParam>;
 
+// Argument of the inlined macro call which is bound to the macro parameter at parse time. Empty `value` means that the argument is
+// missing. Empty default value is treated as the missing argument
+struct InlinedMacroArg
+{
+    ExpressionEvaluatorPtr<> value;
+    bool isDefault;
+};
+
 class ForStatement : public Statement
 {
 public:
@@ -36,6 +44,8 @@ public:
     
     ForStatement(std::vector<std::string> vars, ExpressionEvaluatorPtr<> expr, ExpressionEvaluatorPtr<> ifExpr, bool isRecursive)
         : m_vars(std::move(vars))
+        , m_varSlots(m_vars.size(), InvalidSlot)
+        , m_varMemoRoots(m_vars.size(), InvalidSlot)
         , m_value(expr)
         , m_ifExpr(ifExpr)
         , m_isRecursive(isRecursive)
@@ -52,18 +62,54 @@ public:
         m_elseBody = std::move(renderer);
     }
 
+    auto& GetMainBody() const {return m_mainBody;}
+    auto& GetElseBody() const {return m_elseBody;}
+    auto& GetVars() const {return m_vars;}
+    auto& GetValue() const {return m_value;}
+    auto& GetIfExpr() const {return m_ifExpr;}
+    bool IsRecursive() const {return m_isRecursive;}
+
+    void SetVarSlot(size_t varIdx, size_t slot)
+    {
+        m_varSlots[varIdx] = slot;
+    }
+    void SetLoopSlot(size_t slot)
+    {
+        m_loopSlot = slot;
+    }
+    void SetVarMemoRoot(size_t varIdx, size_t root)
+    {
+        m_varMemoRoots[varIdx] = root;
+    }
+    // Loop doesn't create the `loop` variable if nothing can read it
+    void SetLoopVarUsed(bool isUsed)
+    {
+        m_isLoopVarUsed = isUsed;
+    }
+
     void Render(OutStream& os, RenderContext& values) override;
+    bool Resume(OutStream& os, RenderContext& values, ResumableRender& render) override;
 
 private:
+    struct LoopFrame;
+
   void RenderLoop(const InternalValue &loopVal, OutStream &os,
                   RenderContext &values, int level);
+    void StartLoop(LoopFrame& frame, const InternalValue& loopVal, RenderContext& values, int level);
+    bool NextItem(LoopFrame& frame, RenderContext& values);
     ListAdapter CreateFilteredAdapter(const ListAdapter& loopItems, RenderContext& values) const;
+    void AssignVar(size_t varIdx, const InternalValue& value, RenderContext& values);
+    void InvalidateVarMemos(RenderContext& values) const;
 
 private:
     std::vector<std::string> m_vars;
+    std::vector<size_t> m_varSlots;
+    std::vector<size_t> m_varMemoRoots;
+    size_t m_loopSlot = InvalidSlot;
     ExpressionEvaluatorPtr<> m_value;
     ExpressionEvaluatorPtr<> m_ifExpr;
     bool m_isRecursive;
+    bool m_isLoopVarUsed = true;
     RendererPtr m_mainBody;
     RendererPtr m_elseBody;
 
@@ -91,7 +137,15 @@ public:
         m_elseBranches.push_back(branch);
     }
 
+    auto& GetCondition() const {return m_expr;}
+    auto& GetMainBody() const {return m_mainBody;}
+    auto& GetElseBranches() const {return m_elseBranches;}
+
     void Render(OutStream& os, RenderContext& values) override;
+    bool Resume(OutStream& os, RenderContext& values, ResumableRender& render) override;
+
+private:
+    RendererBase* SelectBody(RenderContext& values) const;
 
 private:
     ExpressionEvaluatorPtr<> m_expr;
@@ -115,6 +169,8 @@ public:
     {
         m_mainBody = std::move(renderer);
     }
+    auto& GetCondition() const {return m_expr;}
+    auto& GetMainBody() const {return m_mainBody;}
     void Render(OutStream& os, RenderContext& values) override;
 
 private:
@@ -127,7 +183,19 @@ class SetStatement : public Statement
 public:
     SetStatement(std::vector<std::string> fields)
         : m_fields(std::move(fields))
+        , m_fieldSlots(m_fields.size(), InvalidSlot)
+        , m_fieldMemoRoots(m_fields.size(), InvalidSlot)
+    {
+    }
+
+    auto& GetFields() const {return m_fields;}
+    void SetFieldSlot(size_t fieldIdx, size_t slot)
+    {
+        m_fieldSlots[fieldIdx] = slot;
+    }
+    void SetFieldMemoRoot(size_t fieldIdx, size_t root)
     {
+        m_fieldMemoRoots[fieldIdx] = root;
     }
 
 protected:
@@ -135,6 +203,8 @@ protected:
 
 private:
     const std::vector<std::string> m_fields;
+    std::vector<size_t> m_fieldSlots;
+    std::vector<size_t> m_fieldMemoRoots;
 };
 
 class SetLineStatement final : public SetStatement
@@ -147,6 +217,8 @@ public:
     {
     }
 
+    auto& GetExpression() const {return m_expr;}
+
     void Render(OutStream& os, RenderContext& values) override;
 
 private:
@@ -162,6 +234,7 @@ public:
     {
         m_body = std::move(renderer);
     }
+    auto& GetBody() const {return m_body;}
 
 protected:
     InternalValue RenderBody(RenderContext&);
@@ -192,6 +265,8 @@ public:
 
     void Render(OutStream&, RenderContext&) override;
 
+    auto& GetFilter() const {return m_expr;}
+
 private:
     const ExpressionEvaluatorPtr<ExpressionFilter> m_expr;
 };
@@ -207,6 +282,9 @@ public:
     {
     }
 
+    auto& GetName() const {return m_name;}
+    auto& GetMainBody() const {return m_mainBody;}
+
     void SetMainBody(RendererPtr renderer)
     {
         m_mainBody = std::move(renderer);
@@ -230,6 +308,7 @@ public:
     }
 
     auto& GetName() const {return m_name;}
+    auto& GetMainBody() const {return m_mainBody;}
 
     void SetMainBody(RendererPtr renderer)
     {
@@ -255,7 +334,13 @@ public:
     {
     }
 
+    auto& GetTemplateName() const {return m_templateName;}
+    bool IsPath() const {return m_isPath;}
+    auto& GetBlocks() const {return m_blocks;}
+
     void Render(OutStream &os, RenderContext &values) override;
+    bool Resume(OutStream& os, RenderContext& values, ResumableRender& render) override;
+    bool RenderBlock(const std::string& blockName, OutStream &os, RenderContext &values);
     void AddBlock(StatementPtr<BlockStatement> block)
     {
         m_blocks[block->GetName()] = block;
@@ -267,6 +352,10 @@ private:
     void DoRender(OutStream &os, RenderContext &values);
 };
 
+// Renders the single named block of the template. Parent templates chain and 'super' calls are resolved as for the whole template rendering.
+// Returns false if the template doesn't contain the block
+bool RenderTemplateBlock(RendererBase* tplRenderer, const std::string& blockName, OutStream& os, RenderContext& values);
+
 class IncludeStatement : public Statement
 {
 public:
@@ -282,11 +371,21 @@ public:
         m_expr = std::move(expr);
     }
 
+    // Values which are set by the included template with the context are copied to the current scope
+    bool IsWithContext() const {return m_withContext;}
+
+    // Memo roots of the variables, which memos are invalidated when the included template with the context binds them
+    void SetMemoRoots(std::unordered_map<std::string, size_t> roots)
+    {
+        m_memoRoots = std::move(roots);
+    }
+
     void Render(OutStream& os, RenderContext& values) override;
 private:
     bool m_ignoreMissing;
     bool m_withContext;
     ExpressionEvaluatorPtr<> m_expr;
+    std::unordered_map<std::string, size_t> m_memoRoots;
 };
 
 class ImportStatement : public Statement
@@ -313,6 +412,14 @@ public:
         m_namesToImport[std::move(name)] = std::move(alias);
     }
 
+    auto& GetNamespace() const {return m_namespace;}
+    auto& GetNamesToImport() const {return m_namesToImport;}
+
+    void AddMemoRoot(size_t root)
+    {
+        m_memoRoots.push_back(root);
+    }
+
     void Render(OutStream& os, RenderContext& values) override;
 
 private:
@@ -324,6 +431,7 @@ private:
     ExpressionEvaluatorPtr<> m_nameExpr;
     nonstd::optional<std::string> m_namespace;
     std::unordered_map<std::string, std::string> m_namesToImport;
+    std::vector<size_t> m_memoRoots;
 };
 
 class MacroStatement : public Statement
@@ -334,6 +442,7 @@ public:
     MacroStatement(std::string name, MacroParams params)
         : m_name(std::move(name))
         , m_params(std::move(params))
+        , m_paramSlots(m_params.size(), InvalidSlot)
     {
     }
 
@@ -341,11 +450,22 @@ public:
     {
         m_mainBody = std::move(renderer);
     }
+    auto& GetMainBody() const {return m_mainBody;}
+    auto& GetName() const {return m_name;}
+    auto& GetParams() const {return m_params;}
+
+    void SetParamSlot(size_t paramIdx, size_t slot)
+    {
+        m_paramSlots[paramIdx] = slot;
+    }
 
     void Render(OutStream &os, RenderContext &values) override;
+    // Renders the macro body with the arguments which are bound to the parameters at the call site. Argument per parameter is expected
+    void RenderInlined(const std::vector<InlinedMacroArg>& args, OutStream& stream, RenderContext& context);
 
 protected:
     void InvokeMacroRenderer(const std::vector<ArgumentInfo>& params, const CallParams& callParams, OutStream& stream, RenderContext& context);
+    void BindParamSlots(InternalValueMap& scope, RenderContext& context);
     void SetupCallArgs(const std::vector<ArgumentInfo>& argsInfo, const CallParams& callParams, RenderContext& context, InternalValueMap& callArgs, InternalValueMap& kwArgs, InternalValueList& varArgs);
     virtual void SetupMacroScope(InternalValueMap& scope);
     std::vector<ArgumentInfo> PrepareMacroParams(RenderContext& values);
@@ -353,6 +473,7 @@ protected:
 protected:
     std::string m_name;
     MacroParams m_params;
+    std::vector<size_t> m_paramSlots;
     RendererPtr m_mainBody;
 };
 
@@ -370,6 +491,8 @@ public:
 
     void Render(OutStream &os, RenderContext &values) override;
 
+    auto& GetMacroName() const {return m_macroName;}
+
 protected:
     void SetupMacroScope(InternalValueMap& scope) override;
 
@@ -378,6 +501,31 @@ protected:
     CallParamsInfo m_callParams;
 };
 
+// Call of the macro which is defined in the same template, with the macro body rendered directly. Created by the macros inlining pass
+class InlinedMacroCallStatement : public Statement
+{
+public:
+    VISITABLE_STATEMENT();
+
+    InlinedMacroCallStatement(std::shared_ptr<MacroStatement> macro, std::vector<InlinedMacroArg> args)
+        : m_macro(std::move(macro))
+        , m_args(std::move(args))
+    {
+    }
+
+    auto& GetMacro() const {return m_macro;}
+    auto& GetArgs() const {return m_args;}
+
+    void Render(OutStream &os, RenderContext &values) override
+    {
+        m_macro->RenderInlined(m_args, os, values);
+    }
+
+private:
+    std::shared_ptr<MacroStatement> m_macro;
+    std::vector<InlinedMacroArg> m_args;
+};
+
 class DoStatement : public Statement
 {
 public:
@@ -385,6 +533,8 @@ public:
 
     DoStatement(ExpressionEvaluatorPtr<> expr) : m_expr(expr) {}
 
+    auto& GetExpression() const {return m_expr;}
+
     void Render(OutStream &os, RenderContext &values) override;
 
 private:
@@ -404,6 +554,8 @@ public:
     {
         m_mainBody = std::move(renderer);
     }
+    auto& GetMainBody() const {return m_mainBody;}
+    auto& GetScopeVars() const {return m_scopeVars;}
 
     void Render(OutStream &os, RenderContext &values) override;
 
@@ -424,7 +576,9 @@ public:
     {
         m_body = std::move(renderer);
     }
-    
+    auto& GetBody() const {return m_body;}
+    auto& GetFilter() const {return m_expr;}
+
     void Render(OutStream &, RenderContext &) override;
 
 private:
@@ -165,6 +165,106 @@ struct UrlStringEncoder : public StringEncoder<UrlStringEncoder>
     }
 };
 
+namespace
+{
+// Character converters are shared by the conversion of the values and the in place conversion of the fused chains
+auto TitleConverter()
+{
+    return [isDelim = true, isAlpha = ba::is_alpha(), isAlNum = ba::is_alnum()](auto ch, auto&& fn) mutable {
+        if (isDelim && isAlpha(ch))
+        {
+            isDelim = false;
+            fn(std::toupper(ch, std::locale()));
+            return;
+        }
+
+        isDelim = !isAlNum(ch);
+        fn(ch);
+    };
+}
+
+auto UpperConverter()
+{
+    return [isAlpha = ba::is_alpha()](auto ch, auto&& fn) mutable {
+        if (isAlpha(ch))
+            fn(std::toupper(ch, std::locale()));
+        else
+            fn(ch);
+    };
+}
+
+auto LowerConverter()
+{
+    return [isAlpha = ba::is_alpha()](auto ch, auto&& fn) mutable {
+        if (isAlpha(ch))
+            fn(std::tolower(ch, std::locale()));
+        else
+            fn(ch);
+    };
+}
+
+auto CapitalConverter()
+{
+    return [isFirstChar = true, isAlpha = ba::is_alpha()](auto ch, auto&& fn) mutable {
+        if (isAlpha(ch))
+        {
+            if (isFirstChar)
+                fn(std::toupper(ch, std::locale()));
+            else
+                fn(std::tolower(ch, std::locale()));
+        }
+        else
+            fn(ch);
+
+        isFirstChar = false;
+    };
+}
+
+auto EscapeHtmlConverter()
+{
+    return [](auto ch, auto&& fn) mutable {
+        switch(ch)
+        {
+            case '<':
+                fn('&', 'l', 't', ';');
+                break;
+            case '>':
+                fn('&', 'g', 't', ';');
+                break;
+            case '&':
+                fn('&', 'a', 'm', 'p', ';');
+                break;
+            case '\'':
+                fn('&', '#', '3', '9', ';');
+                break;
+            case '\"':
+                fn('&', '#', '3', '4', ';');
+                break;
+            default:
+                fn(ch);
+                break;
+        }
+    };
+}
+
+// Converter produces exactly one character per source character
+template<typename CharT, typename Fn>
+void ConvertChars(std::basic_string<CharT>& str, Fn&& fn)
+{
+    for (auto& ch : str)
+        fn(ch, [&ch](auto newCh) {ch = static_cast<CharT>(newCh);});
+}
+
+template<typename CharT, typename Fn>
+void EncodeChars(std::basic_string<CharT>& str, std::basic_string<CharT>& buffer, Fn&& fn)
+{
+    buffer.clear();
+    for (auto& ch : str)
+        fn(ch, [&buffer](auto ... chs) {UrlStringEncoder::AppendChar(buffer, chs...);});
+    str.swap(buffer);
+}
+} // namespace
+
 StringConverter::StringConverter(FilterParams params, StringConverter::Mode mode)
     : m_mode(mode)
 {
@@ -187,35 +287,15 @@ InternalValue StringConverter::Filter(const InternalValue& baseVal, RenderContex
 {
     TargetString result;
 
-    auto isAlpha = ba::is_alpha();
-    auto isAlNum = ba::is_alnum();
-
     switch (m_mode)
     {
-    case TrimMode:
-        result = ApplyStringConverter(baseVal, [](auto strView) -> TargetString {
-            auto str = sv_to_string(strView);
-            ba::trim_all(str);
-            return TargetString(str);
-        });
-        break;
     case TitleMode:
-        result = ApplyStringConverter<GenericStringEncoder>(baseVal, [isDelim = true, &isAlpha, &isAlNum](auto ch, auto&& fn) mutable {
-            if (isDelim && isAlpha(ch))
-            {
-                isDelim = false;
-                fn(std::toupper(ch, std::locale()));
-                return;
-            }
-
-            isDelim = !isAlNum(ch);
-            fn(ch);
-        });
+        result = ApplyStringConverter<GenericStringEncoder>(baseVal, TitleConverter());
         break;
     case WordCountMode:
     {
         int64_t wc = 0;
-        ApplyStringConverter<GenericStringEncoder>(baseVal, [isDelim = true, &wc, &isAlNum](auto ch, auto&&) mutable {
+        ApplyStringConverter<GenericStringEncoder>(baseVal, [isDelim = true, &wc, isAlNum = ba::is_alnum()](auto ch, auto&&) mutable {
             if (isDelim && isAlNum(ch))
             {
                 isDelim = false;
@@ -227,168 +307,204 @@ InternalValue StringConverter::Filter(const InternalValue& baseVal, RenderContex
         return InternalValue(wc);
     }
     case UpperMode:
-        result = ApplyStringConverter<GenericStringEncoder>(baseVal, [&isAlpha](auto ch, auto&& fn) mutable {
-            if (isAlpha(ch))
-                fn(std::toupper(ch, std::locale()));
-            else
-                fn(ch);
-        });
+        result = ApplyStringConverter<GenericStringEncoder>(baseVal, UpperConverter());
         break;
     case LowerMode:
-        result = ApplyStringConverter<GenericStringEncoder>(baseVal, [&isAlpha](auto ch, auto&& fn) mutable {
-            if (isAlpha(ch))
-                fn(std::tolower(ch, std::locale()));
-            else
-                fn(ch);
-        });
+        result = ApplyStringConverter<GenericStringEncoder>(baseVal, LowerConverter());
+        break;
+    case UrlEncodeMode:
+        result = Apply<UrlStringEncoder>(baseVal);
         break;
+    case CapitalMode:
+        result = ApplyStringConverter<GenericStringEncoder>(baseVal, CapitalConverter());
+        break;
+    case EscapeHtmlMode:
+        result = ApplyStringConverter<GenericStringEncoder>(baseVal, EscapeHtmlConverter());
+        break;
+    case TrimMode:
     case ReplaceMode:
+    case TruncateMode:
+    case StriptagsMode:
+    case CenterMode:
         result = ApplyStringConverter(baseVal, [this, &context](auto srcStr) -> TargetString {
-            std::decay_t<decltype(srcStr)> emptyStrView;
-            using CharT = typename decltype(emptyStrView)::value_type;
-            std::basic_string<CharT> emptyStr;
-            auto oldStr = GetAsSameString(srcStr, this->GetArgumentValue("old", context)).value_or(emptyStr);
-            auto newStr = GetAsSameString(srcStr, this->GetArgumentValue("new", context)).value_or(emptyStr);
-            auto count = ConvertToInt(this->GetArgumentValue("count", context));
             auto str = sv_to_string(srcStr);
-            if (count == 0)
-                ba::replace_all(str, oldStr, newStr);
-            else
-            {
-                for (int64_t n = 0; n < count; ++ n)
-                    ba::replace_first(str, oldStr, newStr);
-            }
-            return str;
+            decltype(str) buffer;
+            Convert(str, buffer, context);
+            return TargetString(std::move(str));
         });
         break;
-    case TruncateMode:
-        result = ApplyStringConverter(baseVal, [this, &context, &isAlNum](auto srcStr) -> TargetString {
-            std::decay_t<decltype(srcStr)> emptyStrView;
-            using CharT = typename decltype(emptyStrView)::value_type;
-            std::basic_string<CharT> emptyStr;
-            auto length = ConvertToInt(this->GetArgumentValue("length", context));
-            auto killWords = ConvertToBool(this->GetArgumentValue("killwords", context));
-            auto end = GetAsSameString(srcStr, this->GetArgumentValue("end", context));
-            auto leeway = ConvertToInt(this->GetArgumentValue("leeway", context), 5);
-            if (static_cast<long long int>(srcStr.size()) <= length)
-                return sv_to_string(srcStr);
-
-            auto str = sv_to_string(srcStr);
+    default:
+        break;
+    }
 
-            if (killWords)
-            {
-                if (static_cast<long long int>(str.size()) > (length + leeway))
-                {
-                    str.erase(str.begin() + static_cast<std::ptrdiff_t>(length), str.end());
-                    str += end.value_or(emptyStr);
-                }
-                return str;
-            }
+    return std::move(result);
+}
 
-            auto p = str.begin() + static_cast<std::ptrdiff_t>(length);
-            if (leeway != 0)
-            {
-                for (; leeway != 0 && p != str.end() && isAlNum(*p); -- leeway, ++ p);
-                if (p == str.end())
-                    return TargetString(str);
-            }
+bool StringConverter::IsStringToString() const
+{
+    switch (m_mode)
+    {
+    case CapitalMode:
+    case EscapeHtmlMode:
+    case LowerMode:
+    case ReplaceMode:
+    case StriptagsMode:
+    case TitleMode:
+    case TrimMode:
+    case TruncateMode:
+    case UpperMode:
+    case UrlEncodeMode:
+    case CenterMode:
+        return true;
+    default:
+        return false;
+    }
+}
 
-            if (isAlNum(*p))
-            {
-                for (; p != str.begin() && isAlNum(*p); -- p);
-            }
-            str.erase(p, str.end());
-            ba::trim_right(str);
-            str += end.value_or(emptyStr);
+template<typename CharT>
+void StringConverter::Convert(std::basic_string<CharT>& str, std::basic_string<CharT>& buffer, RenderContext& context)
+{
+    using StringT = std::basic_string<CharT>;
 
-            return TargetString(std::move(str));
-        });
+    switch (m_mode)
+    {
+    case TrimMode:
+        ba::trim_all(str);
         break;
-    case UrlEncodeMode:
-        result = Apply<UrlStringEncoder>(baseVal);
+    case TitleMode:
+        ConvertChars(str, TitleConverter());
+        break;
+    case UpperMode:
+        ConvertChars(str, UpperConverter());
+        break;
+    case LowerMode:
+        ConvertChars(str, LowerConverter());
         break;
     case CapitalMode:
-        result = ApplyStringConverter<GenericStringEncoder>(baseVal, [isFirstChar = true, &isAlpha](auto ch, auto&& fn) mutable {
-            if (isAlpha(ch))
-            {
-                if (isFirstChar)
-                    fn(std::toupper(ch, std::locale()));
-                else
-                    fn(std::tolower(ch, std::locale()));
-            }
-            else
-                fn(ch);
-
-            isFirstChar = false;
-        });
+        ConvertChars(str, CapitalConverter());
         break;
     case EscapeHtmlMode:
-        result = ApplyStringConverter<GenericStringEncoder>(baseVal, [](auto ch, auto&& fn) mutable {
-            switch(ch)
-            {
-                case '<':
-                    fn('&', 'l', 't', ';');
-                    break;
-                case '>':
-                    fn('&', 'g', 't', ';');
-                    break;
-                case '&':
-                    fn('&', 'a', 'm', 'p', ';');
-                    break;
-                case '\'':
-                    fn('&', '#', '3', '9', ';');
-                    break;
-                case '\"':
-                    fn('&', '#', '3', '4', ';');
-                    break;
-                default:
-                    fn(ch);
-                    break;
-            }
-        });
+        EncodeChars(str, buffer, EscapeHtmlConverter());
         break;
-     case StriptagsMode:
-        result = ApplyStringConverter(baseVal, [](auto srcStr) -> TargetString {
-            auto str = sv_to_string(srcStr);
-            using StringT = decltype(str);
-            using CharT = typename StringT::value_type;
-            static const std::basic_regex<CharT> STRIPTAGS_RE(UNIVERSAL_STR("(<!--.*?-->|<[^>]*>)").GetValue<CharT>());
-            str = std::regex_replace(str, STRIPTAGS_RE, UNIVERSAL_STR("").GetValue<CharT>());
-            ba::trim_all(str);
-            static const StringT html_entities [] {
-                UNIVERSAL_STR("&amp;").GetValue<CharT>(), UNIVERSAL_STR("&").GetValue<CharT>(),
-                UNIVERSAL_STR("&apos;").GetValue<CharT>(), UNIVERSAL_STR("\'").GetValue<CharT>(),
-                UNIVERSAL_STR("&gt;").GetValue<CharT>(), UNIVERSAL_STR(">").GetValue<CharT>(),
-                UNIVERSAL_STR("&lt;").GetValue<CharT>(), UNIVERSAL_STR("<").GetValue<CharT>(),
-                UNIVERSAL_STR("&quot;").GetValue<CharT>(), UNIVERSAL_STR("\"").GetValue<CharT>(),
-                UNIVERSAL_STR("&#39;").GetValue<CharT>(), UNIVERSAL_STR("\'").GetValue<CharT>(),
-                UNIVERSAL_STR("&#34;").GetValue<CharT>(), UNIVERSAL_STR("\"").GetValue<CharT>(),
-            };
-            for (auto it = std::begin(html_entities), end = std::end(html_entities); it < end; it += 2)
+    case UrlEncodeMode:
+    {
+        UrlStringEncoder encoder;
+        EncodeChars(str, buffer, [&encoder](auto ch, auto&& fn) {encoder.EncodeChar(ch, fn);});
+        break;
+    }
+    case ReplaceMode:
+    {
+        StringT emptyStr;
+        auto oldStr = GetAsSameString(str, this->GetArgumentValue("old", context)).value_or(emptyStr);
+        auto newStr = GetAsSameString(str, this->GetArgumentValue("new", context)).value_or(emptyStr);
+        auto count = ConvertToInt(this->GetArgumentValue("count", context));
+        if (count == 0)
+            ba::replace_all(str, oldStr, newStr);
+        else
+        {
+            for (int64_t n = 0; n < count; ++ n)
+                ba::replace_first(str, oldStr, newStr);
+        }
+        break;
+    }
+    case TruncateMode:
+    {
+        StringT emptyStr;
+        auto isAlNum = ba::is_alnum();
+        auto length = ConvertToInt(this->GetArgumentValue("length", context));
+        auto killWords = ConvertToBool(this->GetArgumentValue("killwords", context));
+        auto end = GetAsSameString(str, this->GetArgumentValue("end", context));
+        auto leeway = ConvertToInt(this->GetArgumentValue("leeway", context), 5);
+        if (static_cast<long long int>(str.size()) <= length)
+            break;
+
+        if (killWords)
+        {
+            if (static_cast<long long int>(str.size()) > (length + leeway))
             {
-                ba::replace_all(str, *it, *(it + 1));
+                str.erase(str.begin() + static_cast<std::ptrdiff_t>(length), str.end());
+                str += end.value_or(emptyStr);
             }
-            return str;
-        });
+            break;
+        }
+
+        auto p = str.begin() + static_cast<std::ptrdiff_t>(length);
+        if (leeway != 0)
+        {
+            for (; leeway != 0 && p != str.end() && isAlNum(*p); -- leeway, ++ p);
+            if (p == str.end())
+                break;
+        }
+
+        if (isAlNum(*p))
+        {
+            for (; p != str.begin() && isAlNum(*p); -- p);
+        }
+        str.erase(p, str.end());
+        ba::trim_right(str);
+        str += end.value_or(emptyStr);
+        break;
+    }
+    case StriptagsMode:
+    {
+        static const std::basic_regex<CharT> STRIPTAGS_RE(UNIVERSAL_STR("(<!--.*?-->|<[^>]*>)").GetValue<CharT>());
+        str = std::regex_replace(str, STRIPTAGS_RE, UNIVERSAL_STR("").GetValue<CharT>());
+        ba::trim_all(str);
+        static const StringT html_entities [] {
+            UNIVERSAL_STR("&amp;").GetValue<CharT>(), UNIVERSAL_STR("&").GetValue<CharT>(),
+            UNIVERSAL_STR("&apos;").GetValue<CharT>(), UNIVERSAL_STR("\'").GetValue<CharT>(),
+            UNIVERSAL_STR("&gt;").GetValue<CharT>(), UNIVERSAL_STR(">").GetValue<CharT>(),
+            UNIVERSAL_STR("&lt;").GetValue<CharT>(), UNIVERSAL_STR("<").GetValue<CharT>(),
+            UNIVERSAL_STR("&quot;").GetValue<CharT>(), UNIVERSAL_STR("\"").GetValue<CharT>(),
+            UNIVERSAL_STR("&#39;").GetValue<CharT>(), UNIVERSAL_STR("\'").GetValue<CharT>(),
+            UNIVERSAL_STR("&#34;").GetValue<CharT>(), UNIVERSAL_STR("\"").GetValue<CharT>(),
+        };
+        for (auto it = std::begin(html_entities), end = std::end(html_entities); it < end; it += 2)
+        {
+            ba::replace_all(str, *it, *(it + 1));
+        }
         break;
+    }
     case CenterMode:
-        result = ApplyStringConverter(baseVal, [this, &context](auto srcStr) -> TargetString {
-            auto width = ConvertToInt(this->GetArgumentValue("width", context));
-            auto str = sv_to_string(srcStr);
-            auto string_length = static_cast<long long int>(str.size());
-            if (string_length >= width)
-                return str;
-            auto whitespaces = width - string_length;
-            str.insert(0, static_cast<std::string::size_type>(whitespaces + 1) / 2, ' ');
-            str.append(static_cast<std::string::size_type>(whitespaces / 2), ' ');
-            return TargetString(std::move(str));
-        });
+    {
+        auto width = ConvertToInt(this->GetArgumentValue("width", context));
+        auto string_length = static_cast<long long int>(str.size());
+        if (string_length >= width)
+            break;
+        auto whitespaces = width - string_length;
+        str.insert(0, static_cast<typename StringT::size_type>(whitespaces + 1) / 2, ' ');
+        str.append(static_cast<typename StringT::size_type>(whitespaces / 2), ' ');
         break;
+    }
     default:
         break;
     }
+}
 
-    return std::move(result);
+FusedStringConverter::FusedStringConverter(std::vector<std::shared_ptr<StringConverter>> converters)
+    : m_converters(std::move(converters))
+{
+}
+
+InternalValue FusedStringConverter::Filter(const InternalValue& baseVal, RenderContext& context)
+{
+    auto result = m_converters.front()->Filter(baseVal, context);
+    auto str = GetIf<TargetString>(&result);
+    if (!str)
+        return result;
+
+    nonstd::visit([this, &context](auto& s) {
+        std::decay_t<decltype(s)> buffer;
+        for (auto p = m_converters.begin() + 1; p != m_converters.end(); ++ p)
+            (*p)->Convert(s, buffer, context);
+    }, *str);
+
+    return result;
+}
+
+bool FusedStringConverter::IsConstant() const
+{
+    return std::all_of(m_converters.begin(), m_converters.end(), [](auto& c) {return c->IsConstant();});
 }
 
 }
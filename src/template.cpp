@@ -65,12 +65,19 @@ Result<void> Template::LoadFromFile(const std::string& fileName)
 
 Result<void> Template::Render(std::ostream& os, const jinja2::ValuesMap& params)
 {
-    std::string buffer;
-    auto result = GetImpl<char>(m_impl)->Render(buffer, params);
+    std::size_t emittedSize = 0;
+    return Render(os, params, emittedSize);
+}
 
-    if (!result)
-        os.write(buffer.data(), buffer.size());
+Result<void> Template::Render(std::ostream& os, const jinja2::ValuesMap& params, std::size_t& emittedSize)
+{
+    auto result = GetImpl<char>(m_impl)->Render(os, params, emittedSize);
+    return !result ? Result<void>() : nonstd::make_unexpected(std::move(result.get()));
+}
 
+Result<void> Template::Render(IRenderSink& sink, const jinja2::ValuesMap& params)
+{
+    auto result = GetImpl<char>(m_impl)->Render(sink, params);
     return !result ? Result<void>() : nonstd::make_unexpected(std::move(result.get()));
 }
 
@@ -81,6 +88,46 @@ Result<std::string> Template::RenderAsString(const jinja2::ValuesMap& params)
     return !result ? Result<std::string>(std::move(buffer)) : Result<std::string>(nonstd::make_unexpected(std::move(result.get())));;
 }
 
+Result<std::string> Template::RenderAsString(const jinja2::ValuesMap& params, uint64_t& outputHash)
+{
+    std::string buffer;
+    auto result = GetImpl<char>(m_impl)->Render(buffer, params, outputHash);
+    return !result ? Result<std::string>(std::move(buffer)) : Result<std::string>(nonstd::make_unexpected(std::move(result.get())));
+}
+
+Result<void> Template::RenderAsString(std::string& buffer, const jinja2::ValuesMap& params)
+{
+    buffer.clear();
+    auto result = GetImpl<char>(m_impl)->Render(buffer, params);
+    return !result ? Result<void>() : nonstd::make_unexpected(std::move(result.get()));
+}
+
+Result<RenderSegments> Template::RenderAsSegments(const jinja2::ValuesMap& params)
+{
+    RenderSegments segments;
+    auto result = GetImpl<char>(m_impl)->Render(segments, params);
+    return !result ? Result<RenderSegments>(std::move(segments)) : Result<RenderSegments>(nonstd::make_unexpected(std::move(result.get())));
+}
+
+Result<std::string> Template::RenderBlock(const std::string& blockName, const jinja2::ValuesMap& params)
+{
+    std::string buffer;
+    auto result = GetImpl<char>(m_impl)->RenderBlock(buffer, blockName, params);
+    return !result ? Result<std::string>(std::move(buffer)) : Result<std::string>(nonstd::make_unexpected(std::move(result.get())));
+}
+
+Result<std::string> Template::GetStaticPrefix()
+{
+    return GetImpl<char>(m_impl)->GetStaticPrefix();
+}
+
+Result<RenderState> Template::StartRender(const jinja2::ValuesMap& params, std::size_t chunkSize)
+{
+    auto impl = std::static_pointer_cast<TemplateImpl<char>>(m_impl);
+    auto result = impl->StartRender(impl, params, chunkSize);
+    return result ? Result<RenderState>(RenderState(std::move(result.value()))) : Result<RenderState>(nonstd::make_unexpected(std::move(result.error())));
+}
+
 Result<GenericMap> Template::GetMetadata()
 {
     return GetImpl<char>(m_impl)->GetMetadata();
@@ -141,10 +188,19 @@ ResultW<void> TemplateW::LoadFromFile(const std::string& fileName)
 
 ResultW<void> TemplateW::Render(std::wostream& os, const jinja2::ValuesMap& params)
 {
-    std::wstring buffer;
-    auto result = GetImpl<wchar_t>(m_impl)->Render(buffer, params);
-    if (!result)
-        os.write(buffer.data(), buffer.size());
+    std::size_t emittedSize = 0;
+    return Render(os, params, emittedSize);
+}
+
+ResultW<void> TemplateW::Render(std::wostream& os, const jinja2::ValuesMap& params, std::size_t& emittedSize)
+{
+    auto result = GetImpl<wchar_t>(m_impl)->Render(os, params, emittedSize);
+    return !result ? ResultW<void>() : ResultW<void>(nonstd::make_unexpected(std::move(result.get())));
+}
+
+ResultW<void> TemplateW::Render(IRenderSinkW& sink, const jinja2::ValuesMap& params)
+{
+    auto result = GetImpl<wchar_t>(m_impl)->Render(sink, params);
     return !result ? ResultW<void>() : ResultW<void>(nonstd::make_unexpected(std::move(result.get())));
 }
 
@@ -156,6 +212,46 @@ ResultW<std::wstring> TemplateW::RenderAsString(const jinja2::ValuesMap& params)
     return !result ? buffer : ResultW<std::wstring>(nonstd::make_unexpected(std::move(result.get())));
 }
 
+ResultW<std::wstring> TemplateW::RenderAsString(const jinja2::ValuesMap& params, uint64_t& outputHash)
+{
+    std::wstring buffer;
+    auto result = GetImpl<wchar_t>(m_impl)->Render(buffer, params, outputHash);
+    return !result ? ResultW<std::wstring>(std::move(buffer)) : ResultW<std::wstring>(nonstd::make_unexpected(std::move(result.get())));
+}
+
+ResultW<void> TemplateW::RenderAsString(std::wstring& buffer, const jinja2::ValuesMap& params)
+{
+    buffer.clear();
+    auto result = GetImpl<wchar_t>(m_impl)->Render(buffer, params);
+    return !result ? ResultW<void>() : ResultW<void>(nonstd::make_unexpected(std::move(result.get())));
+}
+
+ResultW<RenderSegmentsW> TemplateW::RenderAsSegments(const jinja2::ValuesMap& params)
+{
+    RenderSegmentsW segments;
+    auto result = GetImpl<wchar_t>(m_impl)->Render(segments, params);
+    return !result ? ResultW<RenderSegmentsW>(std::move(segments)) : ResultW<RenderSegmentsW>(nonstd::make_unexpected(std::move(result.get())));
+}
+
+ResultW<std::wstring> TemplateW::RenderBlock(const std::string& blockName, const jinja2::ValuesMap& params)
+{
+    std::wstring buffer;
+    auto result = GetImpl<wchar_t>(m_impl)->RenderBlock(buffer, blockName, params);
+    return !result ? ResultW<std::wstring>(std::move(buffer)) : ResultW<std::wstring>(nonstd::make_unexpected(std::move(result.get())));
+}
+
+ResultW<std::wstring> TemplateW::GetStaticPrefix()
+{
+    return GetImpl<wchar_t>(m_impl)->GetStaticPrefix();
+}
+
+ResultW<RenderStateW> TemplateW::StartRender(const jinja2::ValuesMap& params, std::size_t chunkSize)
+{
+    auto impl = std::static_pointer_cast<TemplateImpl<wchar_t>>(m_impl);
+    auto result = impl->StartRender(impl, params, chunkSize);
+    return result ? ResultW<RenderStateW>(RenderStateW(std::move(result.value()))) : ResultW<RenderStateW>(nonstd::make_unexpected(std::move(result.error())));
+}
+
 ResultW<GenericMap> TemplateW::GetMetadata()
 {
     return GenericMap();
@@ -168,4 +264,19 @@ ResultW<MetadataInfo<wchar_t>> TemplateW::GetMetadataRaw()
     // GetImpl<wchar_t>(m_impl)->GetMetadataRaw();
     ;
 }
+template<typename CharT>
+nonstd::expected<void, ErrorInfoTpl<CharT>> RenderStateTpl<CharT>::Resume(std::basic_string<CharT>& chunk)
+{
+    auto result = m_impl->Resume(chunk);
+    return !result ? nonstd::expected<void, ErrorInfoTpl<CharT>>() : nonstd::make_unexpected(std::move(result.get()));
+}
+
+template<typename CharT>
+bool RenderStateTpl<CharT>::IsFinished() const
+{
+    return m_impl->IsFinished();
+}
+
+template class RenderStateTpl<char>;
+template class RenderStateTpl<wchar_t>;
 } // jinga2
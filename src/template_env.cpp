@@ -1,6 +1,15 @@
+#include "template_impl.h"
+#include "template_layout.h"
+
 #include <jinja2cpp/template.h>
 #include <jinja2cpp/template_env.h>
 
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <system_error>
+#include <thread>
+
 namespace jinja2
 {
 template<typename CharT>
@@ -92,4 +101,134 @@ nonstd::expected<TemplateW, ErrorInfoW> TemplateEnv::LoadTemplateW(std::string f
     return LoadTemplateImpl<wchar_t>(this, std::move(fileName), m_filesystemHandlers, m_templateWCache);
 }
 
+template<typename CharT, typename Cache>
+auto TemplateEnv::PreloadTemplatesImpl(const std::vector<std::string>& fileNames, std::size_t threadsCount, Cache& cache)
+{
+    using ResultType = typename TemplateFunctions<CharT>::ResultType;
+    using ErrorType = typename ResultType::error_type;
+
+    auto makeExceptionError = [](const std::string& fileName, const char* what) {
+        typename ErrorType::Data errorData;
+        errorData.code = ErrorCode::UnexpectedException;
+        errorData.srcLoc.col = 1;
+        errorData.srcLoc.line = 1;
+        errorData.srcLoc.fileName = fileName;
+        errorData.extraParams.push_back(Value(std::string(what)));
+        return ErrorType(errorData);
+    };
+
+    // Every worker takes the next template from the list, so the long templates don't stall the whole batch. Exceptions thrown by the
+    // filesystem handlers are reported as the errors of the particular files, so they never escape the worker threads
+    std::vector<nonstd::optional<ErrorType>> errors(fileNames.size());
+    std::atomic<std::size_t> nextFile{0};
+    auto worker = [this, &fileNames, &cache, &errors, &nextFile, &makeExceptionError]() {
+        for (auto idx = nextFile++; idx < fileNames.size(); idx = nextFile++)
+        {
+            try
+            {
+                auto result = LoadTemplateImpl<CharT>(this, fileNames[idx], m_filesystemHandlers, cache);
+                if (!result)
+                    errors[idx] = result.error();
+            }
+            catch (const std::exception& ex)
+            {
+                errors[idx] = makeExceptionError(fileNames[idx], ex.what());
+            }
+            catch (...)
+            {
+                errors[idx] = makeExceptionError(fileNames[idx], "unknown exception");
+            }
+        }
+    };
+
+    if (threadsCount == 0)
+        threadsCount = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    threadsCount = std::min(threadsCount, fileNames.size());
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadsCount);
+    try
+    {
+        for (std::size_t idx = 1; idx < threadsCount; ++ idx)
+            threads.emplace_back(worker);
+    }
+    catch (const std::system_error&)
+    {
+        // Threads which are already started and the calling thread load the rest of the list
+    }
+    worker();
+    for (auto& t : threads)
+        t.join();
+
+    std::unordered_map<std::string, ErrorType> result;
+    for (std::size_t idx = 0; idx != fileNames.size(); ++ idx)
+    {
+        if (errors[idx])
+            result.emplace(fileNames[idx], std::move(errors[idx].value()));
+    }
+    return result;
+}
+
+std::unordered_map<std::string, ErrorInfo> TemplateEnv::PreloadTemplates(const std::vector<std::string>& fileNames, std::size_t threadsCount)
+{
+    return PreloadTemplatesImpl<char>(fileNames, threadsCount, m_templateCache);
+}
+
+std::unordered_map<std::string, ErrorInfoW> TemplateEnv::PreloadTemplatesW(const std::vector<std::string>& fileNames, std::size_t threadsCount)
+{
+    return PreloadTemplatesImpl<wchar_t>(fileNames, threadsCount, m_templateWCache);
+}
+
+bool TemplateEnv::SavePrecompiledTemplates(std::ostream& os)
+{
+    std::vector<std::pair<std::string, Template>> templates;
+    std::vector<std::pair<std::string, TemplateW>> templatesW;
+    {
+        std::shared_lock<std::shared_timed_mutex> l(m_guard);
+        for (auto& entry : m_templateCache)
+            templates.emplace_back(entry.first, entry.second.tpl);
+        for (auto& entry : m_templateWCache)
+            templatesW.emplace_back(entry.first, entry.second.tpl);
+    }
+
+    NamedTemplateLayouts layouts;
+    auto addLayout = [&layouts](const std::string& fileName, std::shared_ptr<TemplateLayout> layout) {
+        if (layout)
+            layouts.emplace_back(fileName, std::move(layout));
+    };
+    for (auto& t : templates)
+        addLayout(t.first, std::static_pointer_cast<TemplateImpl<char>>(t.second.m_impl)->BuildLayout());
+    for (auto& t : templatesW)
+        addLayout(t.first, std::static_pointer_cast<TemplateImpl<wchar_t>>(t.second.m_impl)->BuildLayout());
+
+    std::string data;
+    WriteLayoutsFile(data, layouts);
+    os.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return !os.fail();
+}
+
+bool TemplateEnv::LoadPrecompiledTemplates(std::istream& is)
+{
+    std::string data{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+    NamedTemplateLayouts layouts;
+    if (!ReadLayoutsFile(data, layouts))
+        return false;
+
+    std::unique_lock<std::shared_timed_mutex> l(m_guard);
+    for (auto& entry : layouts)
+    {
+        auto& storage = entry.second->charSize == sizeof(char) ? m_precompiledLayouts : m_precompiledWLayouts;
+        storage[entry.first] = std::move(entry.second);
+    }
+    return true;
+}
+
+std::shared_ptr<const TemplateLayout> TemplateEnv::FindPrecompiledLayout(const std::string& fileName, std::size_t charSize)
+{
+    std::shared_lock<std::shared_timed_mutex> l(m_guard);
+    auto& storage = charSize == sizeof(char) ? m_precompiledLayouts : m_precompiledWLayouts;
+    auto p = storage.find(fileName);
+    return p == storage.end() ? nullptr : p->second;
+}
+
 } // jinja2
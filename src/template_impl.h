@@ -1,20 +1,33 @@
 #ifndef TEMPLATE_IMPL_H
 #define TEMPLATE_IMPL_H
 
+#include "constant_folder.h"
+#include "globals_substitutor.h"
 #include "internal_value.h"
 #include "jinja2cpp/binding/rapid_json.h"
+#include "jinja2cpp/render_sink.h"
 #include "jinja2cpp/template_env.h"
 #include "jinja2cpp/value.h"
+#include "loop_usage_analyzer.h"
+#include "macro_inliner.h"
+#include "path_memoizer.h"
 #include "renderer.h"
+#include "slot_resolver.h"
 #include "template_parser.h"
 #include "value_visitors.h"
+#include "xxhash64.h"
 
 #include <boost/optional.hpp>
 #include <boost/predef/other/endian.h>
 #include <nonstd/expected.hpp>
 #include <rapidjson/error/en.h>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_set>
 
 namespace jinja2
 {
@@ -87,10 +100,159 @@ struct TemplateLoader<wchar_t>
 };
 
 template<typename CharT>
-class GenericStreamWriter : public OutStream::StreamWriter
+class ChunkedStreamWriter : public OutStream::StreamWriter
 {
 public:
-    explicit GenericStreamWriter(std::basic_string<CharT>& os)
+    static constexpr size_t ChunkSize = 0x1000;
+
+    explicit ChunkedStreamWriter(std::basic_ostream<CharT>& os)
+        : m_os(os)
+    {
+        m_buffer.reserve(ChunkSize);
+    }
+
+    // StreamWriter interface
+    void WriteBuffer(const void* ptr, size_t length) override
+    {
+        auto chars = reinterpret_cast<const CharT*>(ptr);
+        if (m_buffer.size() + length > ChunkSize)
+        {
+            Flush();
+            if (length >= ChunkSize)
+            {
+                Emit(chars, length);
+                return;
+            }
+        }
+        m_buffer.append(chars, length);
+    }
+    size_t WriteValue(const InternalValue& val) override
+    {
+        auto offset = m_buffer.size();
+        Apply<visitors::ValueRenderer<CharT>>(val, m_buffer);
+        auto length = m_buffer.size() - offset;
+        if (m_buffer.size() >= ChunkSize)
+            Flush();
+        return length;
+    }
+
+    void Flush()
+    {
+        if (m_buffer.empty())
+            return;
+
+        Emit(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+
+    size_t GetEmittedSize() const { return m_emitted; }
+
+private:
+    void Emit(const CharT* chars, size_t length)
+    {
+        m_os.write(chars, static_cast<std::streamsize>(length));
+        m_emitted += length;
+    }
+
+private:
+    std::basic_ostream<CharT>& m_os;
+    std::basic_string<CharT> m_buffer;
+    size_t m_emitted = 0;
+};
+
+template<typename CharT>
+struct SinkValueWriter
+{
+    using string_view_t = nonstd::basic_string_view<CharT>;
+
+    explicit SinkValueWriter(IRenderSinkTpl<CharT>* sink)
+        : m_sink(sink)
+    {
+    }
+
+    // Sink renders the numbers itself, so their length is calculated separately
+    size_t operator()(int64_t val) const
+    {
+        m_sink->WriteInteger(val);
+        size_t length = val < 0 ? 2 : 1;
+        for (; val / 10 != 0; val /= 10)
+            ++ length;
+        return length;
+    }
+    size_t operator()(double val) const
+    {
+        m_sink->WriteDouble(val);
+        std::basic_string<CharT> str;
+        Apply<visitors::ValueRenderer<CharT>>(InternalValue(val), str);
+        return str.size();
+    }
+    size_t operator()(bool val) const
+    {
+        auto str = (val ? UNIVERSAL_STR("true") : UNIVERSAL_STR("false")).template GetValue<CharT>();
+        m_sink->WriteString(string_view_t(str.data(), str.size()));
+        return str.size();
+    }
+    size_t operator()(const std::basic_string<CharT>& val) const
+    {
+        m_sink->WriteString(string_view_t(val.data(), val.size()));
+        return val.size();
+    }
+    size_t operator()(const string_view_t& val) const
+    {
+        m_sink->WriteString(val);
+        return val.size();
+    }
+    template<typename CharU>
+    size_t operator()(const std::basic_string<CharU>& val) const
+    {
+        auto str = ConvertString<std::basic_string<CharT>>(val);
+        m_sink->WriteString(string_view_t(str.data(), str.size()));
+        return str.size();
+    }
+    template<typename CharU>
+    size_t operator()(const nonstd::basic_string_view<CharU>& val) const
+    {
+        auto str = ConvertString<std::basic_string<CharT>>(val);
+        m_sink->WriteString(string_view_t(str.data(), str.size()));
+        return str.size();
+    }
+    template<typename T>
+    size_t operator()(const T&) const
+    {
+        return 0;
+    }
+
+    IRenderSinkTpl<CharT>* m_sink;
+};
+
+template<typename CharT>
+class SinkStreamWriter : public OutStream::StreamWriter
+{
+public:
+    explicit SinkStreamWriter(IRenderSinkTpl<CharT>& sink)
+        : m_sink(sink)
+    {}
+
+    // StreamWriter interface
+    void WriteBuffer(const void* ptr, size_t length) override
+    {
+        m_sink.WriteBuffer(reinterpret_cast<const CharT*>(ptr), length);
+    }
+    size_t WriteValue(const InternalValue& val) override
+    {
+        return Apply<SinkValueWriter<CharT>>(val, &m_sink);
+    }
+    bool KeepsValues() const override { return true; }
+
+private:
+    IRenderSinkTpl<CharT>& m_sink;
+};
+
+template<typename CharT>
+class HashingStreamWriter : public OutStream::StreamWriter
+{
+public:
+    explicit HashingStreamWriter(std::basic_string<CharT>& os)
         : m_os(os)
     {}
 
@@ -98,37 +260,149 @@ public:
     void WriteBuffer(const void* ptr, size_t length) override
     {
         m_os.append(reinterpret_cast<const CharT*>(ptr), length);
+        m_hasher.Update(ptr, length * sizeof(CharT));
     }
-    void WriteValue(const InternalValue& val) override
+    size_t WriteValue(const InternalValue& val) override
     {
+        auto offset = m_os.size();
         Apply<visitors::ValueRenderer<CharT>>(val, m_os);
+        m_hasher.Update(m_os.data() + offset, (m_os.size() - offset) * sizeof(CharT));
+        return m_os.size() - offset;
     }
 
+    uint64_t GetHash() const { return m_hasher.GetHash(); }
+
 private:
     std::basic_string<CharT>& m_os;
+    XxHash64 m_hasher;
 };
 
 template<typename CharT>
-class StringStreamWriter : public OutStream::StreamWriter
+class BudgetStreamWriter : public OutStream::StreamWriter
 {
 public:
-    explicit StringStreamWriter(std::basic_string<CharT>* targetStr)
-        : m_targetStr(targetStr)
+    BudgetStreamWriter(OutStream os, RenderBudget& budget, IRendererCallback* callback)
+        : m_os(os)
+        , m_budget(budget)
+        , m_callback(callback)
     {}
 
     // StreamWriter interface
     void WriteBuffer(const void* ptr, size_t length) override
     {
-        m_targetStr->append(reinterpret_cast<const CharT*>(ptr), length);
-        // m_os.write(reinterpret_cast<const CharT*>(ptr), length);
+        m_budget.OnOutput(length, m_callback);
+        m_os.WriteBuffer(ptr, length);
     }
-    void WriteValue(const InternalValue& val) override
+    // Value is rendered once and counted before it's written. Sinks take the values as is, so for them it's counted after it's written
+    size_t WriteValue(const InternalValue& val) override
     {
-        Apply<visitors::ValueRenderer<CharT>>(val, *m_targetStr);
+        if (m_os.KeepsValues())
+        {
+            auto length = m_os.WriteValue(val);
+            m_budget.OnOutput(length, m_callback);
+            return length;
+        }
+
+        m_buffer.clear();
+        Apply<visitors::ValueRenderer<CharT>>(val, m_buffer);
+        m_budget.OnOutput(m_buffer.size(), m_callback);
+        m_os.WriteBuffer(m_buffer.data(), m_buffer.size());
+        return m_buffer.size();
     }
+    bool KeepsValues() const override { return m_os.KeepsValues(); }
 
 private:
-    std::basic_string<CharT>* m_targetStr;
+    OutStream m_os;
+    RenderBudget& m_budget;
+    IRendererCallback* m_callback;
+    std::basic_string<CharT> m_buffer;
+};
+
+template<typename CharT>
+class SegmentsStreamWriter : public OutStream::StreamWriter
+{
+public:
+    // `textPool` keeps the text of the rendered tree which isn't the part of the source
+    SegmentsStreamWriter(const std::basic_string<CharT>& source, std::shared_ptr<const OwnedTextPool<CharT>> textPool)
+        : m_sourceBegin(source.data())
+        , m_sourceEnd(source.data() + source.size())
+        , m_textPool(std::move(textPool))
+    {}
+
+    // StreamWriter interface
+    void WriteBuffer(const void* ptr, size_t length) override
+    {
+        auto chars = reinterpret_cast<const CharT*>(ptr);
+        // Text of the included or parent templates isn't owned by this template, so it's copied. Such text lives in
+        // the unrelated arrays, so the pointers are compared with std::less which gives the total order for them
+        bool isSource = !std::less<const CharT*>()(chars, m_sourceBegin) && !std::greater<const CharT*>()(chars + length, m_sourceEnd);
+        if (!isSource && (!m_textPool || !m_textPool->Contains(chars, length)))
+        {
+            auto offset = m_storage.size();
+            m_storage.append(chars, length);
+            AddStorageSegment(offset);
+            return;
+        }
+
+        if (length != 0)
+            m_segments.push_back(Segment{chars, 0, length});
+    }
+    size_t WriteValue(const InternalValue& val) override
+    {
+        auto offset = m_storage.size();
+        Apply<visitors::ValueRenderer<CharT>>(val, m_storage);
+        AddStorageSegment(offset);
+        return m_storage.size() - offset;
+    }
+
+    void GetSegments(RenderSegmentsTpl<CharT>& result)
+    {
+        // Storage keeps the text pool alive, because the segments can refer to it
+        auto storage = std::make_shared<Storage>();
+        storage->text = std::move(m_storage);
+        storage->textPool = m_textPool;
+        result.segments.clear();
+        result.segments.reserve(m_segments.size());
+        for (auto& s : m_segments)
+        {
+            const CharT* ptr = s.ptr != nullptr ? s.ptr : storage->text.data() + s.offset;
+            result.segments.emplace_back(ptr, s.length);
+        }
+        result.storage = std::shared_ptr<const std::basic_string<CharT>>(storage, &storage->text);
+    }
+
+private:
+    struct Segment
+    {
+        const CharT* ptr;
+        size_t offset;
+        size_t length;
+    };
+
+    struct Storage
+    {
+        std::basic_string<CharT> text;
+        std::shared_ptr<const OwnedTextPool<CharT>> textPool;
+    };
+
+    void AddStorageSegment(size_t offset)
+    {
+        auto length = m_storage.size() - offset;
+        if (length == 0)
+            return;
+
+        if (!m_segments.empty() && m_segments.back().ptr == nullptr)
+            m_segments.back().length += length;
+        else
+            m_segments.push_back(Segment{nullptr, offset, length});
+    }
+
+private:
+    const CharT* m_sourceBegin;
+    const CharT* m_sourceEnd;
+    std::shared_ptr<const OwnedTextPool<CharT>> m_textPool;
+    std::basic_string<CharT> m_storage;
+    std::vector<Segment> m_segments;
 };
 
 template<typename ErrorTpl1, typename ErrorTpl2>
@@ -158,6 +432,12 @@ struct ErrorConverter<ErrorInfoTpl<CharT>, ErrorInfoTpl<CharT>>
     }
 };
         
+template<typename CharT>
+class RenderStateImpl;
+
+template<typename CharT>
+class StaticPrefixCollector;
+
 template<typename CharT>
 class TemplateImpl : public ITemplateImpl
 {
@@ -180,61 +460,162 @@ public:
         m_templateName = tplName.empty() ? std::string("noname.j2tpl") : std::move(tplName);
         TemplateParser<CharT> parser(&m_template, m_settings, m_env, m_templateName);
 
-        auto parseResult = parser.Parse();
+        auto layout = m_env ? m_env->FindPrecompiledLayout(m_templateName, sizeof(CharT)) : nullptr;
+        if (layout && !layout->Matches(m_template, m_settings))
+            layout.reset();
+
+        auto parseResult = parser.Parse(layout.get());
         if (!parseResult)
             return parseResult.error()[0];
 
         m_renderer = *parseResult;
+        Optimize(m_renderer, parser.GetTextPool());
+        m_textPool = parser.GetTextPool();
+        std::atomic_store(&m_specialization, std::shared_ptr<const Specialization>());
         m_metadataInfo = parser.GetMetadataInfo();
         return boost::optional<ErrorInfoTpl<CharT>>();
     }
 
+    // Runs the parse-time passes over the renderers tree. Text produced by the passes is kept by the `textPool` of the tree
+    void Optimize(const RendererPtr& renderer, const std::shared_ptr<OwnedTextPool<CharT>>& textPool)
+    {
+        {
+            RendererCallback callback(this);
+            ConstantFolder<CharT> folder(&callback, textPool);
+            folder.Fold(renderer);
+        }
+        SlotResolver().Resolve(renderer);
+        MacroInliner().Inline(renderer);
+        LoopUsageAnalyzer().Analyze(renderer);
+        // Memoized paths are used only by the renderings which start from the root renderer of this tree
+        PathMemoizer(renderer.get()).Memoize(renderer);
+    }
+
+    // Returns nullptr if the template isn't loaded successfully
+    std::shared_ptr<TemplateLayout> BuildLayout() const
+    {
+        if (!m_renderer)
+            return nullptr;
+
+        TemplateParser<CharT> parser(&m_template, m_settings, m_env, m_templateName);
+        return parser.BuildLayout();
+    }
+
     boost::optional<ErrorInfoTpl<CharT>> Render(std::basic_string<CharT>& os, const ValuesMap& params)
     {
-        boost::optional<ErrorInfoTpl<CharT>> normalResult;
+        auto initialSize = os.size();
+        auto sizeHint = m_outputSizeHint.load(std::memory_order_relaxed);
+        if (os.capacity() < initialSize + sizeHint)
+            os.reserve(initialSize + sizeHint + sizeHint / 8);
+
+        auto result = Render(OutStream(&os), params);
+        if (!result)
+            UpdateOutputSizeHint(os.size() - initialSize);
+        return result;
+    }
+
+    boost::optional<ErrorInfoTpl<CharT>> Render(std::basic_string<CharT>& os, const ValuesMap& params, uint64_t& outputHash)
+    {
+        auto sizeHint = m_outputSizeHint.load(std::memory_order_relaxed);
+        if (os.capacity() < os.size() + sizeHint)
+            os.reserve(os.size() + sizeHint + sizeHint / 8);
+
+        HashingStreamWriter<CharT> writer(os);
+        auto result = Render(OutStream(&writer), params);
+        if (!result)
+            UpdateOutputSizeHint(os.size());
+        outputHash = writer.GetHash();
+        return result;
+    }
+
+    boost::optional<ErrorInfoTpl<CharT>> Render(std::basic_ostream<CharT>& os, const ValuesMap& params, size_t& emittedSize)
+    {
+        ChunkedStreamWriter<CharT> writer(os);
+        auto result = Render(OutStream(&writer), params);
+        writer.Flush();
+        emittedSize = writer.GetEmittedSize();
+        return result;
+    }
 
+    boost::optional<ErrorInfoTpl<CharT>> Render(RenderSegmentsTpl<CharT>& segments, const ValuesMap& params)
+    {
         if (!m_renderer)
+            return MakeNotParsedError();
+
+        auto specialization = GetSpecialization();
+        auto renderer = GetRootRenderer(*specialization, params);
+        SegmentsStreamWriter<CharT> writer(m_template, renderer == specialization->tree ? specialization->textPool : m_textPool);
+        auto result = RenderRoot(OutStream(&writer), *specialization, renderer, params);
+        if (!result)
+            writer.GetSegments(segments);
+        return result;
+    }
+
+    boost::optional<ErrorInfoTpl<CharT>> Render(IRenderSinkTpl<CharT>& sink, const ValuesMap& params)
+    {
+        SinkStreamWriter<CharT> writer(sink);
+        return Render(OutStream(&writer), params);
+    }
+
+    boost::optional<ErrorInfoTpl<CharT>> RenderBlock(std::basic_string<CharT>& os, const std::string& blockName, const ValuesMap& params)
+    {
+        if (!m_renderer)
+            return MakeNotParsedError();
+
+        auto specialization = GetSpecialization();
+        auto tree = GetRootRenderer(*specialization, params);
+        return Render(*specialization, params, [this, &tree, &os, &blockName](RenderContext& context) {
+            OutStream outStream(&os);
+            RenderWithOutputBudget(outStream, context, [this, &tree, &blockName, &context](OutStream& stream) {
+                if (!RenderTemplateBlock(tree.get(), blockName, stream, context))
+                    ThrowRuntimeError(ErrorCode::BlockNotFound, ValuesList{Value(blockName)});
+            });
+        });
+    }
+
+    boost::optional<ErrorInfoTpl<CharT>> Render(OutStream outStream, const ValuesMap& params)
+    {
+        if (!m_renderer)
+            return MakeNotParsedError();
+
+        auto specialization = GetSpecialization();
+        return RenderRoot(outStream, *specialization, GetRootRenderer(*specialization, params), params);
+    }
+
+    // Root renderer for the rendering of this template as the included or the parent one within the specified context
+    RendererPtr GetRootRenderer(const RenderContext& context)
+    {
+        auto specialization = GetSpecialization();
+        if (!specialization->tree)
+            return m_renderer;
+
+        for (auto& name : specialization->substitutedNames)
         {
-            typename ErrorInfoTpl<CharT>::Data errorData;
-            errorData.code = ErrorCode::TemplateNotParsed;
-            errorData.srcLoc.col = 1;
-            errorData.srcLoc.line = 1;
-            errorData.srcLoc.fileName = "<unknown file>";
+            if (context.IsShadowed(name))
+                return m_renderer;
+        }
+        return specialization->tree;
+    }
 
-            return ErrorInfoTpl<CharT>(errorData);
+    static void ConvertParams(const ValuesMap& params, InternalValueMap& intParams)
+    {
+        for (auto& ip : params)
+        {
+            auto valRef = &ip.second.data();
+            auto newParam = visit(visitors::InputValueConvertor(false, true), *valRef);
+            if (!newParam)
+                intParams[ip.first] = ValueRef(static_cast<const Value&>(*valRef));
+            else
+                intParams[ip.first] = newParam.get();
         }
+    }
 
+    template<typename Fn>
+    boost::optional<ErrorInfoTpl<CharT>> InvokeRenderer(Fn&& fn)
+    {
         try
         {
-            InternalValueMap extParams;
-            InternalValueMap intParams;
-
-            auto convertFn = [&intParams](auto& params) {
-                for (auto& ip : params)
-                {
-                    auto valRef = &ip.second.data();
-                    auto newParam = visit(visitors::InputValueConvertor(false, true), *valRef);
-                    if (!newParam)
-                        intParams[ip.first] = ValueRef(static_cast<const Value&>(*valRef));
-                    else
-                        intParams[ip.first] = newParam.get();
-                }
-            };
-
-            if (m_env)
-            {
-                m_env->ApplyGlobals(convertFn);
-                std::swap(extParams, intParams);
-            }
-
-            convertFn(params);
-            SetupGlobals(extParams);
-
-            RendererCallback callback(this);
-            RenderContext context(intParams, extParams, &callback);
-            InitRenderContext(context);
-            OutStream outStream([writer = GenericStreamWriter<CharT>(os)]() mutable -> OutStream::StreamWriter* {return &writer;});
-            m_renderer->Render(outStream, context);
+            fn();
         }
         catch (const ErrorInfoTpl<char>& error)
         {
@@ -256,7 +637,40 @@ public:
             return ErrorInfoTpl<CharT>(errorData);
         }
 
-        return normalResult;
+        return boost::optional<ErrorInfoTpl<CharT>>();
+    }
+
+    ErrorInfoTpl<CharT> MakeNotParsedError() const
+    {
+        typename ErrorInfoTpl<CharT>::Data errorData;
+        errorData.code = ErrorCode::TemplateNotParsed;
+        errorData.srcLoc.col = 1;
+        errorData.srcLoc.line = 1;
+        errorData.srcLoc.fileName = "<unknown file>";
+
+        return ErrorInfoTpl<CharT>(errorData);
+    }
+
+    nonstd::expected<std::basic_string<CharT>, ErrorInfoTpl<CharT>> GetStaticPrefix()
+    {
+        if (!m_renderer)
+            return nonstd::make_unexpected(MakeNotParsedError());
+
+        std::basic_string<CharT> prefix;
+        StaticPrefixCollector<CharT> collector(prefix);
+        collector.Collect(this);
+        if (collector.GetError())
+            return nonstd::make_unexpected(collector.GetError().value());
+
+        return prefix;
+    }
+
+    nonstd::expected<std::shared_ptr<RenderStateImpl<CharT>>, ErrorInfoTpl<CharT>> StartRender(std::shared_ptr<ThisType> self, const ValuesMap& params, size_t chunkSize)
+    {
+        if (!m_renderer)
+            return nonstd::make_unexpected(MakeNotParsedError());
+
+        return std::make_shared<RenderStateImpl<CharT>>(std::move(self), params, chunkSize);
     }
 
     InternalValueMap& InitRenderContext(RenderContext& context)
@@ -265,6 +679,22 @@ public:
         return curScope;
     }
 
+    // Counts the output against the budget limit if it's set. Otherwise the stream is used as is
+    template<typename Fn>
+    static void RenderWithOutputBudget(OutStream& os, RenderContext& context, Fn&& renderFn)
+    {
+        auto budget = context.GetRenderBudget();
+        if (budget == nullptr || !budget->HasOutputLimit())
+        {
+            renderFn(os);
+            return;
+        }
+
+        BudgetStreamWriter<CharT> writer(os, *budget, context.GetRendererCallback());
+        OutStream budgetStream(&writer);
+        renderFn(budgetStream);
+    }
+
     using TplLoadResultType = nonstd::variant<EmptyValue,
             nonstd::expected<std::shared_ptr<TemplateImpl<char>>, ErrorInfo>,
             nonstd::expected<std::shared_ptr<TemplateImpl<wchar_t>>, ErrorInfoW>>;
@@ -328,6 +758,164 @@ public:
     nonstd::expected<MetadataInfo<CharT>, ErrorInfoTpl<CharT>> GetMetadataRaw() const { return m_metadataInfo; }
 
 private:
+    friend class RenderStateImpl<CharT>;
+
+    // Snapshot of the env globals: their converted values and the template renderers tree which is specialized with them. Snapshot is
+    // shared by the renderings until the globals change
+    struct Specialization
+    {
+        uint64_t globalsVersion = 0;
+        // Converted values can refer to the source ones
+        ValuesMap sourceGlobals;
+        InternalValueMap globals;
+        // Specialized renderers tree. It's nullptr if the template isn't specialized
+        RendererPtr tree;
+        std::shared_ptr<const OwnedTextPool<CharT>> textPool;
+        std::unordered_set<std::string> substitutedNames;
+    };
+
+    bool IsSpecializationActual(const Specialization* specialization) const
+    {
+        return specialization && (!m_env || specialization->globalsVersion == m_env->m_globalsVersion.load());
+    }
+
+    // Specialization is rebuilt by one rendering at a time. Concurrent renderings keep using the previous snapshot meanwhile, and wait
+    // for the rebuild only if there is no snapshot yet
+    std::shared_ptr<const Specialization> GetSpecialization()
+    {
+        auto specialization = std::atomic_load(&m_specialization);
+        if (IsSpecializationActual(specialization.get()))
+            return specialization;
+
+        std::unique_lock<std::mutex> lock(m_specializationMutex, std::defer_lock);
+        if (!specialization)
+            lock.lock();
+        else if (!lock.try_lock())
+            return specialization;
+
+        specialization = std::atomic_load(&m_specialization);
+        if (!IsSpecializationActual(specialization.get()))
+        {
+            specialization = Specialize();
+            std::atomic_store(&m_specialization, specialization);
+        }
+        return specialization;
+    }
+
+    // Render params shadow the globals with the same names
+    static bool IsSpecializationUsable(const Specialization& specialization, const ValuesMap& params)
+    {
+        if (!specialization.tree)
+            return false;
+
+        for (auto& name : specialization.substitutedNames)
+        {
+            if (params.count(name) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    RendererPtr GetRootRenderer(const Specialization& specialization, const ValuesMap& params) const
+    {
+        return IsSpecializationUsable(specialization, params) ? specialization.tree : m_renderer;
+    }
+
+    boost::optional<ErrorInfoTpl<CharT>> RenderRoot(OutStream outStream, const Specialization& specialization, const RendererPtr& renderer,
+                                                    const ValuesMap& params)
+    {
+        return Render(specialization, params, [&renderer, &outStream](RenderContext& context) {
+            context.SetMemoOwner(renderer.get());
+            RenderWithOutputBudget(outStream, context, [&renderer, &context](OutStream& stream) { renderer->Render(stream, context); });
+        });
+    }
+
+    template<typename Fn>
+    boost::optional<ErrorInfoTpl<CharT>> Render(const Specialization& specialization, const ValuesMap& params, Fn&& renderFn)
+    {
+        return InvokeRenderer([this, &specialization, &params, &renderFn]() {
+            InternalValueMap intParams;
+            ConvertParams(params, intParams);
+
+            RendererCallback callback(this);
+            RenderContext context(intParams, specialization.globals, &callback);
+            InitRenderContext(context);
+
+            boost::optional<RenderBudget> budget;
+            if (RenderBudget::HasLimits(m_settings.renderLimits))
+            {
+                budget.emplace(m_settings.renderLimits);
+                context.SetRenderBudget(&budget.get());
+                callback.SetRenderBudget(&budget.get());
+            }
+            renderFn(context);
+        });
+    }
+
+    std::shared_ptr<const Specialization> Specialize()
+    {
+        auto result = std::make_shared<Specialization>();
+        if (m_env)
+        {
+            m_env->ApplyGlobals([this, &result](auto& envGlobals) {
+                result->sourceGlobals = envGlobals;
+                result->globalsVersion = m_env->m_globalsVersion.load();
+            });
+        }
+        ConvertParams(result->sourceGlobals, result->globals);
+        SetupGlobals(result->globals);
+        if (!m_env || !m_settings.specializeOnGlobals || !m_renderer)
+            return result;
+
+        // Only the self-contained scalar values are substituted. Built-in globals take precedence over the env ones
+        InternalValueMap builtins;
+        SetupGlobals(builtins);
+        // Source values are kept intact, because the converted globals refer to them
+        const auto& sourceGlobals = result->sourceGlobals;
+        InternalValueMap constants;
+        for (auto& g : sourceGlobals)
+        {
+            if (builtins.count(g.first) != 0)
+                continue;
+
+            auto value = visit(visitors::InputValueConvertor(true, false), g.second.data());
+            if (!value)
+                continue;
+
+            auto& data = value->GetData();
+            if (nonstd::holds_alternative<bool>(data) || nonstd::holds_alternative<TargetString>(data) ||
+                nonstd::holds_alternative<int64_t>(data) || nonstd::holds_alternative<double>(data))
+                constants[g.first] = std::move(value.get());
+        }
+        if (constants.empty())
+            return result;
+
+        TemplateParser<CharT> parser(&m_template, m_settings, m_env, m_templateName);
+        auto parseResult = parser.Parse();
+        if (!parseResult)
+            return result;
+
+        auto renderer = *parseResult;
+        GlobalsSubstitutor substitutor(constants);
+        substitutor.Substitute(renderer);
+        if (substitutor.GetSubstitutedNames().empty())
+            return result;
+
+        Optimize(renderer, parser.GetTextPool());
+        result->tree = renderer;
+        result->textPool = parser.GetTextPool();
+        result->substitutedNames = substitutor.GetSubstitutedNames();
+        return result;
+    }
+
+    void UpdateOutputSizeHint(size_t outputSize)
+    {
+        // Exponential moving average of the output size. Concurrent renders may lose some updates, which doesn't matter for the hint
+        auto sizeHint = m_outputSizeHint.load(std::memory_order_relaxed);
+        sizeHint = sizeHint == 0 ? outputSize : sizeHint - sizeHint / 8 + outputSize / 8;
+        m_outputSizeHint.store(sizeHint, std::memory_order_relaxed);
+    }
+
     void ThrowRuntimeError(ErrorCode code, ValuesList extraParams)
     {
         typename ErrorInfoTpl<CharT>::Data errorData;
@@ -347,6 +935,11 @@ private:
             : m_host(host)
         {}
 
+        void SetRenderBudget(RenderBudget* budget)
+        {
+            m_budget = budget;
+        }
+
         TargetString GetAsTargetString(const InternalValue& val) override
         {
             std::basic_string<CharT> os;
@@ -358,7 +951,11 @@ private:
         {
             using string_t = std::basic_string<CharT>;
             str = string_t();
-            return OutStream([writer = StringStreamWriter<CharT>(&nonstd::get<string_t>(str))]() mutable -> OutStream::StreamWriter* { return &writer; });
+            auto& target = nonstd::get<string_t>(str);
+            // Captured output (`set` and filter blocks, macro calls) is counted as well, so the runaway loops can't grow it unlimitedly
+            if (m_budget != nullptr && m_budget->HasOutputLimit())
+                return OutStream(std::make_shared<BudgetStreamWriter<CharT>>(OutStream(&target), *m_budget, this));
+            return OutStream(&target);
         }
 
         nonstd::variant<EmptyValue,
@@ -382,6 +979,7 @@ private:
 
     private:
         ThisType* m_host;
+        RenderBudget* m_budget = nullptr;
     };
 
 private:
@@ -392,9 +990,181 @@ private:
     std::basic_string<CharT> m_template;
     std::string m_templateName;
     RendererPtr m_renderer;
+    // Text of the renderers tree which isn't the part of the template source
+    std::shared_ptr<const OwnedTextPool<CharT>> m_textPool;
+    std::shared_ptr<const Specialization> m_specialization;
+    std::mutex m_specializationMutex;
     mutable nonstd::optional<GenericMap> m_metadata;
     mutable nonstd::optional<JsonDocumentType> m_metadataJson;
     MetadataInfo<CharT> m_metadataInfo;
+    std::atomic<size_t> m_outputSizeHint{0};
+};
+
+// Resumable rendering. Template is rendered by the regular renderers on the worker thread, and the output writer suspends the worker
+// once the requested chunk is filled. So the rendering is suspended at any point of the output: within the loops, blocks, macros, included
+// and parent templates. Worker is started by the first resume and is stopped when the rendering is finished or the state is destroyed
+template<typename CharT>
+class RenderStateImpl : public ResumableRender
+{
+public:
+    RenderStateImpl(std::shared_ptr<TemplateImpl<CharT>> tpl, const ValuesMap& params, size_t chunkSize)
+        : m_template(std::move(tpl))
+        , m_params(params)
+        , m_specialization(m_template->GetSpecialization())
+        , m_callback(m_template.get())
+        , m_context(m_intParams, m_specialization->globals, &m_callback)
+        , m_chunkSize(chunkSize)
+    {
+        // Params are kept by value, because external params can be destroyed between the resumes. Env globals snapshot is kept
+        // by the specialization
+        TemplateImpl<CharT>::ConvertParams(m_params, m_intParams);
+        m_template->InitRenderContext(m_context);
+        m_renderer = m_template->GetRootRenderer(*m_specialization, m_params);
+        m_context.SetMemoOwner(m_renderer.get());
+        if (RenderBudget::HasLimits(m_template->m_settings.renderLimits))
+        {
+            m_budget.emplace(m_template->m_settings.renderLimits);
+            m_context.SetRenderBudget(&m_budget.get());
+            m_callback.SetRenderBudget(&m_budget.get());
+        }
+    }
+
+    boost::optional<ErrorInfoTpl<CharT>> Resume(std::basic_string<CharT>& chunk)
+    {
+        chunk.clear();
+        if (m_isFinished)
+            return boost::optional<ErrorInfoTpl<CharT>>();
+
+        m_chunk = &chunk;
+        // Timeout limits every single resume, because the pauses between them are controlled by the caller
+        if (m_budget)
+            m_budget->RestartTimer();
+        auto result = m_template->InvokeRenderer([this, &chunk]() {
+            OutStream outStream(&chunk);
+            TemplateImpl<CharT>::RenderWithOutputBudget(
+              outStream, m_context, [this](OutStream& stream) { m_isFinished = m_renderer->Resume(stream, m_context, *this); });
+        });
+        m_chunk = nullptr;
+        if (result)
+            m_isFinished = true;
+        return result;
+    }
+
+    bool IsFinished() const { return m_isFinished; }
+
+    // Output which is produced after the chunk is filled goes to the next chunk. Empty chunk isn't returned, so the output of the single
+    // renderer which exceeds the chunk size isn't split
+    bool ShouldSuspend() const override { return !m_chunk->empty() && m_chunk->size() >= m_chunkSize; }
+
+private:
+    std::shared_ptr<TemplateImpl<CharT>> m_template;
+    ValuesMap m_params;
+    std::shared_ptr<const typename TemplateImpl<CharT>::Specialization> m_specialization;
+    InternalValueMap m_intParams;
+    typename TemplateImpl<CharT>::RendererCallback m_callback;
+    RenderContext m_context;
+    boost::optional<RenderBudget> m_budget;
+    RendererPtr m_renderer;
+    size_t m_chunkSize;
+    std::basic_string<CharT>* m_chunk = nullptr;
+    bool m_isFinished = false;
+};
+
+// Collects the longest part of the template output which doesn't depend on the render params. Output of the parent templates
+// is taken into account, but the blocks which are overridden in the derived templates terminate the prefix
+template<typename CharT>
+class StaticPrefixCollector : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    explicit StaticPrefixCollector(std::basic_string<CharT>& prefix)
+        : m_prefix(prefix)
+    {
+    }
+
+    void Collect(TemplateImpl<CharT>* tpl)
+    {
+        m_template = tpl;
+        Collect(tpl->GetRenderer().get());
+    }
+
+    auto& GetError() const { return m_error; }
+
+    void DoVisit(RawTextRenderer* renderer) override
+    {
+        m_prefix.append(static_cast<const CharT*>(renderer->GetData()), renderer->GetLength());
+        m_isStatic = true;
+    }
+
+    // Folded numeric constants are kept as expressions
+    void DoVisit(ExpressionRenderer* renderer) override
+    {
+        auto constant = dynamic_cast<ConstantExpression*>(renderer->GetExpression().get());
+        if (constant == nullptr)
+            return;
+
+        Apply<visitors::ValueRenderer<CharT>>(constant->GetValue(), m_prefix);
+        m_isStatic = true;
+    }
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        for (auto& r : renderer->GetRenderers())
+        {
+            if (!Collect(r.get()))
+                return;
+        }
+        m_isStatic = true;
+    }
+
+    void DoVisit(ParentBlockStatement* stmt) override
+    {
+        if (m_overriddenBlocks.count(stmt->GetName()) == 0)
+            m_isStatic = Collect(stmt->GetMainBody().get());
+    }
+
+    void DoVisit(ExtendsStatement* stmt) override
+    {
+        if (!stmt->IsPath())
+            return;
+
+        auto tplResult = m_template->LoadTemplate(stmt->GetTemplateName());
+        auto parentTpl = nonstd::get_if<typename TemplateImpl<CharT>::TplOrError>(&tplResult);
+        if (parentTpl == nullptr)
+            return;
+
+        if (!*parentTpl)
+        {
+            m_error = parentTpl->error();
+            return;
+        }
+
+        for (auto& block : stmt->GetBlocks())
+            m_overriddenBlocks.insert(block.first);
+
+        Collect(parentTpl->value().get());
+        // Output of the derived template after the 'extends' statement isn't static anymore
+        m_isStatic = false;
+    }
+
+private:
+    bool Collect(RendererBase* renderer)
+    {
+        m_isStatic = false;
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer);
+        if (stmt != nullptr && !m_error)
+            Visit(stmt);
+
+        return m_isStatic;
+    }
+
+private:
+    std::basic_string<CharT>& m_prefix;
+    TemplateImpl<CharT>* m_template = nullptr;
+    std::unordered_set<std::string> m_overriddenBlocks;
+    bool m_isStatic = false;
+    nonstd::optional<ErrorInfoTpl<CharT>> m_error;
 };
 
 } // jinja2
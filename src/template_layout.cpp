@@ -0,0 +1,213 @@
+#include "template_layout.h"
+#include "lexer.h"
+
+#include <algorithm>
+
+namespace jinja2
+{
+namespace
+{
+const char FileSignature[] = {'J', '2', 'C', 'P', 'P', 'T', 'P', 'L'};
+
+// All integers are stored in the little-endian byte order regardless of the platform
+template<typename T>
+void WriteInt(std::string& out, T val)
+{
+    for (size_t idx = 0; idx != sizeof(T); ++ idx)
+        out.push_back(static_cast<char>(static_cast<uint64_t>(val) >> (idx * 8)));
+}
+
+template<typename T>
+bool ReadInt(const char*& ptr, const char* end, T& val)
+{
+    if (static_cast<size_t>(end - ptr) < sizeof(T))
+        return false;
+
+    uint64_t result = 0;
+    for (size_t idx = 0; idx != sizeof(T); ++ idx)
+        result |= static_cast<uint64_t>(static_cast<uint8_t>(*ptr ++)) << (idx * 8);
+    val = static_cast<T>(result);
+    return true;
+}
+
+template<typename T, typename Fn>
+bool ReadTable(const char*& ptr, const char* end, size_t itemSize, std::vector<T>& items, Fn&& readItem)
+{
+    uint32_t count = 0;
+    if (!ReadInt(ptr, end, count) || static_cast<size_t>(end - ptr) / itemSize < count)
+        return false;
+
+    items.resize(count);
+    for (auto& item : items)
+        readItem(item);
+    return true;
+}
+} // namespace
+
+void TemplateLayout::Serialize(std::string& out) const
+{
+    WriteInt(out, charSize);
+    WriteInt(out, settingsFlags);
+    WriteInt(out, sourceLength);
+    WriteInt(out, sourceHash);
+
+    WriteInt(out, static_cast<uint32_t>(lines.size()));
+    for (auto& line : lines)
+    {
+        WriteInt(out, line.startOffset);
+        WriteInt(out, line.endOffset);
+        WriteInt(out, line.lineNumber);
+    }
+
+    WriteInt(out, static_cast<uint32_t>(blocks.size()));
+    for (auto& block : blocks)
+    {
+        WriteInt(out, block.startOffset);
+        WriteInt(out, block.endOffset);
+        WriteInt(out, block.type);
+        WriteInt(out, block.firstToken);
+        WriteInt(out, block.tokensCount);
+    }
+
+    WriteInt(out, static_cast<uint32_t>(tokens.size()));
+    for (auto& token : tokens)
+    {
+        WriteInt(out, token.startOffset);
+        WriteInt(out, token.endOffset);
+        WriteInt(out, token.type);
+    }
+
+    WriteInt(out, static_cast<uint8_t>(hasMetaBlock));
+    WriteInt(out, metadataLine);
+    WriteInt(out, metadataCol);
+}
+
+bool TemplateLayout::Deserialize(const char*& ptr, const char* end)
+{
+    if (!ReadInt(ptr, end, charSize) || !ReadInt(ptr, end, settingsFlags) || !ReadInt(ptr, end, sourceLength) || !ReadInt(ptr, end, sourceHash))
+        return false;
+
+    auto readLine = [&ptr, end](Line& line) {
+        ReadInt(ptr, end, line.startOffset);
+        ReadInt(ptr, end, line.endOffset);
+        ReadInt(ptr, end, line.lineNumber);
+    };
+    if (!ReadTable(ptr, end, sizeof(uint64_t) * 2 + sizeof(uint32_t), lines, readLine))
+        return false;
+
+    auto readBlock = [&ptr, end](Block& block) {
+        ReadInt(ptr, end, block.startOffset);
+        ReadInt(ptr, end, block.endOffset);
+        ReadInt(ptr, end, block.type);
+        ReadInt(ptr, end, block.firstToken);
+        ReadInt(ptr, end, block.tokensCount);
+    };
+    if (!ReadTable(ptr, end, sizeof(uint64_t) * 2 + sizeof(uint8_t) + sizeof(uint32_t) * 2, blocks, readBlock))
+        return false;
+
+    auto readToken = [&ptr, end](Token& token) {
+        ReadInt(ptr, end, token.startOffset);
+        ReadInt(ptr, end, token.endOffset);
+        ReadInt(ptr, end, token.type);
+    };
+    if (!ReadTable(ptr, end, sizeof(uint64_t) * 2 + sizeof(uint16_t), tokens, readToken))
+        return false;
+
+    uint8_t metaFlag = 0;
+    if (!ReadInt(ptr, end, metaFlag) || !ReadInt(ptr, end, metadataLine) || !ReadInt(ptr, end, metadataCol))
+        return false;
+    hasMetaBlock = metaFlag != 0;
+
+    return Validate();
+}
+
+bool TemplateLayout::Validate() const
+{
+    uint64_t prevEnd = 0;
+    for (size_t idx = 0; idx != lines.size(); ++ idx)
+    {
+        auto& line = lines[idx];
+        if (line.lineNumber != idx || line.startOffset < prevEnd || line.startOffset > line.endOffset || line.endOffset > sourceLength)
+            return false;
+        prevEnd = line.endOffset;
+    }
+
+    prevEnd = 0;
+    uint64_t nextToken = 0;
+    bool metaBlockFound = false;
+    for (auto& block : blocks)
+    {
+        if (block.type > MaxBlockType || block.startOffset < prevEnd || block.startOffset > block.endOffset || block.endOffset > sourceLength)
+            return false;
+        prevEnd = block.endOffset;
+        metaBlockFound |= block.type == MaxBlockType;
+
+        // Tokens of the blocks follow each other in the blocks order and lie within the block
+        if (block.tokensCount == 0)
+            continue;
+        if (block.firstToken != nextToken || tokens.size() - nextToken < block.tokensCount)
+            return false;
+        nextToken += block.tokensCount;
+
+        uint64_t prevTokenEnd = block.startOffset;
+        for (auto idx = block.firstToken; idx != nextToken; ++ idx)
+        {
+            auto& token = tokens[idx];
+            if (token.type > jinja2::Token::ExprEnd || token.startOffset < prevTokenEnd || token.startOffset > token.endOffset ||
+                token.endOffset > block.endOffset)
+                return false;
+            prevTokenEnd = token.endOffset;
+        }
+    }
+
+    return nextToken == tokens.size() && metaBlockFound == hasMetaBlock;
+}
+
+void WriteLayoutsFile(std::string& out, const NamedTemplateLayouts& layouts)
+{
+    out.append(FileSignature, sizeof(FileSignature));
+    WriteInt(out, TemplateLayout::FormatVersion);
+    WriteInt(out, static_cast<uint32_t>(layouts.size()));
+    for (auto& entry : layouts)
+    {
+        WriteInt(out, static_cast<uint32_t>(entry.first.size()));
+        out.append(entry.first);
+        entry.second->Serialize(out);
+    }
+}
+
+bool ReadLayoutsFile(const std::string& data, NamedTemplateLayouts& layouts)
+{
+    auto ptr = data.data();
+    auto end = ptr + data.size();
+    if (data.size() < sizeof(FileSignature) || !std::equal(FileSignature, FileSignature + sizeof(FileSignature), ptr))
+        return false;
+    ptr += sizeof(FileSignature);
+
+    uint32_t version = 0;
+    uint32_t count = 0;
+    if (!ReadInt(ptr, end, version) || version != TemplateLayout::FormatVersion || !ReadInt(ptr, end, count))
+        return false;
+
+    NamedTemplateLayouts result;
+    for (uint32_t idx = 0; idx != count; ++ idx)
+    {
+        uint32_t nameSize = 0;
+        if (!ReadInt(ptr, end, nameSize) || static_cast<size_t>(end - ptr) < nameSize)
+            return false;
+        std::string name(ptr, nameSize);
+        ptr += nameSize;
+
+        auto layout = std::make_shared<TemplateLayout>();
+        if (!layout->Deserialize(ptr, end))
+            return false;
+        result.emplace_back(std::move(name), std::move(layout));
+    }
+
+    if (ptr != end)
+        return false;
+
+    layouts = std::move(result);
+    return true;
+}
+} // jinja2
@@ -0,0 +1,99 @@
+#ifndef TEMPLATE_LAYOUT_H
+#define TEMPLATE_LAYOUT_H
+
+#include "xxhash64.h"
+
+#include <jinja2cpp/template_env.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace jinja2
+{
+// Result of the template tokenization: source lines table, the text blocks layout and the tokens of the expression and statement
+// blocks. Layout depends only on the template source and the blocks stripping settings, so it can be saved to the precompiled
+// templates file and reused instead of the rough parsing and lexing while the source isn't changed
+struct TemplateLayout
+{
+    static constexpr uint32_t FormatVersion = 2;
+    // Should match the last value of TemplateParser::TextBlockType
+    static constexpr uint8_t MaxBlockType = 6;
+
+    struct Line
+    {
+        uint64_t startOffset;
+        uint64_t endOffset;
+        uint32_t lineNumber;
+    };
+
+    // Tokens of the block are stored in the [firstToken, firstToken + tokensCount) range of the tokens table. Blocks which aren't
+    // lexed have no tokens
+    struct Block
+    {
+        uint64_t startOffset;
+        uint64_t endOffset;
+        uint8_t type;
+        uint32_t firstToken;
+        uint32_t tokensCount;
+    };
+
+    struct Token
+    {
+        uint64_t startOffset;
+        uint64_t endOffset;
+        uint16_t type;
+    };
+
+    uint8_t charSize = 0;
+    uint8_t settingsFlags = 0;
+    uint64_t sourceLength = 0;
+    uint64_t sourceHash = 0;
+    std::vector<Line> lines;
+    std::vector<Block> blocks;
+    std::vector<Token> tokens;
+    bool hasMetaBlock = false;
+    uint32_t metadataLine = 0;
+    uint32_t metadataCol = 0;
+
+    template<typename CharT>
+    static uint64_t HashSource(const std::basic_string<CharT>& source)
+    {
+        XxHash64 hash;
+        hash.Update(source.data(), source.size() * sizeof(CharT));
+        return hash.GetHash();
+    }
+
+    static uint8_t GetSettingsFlags(const Settings& settings)
+    {
+        return static_cast<uint8_t>((settings.trimBlocks ? 1 : 0) | (settings.lstripBlocks ? 2 : 0) | (settings.useLineStatements ? 4 : 0));
+    }
+
+    // Returns true if the layout is built for the same source with the same settings
+    template<typename CharT>
+    bool Matches(const std::basic_string<CharT>& source, const Settings& settings) const
+    {
+        return charSize == sizeof(CharT) && settingsFlags == GetSettingsFlags(settings) && sourceLength == source.size() &&
+            sourceHash == HashSource(source);
+    }
+
+    void Serialize(std::string& out) const;
+    // Returns false if the data is truncated or malformed, i.e. the tables aren't ordered, refer outside of the source or contain
+    // unknown block and token types
+    bool Deserialize(const char*& ptr, const char* end);
+
+private:
+    bool Validate() const;
+};
+
+using NamedTemplateLayouts = std::vector<std::pair<std::string, std::shared_ptr<const TemplateLayout>>>;
+
+// Precompiled templates file consists of the header (signature and format version) and the list of the named layouts
+void WriteLayoutsFile(std::string& out, const NamedTemplateLayouts& layouts);
+// Returns false if the file has unsupported format or is corrupted
+bool ReadLayoutsFile(const std::string& data, NamedTemplateLayouts& layouts);
+} // jinja2
+
+#endif // TEMPLATE_LAYOUT_H
@@ -0,0 +1,127 @@
+#ifndef TEMPLATE_NAMES_COLLECTOR_H
+#define TEMPLATE_NAMES_COLLECTOR_H
+
+#include "renderer.h"
+#include "statements.h"
+
+#include <string>
+#include <unordered_set>
+
+namespace jinja2
+{
+// Collects all names which can be assigned by the statements of the template, including the implicitly defined ones. Every assignment
+// statement adds the name once, so the count of the name is the number of the statements which assign it. Imports bind the listed names
+// only. Names assigned by the templates which are included with the context and by the parent templates aren't known at parse time, so
+// such templates are reported via AssignsAny
+class TemplateNamesCollector : public StatementVisitor
+{
+public:
+    using StatementVisitor::DoVisit;
+
+    explicit TemplateNamesCollector(std::unordered_multiset<std::string>& names)
+        : m_names(names)
+    {
+        m_names.insert({"loop", "caller", "self", "super", "kwargs", "varargs"});
+    }
+
+    void Collect(const RendererPtr& renderer)
+    {
+        auto stmt = dynamic_cast<VisitableStatement*>(renderer.get());
+        if (stmt)
+            Visit(stmt);
+    }
+
+    bool AssignsAny() const {return m_assignsAny;}
+
+    void DoVisit(ComposedRenderer* renderer) override
+    {
+        for (auto& r : renderer->GetRenderers())
+            Collect(r);
+    }
+
+    void DoVisit(IfStatement* stmt) override
+    {
+        Collect(stmt->GetMainBody());
+        for (auto& branch : stmt->GetElseBranches())
+            Collect(branch->GetMainBody());
+    }
+
+    void DoVisit(ForStatement* stmt) override
+    {
+        for (auto& v : stmt->GetVars())
+            m_names.insert(v);
+        Collect(stmt->GetMainBody());
+        Collect(stmt->GetElseBody());
+    }
+
+    void DoVisit(SetLineStatement* stmt) override { AddFields(stmt); }
+    void DoVisit(SetRawBlockStatement* stmt) override
+    {
+        AddFields(stmt);
+        Collect(stmt->GetBody());
+    }
+    void DoVisit(SetFilteredBlockStatement* stmt) override
+    {
+        AddFields(stmt);
+        Collect(stmt->GetBody());
+    }
+
+    void DoVisit(MacroStatement* stmt) override
+    {
+        m_names.insert(stmt->GetName());
+        AddParams(stmt);
+    }
+
+    void DoVisit(MacroCallStatement* stmt) override
+    {
+        AddParams(stmt);
+    }
+
+    void DoVisit(ParentBlockStatement* stmt) override { Collect(stmt->GetMainBody()); }
+    void DoVisit(BlockStatement* stmt) override { Collect(stmt->GetMainBody()); }
+    void DoVisit(FilterStatement* stmt) override { Collect(stmt->GetBody()); }
+
+    void DoVisit(WithStatement* stmt) override
+    {
+        for (auto& v : stmt->GetScopeVars())
+            m_names.insert(v.first);
+        Collect(stmt->GetMainBody());
+    }
+
+    void DoVisit(ImportStatement* stmt) override
+    {
+        if (stmt->GetNamespace())
+            m_names.insert(stmt->GetNamespace().value());
+        for (auto& name : stmt->GetNamesToImport())
+            m_names.insert(name.second);
+    }
+
+    void DoVisit(IncludeStatement* stmt) override
+    {
+        if (stmt->IsWithContext())
+            m_assignsAny = true;
+    }
+
+    void DoVisit(ExtendsStatement*) override { m_assignsAny = true; }
+
+private:
+    void AddFields(const SetStatement* stmt)
+    {
+        for (auto& f : stmt->GetFields())
+            m_names.insert(f);
+    }
+
+    void AddParams(MacroStatement* stmt)
+    {
+        for (auto& p : stmt->GetParams())
+            m_names.insert(p.paramName);
+        Collect(stmt->GetMainBody());
+    }
+
+private:
+    std::unordered_multiset<std::string>& m_names;
+    bool m_assignsAny = false;
+};
+} // jinja2
+
+#endif // TEMPLATE_NAMES_COLLECTOR_H
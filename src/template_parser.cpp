@@ -136,7 +136,7 @@ StatementsParser::ParseResult StatementsParser::ParseFor(LexScanner &lexer, Stat
     while (lexer.PeekNextToken() == Token::Identifier)
     {
         auto tok = lexer.NextToken();
-        vars.push_back(AsString(tok.value));
+        vars.push_back(lexer.GetAsString(tok));
         if (lexer.NextToken() != ',')
         {
             lexer.ReturnToken();
@@ -153,7 +153,6 @@ StatementsParser::ParseResult StatementsParser::ParseFor(LexScanner &lexer, Stat
         Token tok2 = tok1;
         tok2.type = Token::Identifier;
         tok2.range.endOffset = tok2.range.startOffset;
-        tok2.value = InternalValue();
         return MakeParseErrorTL(ErrorCode::ExpectedToken, tok1, tok2, Token::In, ',');
     }
 
@@ -310,7 +309,7 @@ StatementsParser::ParseResult StatementsParser::ParseSet(LexScanner& lexer, Stat
     while (lexer.PeekNextToken() == Token::Identifier)
     {
         auto tok = lexer.NextToken();
-        vars.push_back(AsString(tok.value));
+        vars.push_back(lexer.GetAsString(tok));
         if (lexer.NextToken() != ',')
         {
             lexer.ReturnToken();
@@ -387,7 +386,7 @@ StatementsParser::ParseResult StatementsParser::ParseBlock(LexScanner& lexer, St
     if (nextTok != Token::Identifier)
         return MakeParseError(ErrorCode::ExpectedIdentifier, nextTok);
 
-    std::string blockName = AsString(nextTok.value);
+    std::string blockName = lexer.GetAsString(nextTok);
 
     auto& info = statementsInfo.back();
     RendererPtr blockRenderer;
@@ -475,11 +474,10 @@ StatementsParser::ParseResult StatementsParser::ParseExtends(LexScanner& lexer,
         auto tok2 = tok;
         tok2.type = Token::Identifier;
         tok2.range.endOffset = tok2.range.startOffset;
-        tok2.value = EmptyValue{};
         return MakeParseErrorTL(ErrorCode::ExpectedToken, tok, tok2, Token::String);
     }
 
-    auto renderer = std::make_shared<ExtendsStatement>(AsString(tok.value), tok == Token::String);
+    auto renderer = std::make_shared<ExtendsStatement>(lexer.GetAsString(tok), tok == Token::String);
     statementsInfo.back().currentComposition->AddRenderer(renderer);
 
     StatementInfo statementInfo = StatementInfo::Create(StatementInfo::ExtendsStatement, stmtTok);
@@ -498,7 +496,7 @@ StatementsParser::ParseResult StatementsParser::ParseMacro(LexScanner& lexer, St
     if (nextTok != Token::Identifier)
         return MakeParseError(ErrorCode::ExpectedIdentifier, nextTok);
 
-    std::string macroName = AsString(nextTok.value);
+    std::string macroName = lexer.GetAsString(nextTok);
     MacroParams macroParams;
 
     if (lexer.EatIfEqual('('))
@@ -550,7 +548,7 @@ nonstd::expected<MacroParams, ParseError> StatementsParser::ParseMacroParams(Lex
         }
 
         MacroParam p;
-        p.paramName = AsString(name.value);
+        p.paramName = lexer.GetAsString(name);
         p.defaultValue = std::move(defVal);
         items.push_back(std::move(p));
 
@@ -610,7 +608,7 @@ StatementsParser::ParseResult StatementsParser::ParseCall(LexScanner& lexer, Sta
         return MakeParseError(ErrorCode::UnexpectedToken, tok, {tok1});
     }
 
-    std::string macroName = AsString(nextTok.value);
+    std::string macroName = lexer.GetAsString(nextTok);
 
     CallParamsInfo callParams;
     if (lexer.EatIfEqual('('))
@@ -758,7 +756,7 @@ StatementsParser::ParseResult StatementsParser::ParseImport(LexScanner& lexer, S
 
     auto renderer = std::make_shared<ImportStatement>(isWithContext);
     renderer->SetImportNameExpr(valueExpr);
-    renderer->SetNamespace(AsString(name.value));
+    renderer->SetNamespace(lexer.GetAsString(name));
     statementsInfo.back().currentComposition->AddRenderer(renderer);
 
     return ParseResult();
@@ -819,13 +817,13 @@ StatementsParser::ParseResult StatementsParser::ParseFrom(LexScanner& lexer, Sta
         if (!lexer.EatIfEqual(Token::Identifier, &nextTok))
             return MakeParseErrorTL(ErrorCode::ExpectedToken, nextTok, Token::Identifier);
 
-        macroMap.first = AsString(nextTok.value);
+        macroMap.first = lexer.GetAsString(nextTok);
 
         if (lexer.EatIfEqual(Keyword::As))
         {
             if (!lexer.EatIfEqual(Token::Identifier, &nextTok))
                 return MakeParseErrorTL(ErrorCode::ExpectedToken, nextTok, Token::Identifier);
-            macroMap.second = AsString(nextTok.value);
+            macroMap.second = lexer.GetAsString(nextTok);
         }
         else
         {
@@ -887,7 +885,7 @@ StatementsParser::ParseResult StatementsParser::ParseWith(LexScanner& lexer, Sta
             return expr.get_unexpected();
         auto valueExpr = *expr;
 
-        vars.emplace_back(AsString(nameTok.value), valueExpr);
+        vars.emplace_back(lexer.GetAsString(nameTok), valueExpr);
 
         if (!lexer.EatIfEqual(','))
             break;
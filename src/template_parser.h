@@ -8,6 +8,7 @@
 #include "lexertk.h"
 #include "renderer.h"
 #include "statements.h"
+#include "template_layout.h"
 #include "template_parser.h"
 #include "value_visitors.h"
 
@@ -16,10 +17,13 @@
 #include <jinja2cpp/template_env.h>
 #include <nonstd/expected.hpp>
 
+#include <algorithm>
+#include <iterator>
 #include <list>
-#include <regex>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace jinja2
@@ -27,12 +31,6 @@ namespace jinja2
 template<typename CharT>
 struct ParserTraits;
 
-struct KeywordsInfo
-{
-    MultiStringLiteral name;
-    Keyword type;
-};
-
 struct TokenStrInfo : MultiStringLiteral
 {
     template<typename CharT>
@@ -46,44 +44,79 @@ template<typename T = void>
 struct ParserTraitsBase
 {
     static Token::Type s_keywords[];
-    static KeywordsInfo s_keywordsInfo[41];
     static std::unordered_map<int, MultiStringLiteral> s_tokens;
-    static MultiStringLiteral s_regexp;
-};
-
-template<typename T>
-MultiStringLiteral ParserTraitsBase<T>::s_regexp = UNIVERSAL_STR(
-  R"((\{\{)|(\}\})|(\{%[\+\-]?\s+raw\s+[\+\-]?%\})|(\{%[\+\-]?\s+endraw\s+[\+\-]?%\})|(\{%\s+meta\s+%\})|(\{%\s+endmeta\s+%\})|(\{%)|(%\})|(\{#)|(#\})|(\n))");
 
-template<>
-struct ParserTraits<char> : public ParserTraitsBase<>
-{
-    static std::regex GetRoughTokenizer()
-    { return std::regex(s_regexp.GetValue<char>()); }
-    static std::regex GetKeywords()
+    // Keywords are grouped by the length, so the identifier is compared only with the few keywords of the same length
+    template<typename CharT>
+    static Keyword GetKeyword(const CharT* str, size_t length)
     {
-        std::string pattern;
-        std::string prefix("(^");
-        std::string postfix("$)");
-
-        bool isFirst = true;
-        for (auto& info : s_keywordsInfo)
+        struct KeywordInfo
         {
-            if (!isFirst)
-                pattern += "|";
-            else
-                isFirst = false;
+            const char* name;
+            Keyword type;
+        };
+
+        static const KeywordInfo keywords2[] = {
+            {"in", Keyword::In}, {"if", Keyword::If}, {"or", Keyword::LogicalOr}, {"is", Keyword::Is}, {"as", Keyword::As}, {"do", Keyword::Do}
+        };
+        static const KeywordInfo keywords3[] = {
+            {"for", Keyword::For}, {"and", Keyword::LogicalAnd}, {"not", Keyword::LogicalNot}, {"set", Keyword::Set}
+        };
+        static const KeywordInfo keywords4[] = {
+            {"else", Keyword::Else}, {"elif", Keyword::ElIf}, {"call", Keyword::Call}, {"true", Keyword::True}, {"True", Keyword::True},
+            {"none", Keyword::None}, {"None", Keyword::None}, {"with", Keyword::With}, {"from", Keyword::From}
+        };
+        static const KeywordInfo keywords5[] = {
+            {"endif", Keyword::EndIf}, {"block", Keyword::Block}, {"macro", Keyword::Macro}, {"false", Keyword::False}, {"False", Keyword::False}
+        };
+        static const KeywordInfo keywords6[] = {
+            {"endfor", Keyword::Endfor}, {"filter", Keyword::Filter}, {"endset", Keyword::EndSet}, {"import", Keyword::Import},
+            {"scoped", Keyword::Scoped}, {"ignore", Keyword::Ignore}
+        };
+        static const KeywordInfo keywords7[] = {
+            {"extends", Keyword::Extends}, {"endcall", Keyword::EndCall}, {"include", Keyword::Include}, {"endwith", Keyword::EndWith},
+            {"without", Keyword::Without}, {"missing", Keyword::Missing}, {"context", Keyword::Context}
+        };
+        static const KeywordInfo keywords8[] = {
+            {"endblock", Keyword::EndBlock}, {"endmacro", Keyword::EndMacro}
+        };
+        static const KeywordInfo keywords9[] = {
+            {"endfilter", Keyword::EndFilter}, {"recursive", Keyword::Recursive}
+        };
+
+        const KeywordInfo* first = nullptr;
+        const KeywordInfo* last = nullptr;
+        switch (length)
+        {
+        case 2: first = std::begin(keywords2); last = std::end(keywords2); break;
+        case 3: first = std::begin(keywords3); last = std::end(keywords3); break;
+        case 4: first = std::begin(keywords4); last = std::end(keywords4); break;
+        case 5: first = std::begin(keywords5); last = std::end(keywords5); break;
+        case 6: first = std::begin(keywords6); last = std::end(keywords6); break;
+        case 7: first = std::begin(keywords7); last = std::end(keywords7); break;
+        case 8: first = std::begin(keywords8); last = std::end(keywords8); break;
+        case 9: first = std::begin(keywords9); last = std::end(keywords9); break;
+        default: return Keyword::Unknown;
+        }
 
-            pattern += prefix + info.name.charValue + postfix;
+        for (; first != last; ++ first)
+        {
+            if (std::equal(str, str + length, first->name))
+                return first->type;
         }
-        return std::regex(pattern);
+        return Keyword::Unknown;
     }
+};
+
+template<>
+struct ParserTraits<char> : public ParserTraitsBase<>
+{
     static std::string GetAsString(const std::string& str, CharRange range) { return str.substr(range.startOffset, range.size()); }
     static InternalValue RangeToNum(const std::string& str, CharRange range, Token::Type hint)
     {
-        char buff[std::max(std::numeric_limits<int64_t>::max_digits10, std::numeric_limits<double>::max_digits10) * 2 + 1];
-        std::copy(str.data() + range.startOffset, str.data() + range.endOffset, buff);
-        buff[range.size()] = 0;
+        // Length of the number token isn't limited (and its range may come from the precompiled layout), so it isn't copied to the fixed buffer
+        auto numStr = str.substr(range.startOffset, range.size());
+        auto buff = numStr.c_str();
         InternalValue result;
         if (hint == Token::IntegerNum)
         {
@@ -109,26 +142,6 @@ struct ParserTraits<char> : public ParserTraitsBase<>
 template<>
 struct ParserTraits<wchar_t> : public ParserTraitsBase<>
 {
-    static std::wregex GetRoughTokenizer()
-    { return std::wregex(s_regexp.GetValue<wchar_t>()); }
-    static std::wregex GetKeywords()
-    {
-        std::wstring pattern;
-        std::wstring prefix(L"(^");
-        std::wstring postfix(L"$)");
-
-        bool isFirst = true;
-        for (auto& info : s_keywordsInfo)
-        {
-            if (!isFirst)
-                pattern += L"|";
-            else
-                isFirst = false;
-
-            pattern += prefix + info.name.wcharValue + postfix;
-        }
-        return std::wregex(pattern);
-    }
     static std::string GetAsString(const std::wstring& str, CharRange range)
     {
         auto srcStr = str.substr(range.startOffset, range.size());
@@ -136,9 +149,9 @@ struct ParserTraits<wchar_t> : public ParserTraitsBase<>
     }
     static InternalValue RangeToNum(const std::wstring& str, CharRange range, Token::Type hint)
     {
-        wchar_t buff[std::max(std::numeric_limits<int64_t>::max_digits10, std::numeric_limits<double>::max_digits10) * 2 + 1];
-        std::copy(str.data() + range.startOffset, str.data() + range.endOffset, buff);
-        buff[range.size()] = 0;
+        // Length of the number token isn't limited (and its range may come from the precompiled layout), so it isn't copied to the fixed buffer
+        auto numStr = str.substr(range.startOffset, range.size());
+        auto buff = numStr.c_str();
         InternalValue result;
         if (hint == Token::IntegerNum)
         {
@@ -248,7 +261,6 @@ class TemplateParser : public LexerHelper
 public:
     using string_t = std::basic_string<CharT>;
     using traits_t = ParserTraits<CharT>;
-    using sregex_iterator = std::regex_iterator<typename string_t::const_iterator>;
     using ErrorInfo = ErrorInfoTpl<CharT>;
     using ParseResult = nonstd::expected<RendererPtr, std::vector<ErrorInfo>>;
 
@@ -257,19 +269,25 @@ public:
         , m_templateName(std::move(tplName))
         , m_settings(setts)
         , m_env(env)
-        , m_roughTokenizer(traits_t::GetRoughTokenizer())
-        , m_keywords(traits_t::GetKeywords())
         , m_metadataType(setts.m_defaultMetadataType)
     {
     }
 
-    ParseResult Parse()
+    // Precompiled layout (if provided) should match the template source, see TemplateLayout::Matches
+    ParseResult Parse(const TemplateLayout* layout = nullptr)
     {
-        auto roughResult = DoRoughParsing();
-
-        if (!roughResult)
+        if (layout)
+        {
+            ImportLayout(*layout);
+        }
+        else
         {
-            return ParseErrorsToErrorInfo(roughResult.error());
+            auto roughResult = DoRoughParsing();
+
+            if (!roughResult)
+            {
+                return ParseErrorsToErrorInfo(roughResult.error());
+            }
         }
 
         auto composeRenderer = std::make_shared<ComposedRenderer>();
@@ -281,6 +299,41 @@ public:
         return composeRenderer;
     }
 
+    // Returns nullptr if the template can't be tokenized
+    std::shared_ptr<TemplateLayout> BuildLayout()
+    {
+        if (!DoRoughParsing())
+            return nullptr;
+
+        auto layout = std::make_shared<TemplateLayout>();
+        layout->charSize = sizeof(CharT);
+        layout->settingsFlags = TemplateLayout::GetSettingsFlags(m_settings);
+        layout->sourceLength = m_template->size();
+        layout->sourceHash = TemplateLayout::HashSource(*m_template);
+        layout->lines.reserve(m_lines.size());
+        for (auto& line : m_lines)
+            layout->lines.push_back(TemplateLayout::Line{line.range.startOffset, line.range.endOffset, line.lineNumber});
+        layout->blocks.reserve(m_textBlocks.size());
+        Lexer::TokensList tokens;
+        for (auto& block : m_textBlocks)
+        {
+            uint32_t firstToken = static_cast<uint32_t>(layout->tokens.size());
+            tokens.clear();
+            if (IsLexedBlock(block.type) && Tokenize(AdjustBlock(block), tokens))
+            {
+                for (auto& tok : tokens)
+                    layout->tokens.push_back(TemplateLayout::Token{tok.range.startOffset, tok.range.endOffset, static_cast<uint16_t>(tok.type)});
+            }
+            auto tokensCount = static_cast<uint32_t>(layout->tokens.size() - firstToken);
+            layout->blocks.push_back(TemplateLayout::Block{block.range.startOffset, block.range.endOffset, static_cast<uint8_t>(block.type),
+                                                           tokensCount ? firstToken : 0, tokensCount});
+        }
+        layout->hasMetaBlock = m_hasMetaBlock;
+        layout->metadataLine = m_metadataLocation.line;
+        layout->metadataCol = m_metadataLocation.col;
+        return layout;
+    }
+
     MetadataInfo<CharT> GetMetadataInfo() const
     {
         MetadataInfo<CharT> result;
@@ -290,6 +343,9 @@ public:
         return result;
     }
 
+    // Pool which keeps the text of the parsed renderers which isn't the part of the template source
+    auto& GetTextPool() const {return m_textPool;}
+
 private:
     enum {
         RM_Unknown = 0,
@@ -306,30 +362,306 @@ private:
         RM_NewLine
     };
 
+    struct RoughMatch
+    {
+        unsigned type;
+        size_t position;
+        size_t length;
+    };
+
+    // Finds the delimiters of the template blocks and the line ends. Delimiters are recognized the same way as by the regular expression
+    // `(\{\{)|(\}\})|(\{%[+-]?\s+raw\s+[+-]?%\})|(\{%[+-]?\s+endraw\s+[+-]?%\})|(\{%\s+meta\s+%\})|(\{%\s+endmeta\s+%\})|(\{%)|(%\})|(\{#)|(#\})|(\n)`,
+    // i.e. the leftmost delimiter wins and the search continues after its end. Every delimiter either starts with `{` or `\n`, or ends
+    // with `}`, so the plain text runs are skipped by the memchr-like search of these characters. Found positions are kept until the
+    // scanning passes them, so the source is searched for every character once
+    class RoughScanner
+    {
+    public:
+        explicit RoughScanner(const string_t& tpl)
+            : m_begin(tpl.data())
+            , m_end(tpl.data() + tpl.size())
+            , m_cur(tpl.data())
+            , m_nextOpen(Find('{'))
+            , m_nextClose(Find('}'))
+            , m_nextNewLine(Find('\n'))
+        {
+        }
+
+        // Returns false if there are no more delimiters
+        bool Next(RoughMatch& match)
+        {
+            while (m_cur != m_end)
+            {
+                auto open = FindNext(m_nextOpen, '{');
+                auto close = FindNext(m_nextClose, '}');
+                auto newLine = FindNext(m_nextNewLine, '\n');
+                // `}` is the first one after the current position, so the closing delimiter starts either at it or right before it
+                if (close != m_end && close != m_cur && (close[-1] == '%' || close[-1] == '#'))
+                    -- close;
+
+                auto pos = std::min({open, close, newLine});
+                if (pos == m_end)
+                    break;
+
+                size_t length = 0;
+                match.type = MatchAt(pos, length);
+                if (match.type == RM_Unknown)
+                {
+                    m_cur = pos + 1;
+                    continue;
+                }
+
+                match.position = static_cast<size_t>(pos - m_begin);
+                match.length = length;
+                m_cur = pos + length;
+                return true;
+            }
+            m_cur = m_end;
+            return false;
+        }
+
+    private:
+        unsigned MatchAt(const CharT* pos, size_t& length) const
+        {
+            length = 1;
+            if (*pos == '\n')
+                return RM_NewLine;
+
+            if (pos + 1 == m_end)
+                return RM_Unknown;
+
+            length = 2;
+            auto next = pos[1];
+            switch (*pos)
+            {
+            case '{':
+                if (next == '{')
+                    return RM_ExprBegin;
+                if (next == '#')
+                    return RM_CommentBegin;
+                if (next == '%')
+                    return MatchStmtBegin(pos, length);
+                break;
+            case '}':
+                if (next == '}')
+                    return RM_ExprEnd;
+                break;
+            case '%':
+                if (next == '}')
+                    return RM_StmtEnd;
+                break;
+            case '#':
+                if (next == '}')
+                    return RM_CommentEnd;
+                break;
+            }
+            return RM_Unknown;
+        }
+
+        // `pos` points to the `{%` delimiter. Checks whether it starts the raw or meta block tag
+        unsigned MatchStmtBegin(const CharT* pos, size_t& length) const
+        {
+            auto tagEnd = MatchSpecialTag(pos + 2, true, "raw");
+            if (tagEnd)
+            {
+                length = static_cast<size_t>(tagEnd - pos);
+                return RM_RawBegin;
+            }
+            tagEnd = MatchSpecialTag(pos + 2, true, "endraw");
+            if (tagEnd)
+            {
+                length = static_cast<size_t>(tagEnd - pos);
+                return RM_RawEnd;
+            }
+            tagEnd = MatchSpecialTag(pos + 2, false, "meta");
+            if (tagEnd)
+            {
+                length = static_cast<size_t>(tagEnd - pos);
+                return RM_MetaBegin;
+            }
+            tagEnd = MatchSpecialTag(pos + 2, false, "endmeta");
+            if (tagEnd)
+            {
+                length = static_cast<size_t>(tagEnd - pos);
+                return RM_MetaEnd;
+            }
+            length = 2;
+            return RM_StmtBegin;
+        }
+
+        // Matches `[+-]?\s+name\s+[+-]?%}` (control chars are allowed only if `withControl` is true). Returns the end of the tag or nullptr
+        const CharT* MatchSpecialTag(const CharT* pos, bool withControl, const char* name) const
+        {
+            if (withControl && pos != m_end && (*pos == '+' || *pos == '-'))
+                ++ pos;
+
+            auto p = SkipSpaces(pos);
+            if (p == pos)
+                return nullptr;
+
+            for (; *name; ++ name, ++ p)
+            {
+                if (p == m_end || *p != *name)
+                    return nullptr;
+            }
+
+            pos = p;
+            p = SkipSpaces(pos);
+            if (p == pos)
+                return nullptr;
+
+            if (withControl && p != m_end && (*p == '+' || *p == '-'))
+                ++ p;
+
+            if (m_end - p < 2 || p[0] != '%' || p[1] != '}')
+                return nullptr;
+
+            return p + 2;
+        }
+
+        const CharT* SkipSpaces(const CharT* pos) const
+        {
+            for (; pos != m_end; ++ pos)
+            {
+                auto ch = *pos;
+                if (ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r' && ch != '\v' && ch != '\f')
+                    break;
+            }
+            return pos;
+        }
+
+        // Returns the end of the source if the character isn't found
+        const CharT* Find(CharT ch) const
+        {
+            auto found = std::char_traits<CharT>::find(m_cur, static_cast<size_t>(m_end - m_cur), ch);
+            return found != nullptr ? found : m_end;
+        }
+
+        const CharT* FindNext(const CharT*& next, CharT ch) const
+        {
+            if (next < m_cur)
+                next = Find(ch);
+            return next;
+        }
+
+    private:
+        const CharT* m_begin;
+        const CharT* m_end;
+        const CharT* m_cur;
+        const CharT* m_nextOpen;
+        const CharT* m_nextClose;
+        const CharT* m_nextNewLine;
+    };
+
     struct LineInfo
     {
         CharRange range;
         unsigned lineNumber;
     };
 
+    struct NameHash
+    {
+        size_t operator()(const nonstd::basic_string_view<CharT>& name) const
+        {
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ULL;
+            for (auto ch : name)
+            {
+                hash ^= static_cast<uint64_t>(ch);
+                hash *= 1099511628211ULL;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
+
     enum class TextBlockType { RawText, Expression, Statement, Comment, LineStatement, RawBlock, MetaBlock };
+    static_assert(static_cast<uint8_t>(TextBlockType::MetaBlock) == TemplateLayout::MaxBlockType, "Layout block types are out of sync");
 
+    // Tokens of the block are taken from m_layoutTokens if they are imported with the precompiled layout
     struct TextBlockInfo
     {
         CharRange range;
         TextBlockType type;
+        size_t firstToken = 0;
+        size_t tokensCount = 0;
     };
 
+    // Consecutive static text pieces (separated by comments, raw blocks or stripped whitespaces) are merged into the single renderer.
+    // Adjacent pieces are referred within the template source, others are copied into the owned buffer
+    class PendingText
+    {
+    public:
+        void Add(const CharT* ptr, size_t length)
+        {
+            if (m_length == 0 && m_text.empty())
+            {
+                m_ptr = ptr;
+                m_length = length;
+            }
+            else if (m_text.empty() && m_ptr + m_length == ptr)
+            {
+                m_length += length;
+            }
+            else
+            {
+                if (m_text.empty())
+                    m_text.assign(m_ptr, m_length);
+                m_text.append(ptr, length);
+            }
+        }
+
+        void Flush(ComposedRenderer& composition, const std::shared_ptr<OwnedTextPool<CharT>>& textPool)
+        {
+            if (!m_text.empty())
+                composition.AddRenderer(std::make_shared<OwnedTextRenderer<CharT>>(textPool, std::move(m_text)));
+            else if (m_length != 0)
+                composition.AddRenderer(std::make_shared<RawTextRenderer>(m_ptr, m_length));
+
+            m_text.clear();
+            m_ptr = nullptr;
+            m_length = 0;
+        }
+
+    private:
+        const CharT* m_ptr = nullptr;
+        size_t m_length = 0;
+        std::basic_string<CharT> m_text;
+    };
+
+    void ImportLayout(const TemplateLayout& layout)
+    {
+        m_lines.reserve(layout.lines.size());
+        for (auto& line : layout.lines)
+            m_lines.push_back(LineInfo{CharRange{static_cast<size_t>(line.startOffset), static_cast<size_t>(line.endOffset)}, line.lineNumber});
+        m_textBlocks.reserve(layout.blocks.size());
+        for (auto& block : layout.blocks)
+        {
+            m_textBlocks.push_back(TextBlockInfo{CharRange{static_cast<size_t>(block.startOffset), static_cast<size_t>(block.endOffset)},
+                                                 static_cast<TextBlockType>(block.type), block.firstToken, block.tokensCount});
+        }
+        m_layoutTokens.reserve(layout.tokens.size());
+        for (auto& token : layout.tokens)
+        {
+            m_layoutTokens.push_back(
+              MakeToken(static_cast<Token::Type>(token.type), {static_cast<size_t>(token.startOffset), static_cast<size_t>(token.endOffset)}));
+        }
+        m_hasMetaBlock = layout.hasMetaBlock;
+        if (m_hasMetaBlock)
+        {
+            m_metadataLocation.line = layout.metadataLine;
+            m_metadataLocation.col = layout.metadataCol;
+            m_metadataLocation.fileName = m_templateName;
+        }
+    }
+
     nonstd::expected<void, std::vector<ParseError>> DoRoughParsing()
     {
         std::vector<ParseError> foundErrors;
 
-        auto matchBegin = sregex_iterator(m_template->begin(), m_template->end(), m_roughTokenizer);
-        auto matchEnd = sregex_iterator();
-
-        auto matches = std::distance(matchBegin, matchEnd);
+        RoughScanner scanner(*m_template);
+        RoughMatch match;
         // One line, no customization
-        if (matches == 0)
+        if (!scanner.Next(match))
         {
             CharRange range{ 0ULL, m_template->size() };
             m_lines.push_back(LineInfo{ range, 0 });
@@ -348,13 +680,13 @@ private:
             m_currentBlockInfo.type = TextBlockType::RawText;
         do
         {
-            auto result = ParseRoughMatch(matchBegin, matchEnd);
+            auto result = ParseRoughMatch(match);
             if (!result)
             {
                 foundErrors.push_back(result.error());
                 return nonstd::make_unexpected(std::move(foundErrors));
             }
-        } while (matchBegin != matchEnd);
+        } while (scanner.Next(match));
         FinishCurrentLine(m_template->size());
 
         if (m_currentBlockInfo.type == TextBlockType::RawBlock)
@@ -378,26 +710,14 @@ private:
             return nonstd::make_unexpected(std::move(foundErrors));
         return nonstd::expected<void, std::vector<ParseError>>();
     }
-    nonstd::expected<void, ParseError> ParseRoughMatch(sregex_iterator& curMatch, const sregex_iterator& /*endMatch*/)
+    nonstd::expected<void, ParseError> ParseRoughMatch(const RoughMatch& match)
     {
-        auto match = *curMatch;
-        ++curMatch;
-        unsigned matchType = RM_Unknown;
-        for (unsigned idx = 1; idx != match.size(); ++idx)
-        {
-            if (match.length(idx) != 0)
-            {
-                matchType = idx;
-                break;
-            }
-        }
-
-        size_t matchStart = static_cast<size_t>(match.position());
+        size_t matchStart = match.position;
 
-        switch (matchType)
+        switch (match.type)
         {
             case RM_NewLine:
-                FinishCurrentLine(match.position());
+                FinishCurrentLine(match.position);
                 m_currentLineInfo.range.startOffset = m_currentLineInfo.range.endOffset + 1;
                 if (m_currentLineInfo.range.startOffset < m_template->size() &&
                     (m_currentBlockInfo.type == TextBlockType::RawText || m_currentBlockInfo.type == TextBlockType::LineStatement))
@@ -420,7 +740,7 @@ private:
                     break;
                 if (m_currentBlockInfo.type != TextBlockType::RawText)
                 {
-                    FinishCurrentLine(match.position() + 2);
+                    FinishCurrentLine(match.position + 2);
                     return MakeParseError(ErrorCode::UnexpectedCommentBegin, MakeToken(Token::CommentBegin, { matchStart, matchStart + 2 }));
                 }
 
@@ -434,7 +754,7 @@ private:
                     break;
                 if (m_currentBlockInfo.type != TextBlockType::Comment)
                 {
-                    FinishCurrentLine(match.position() + 2);
+                    FinishCurrentLine(match.position + 2);
                     return MakeParseError(ErrorCode::UnexpectedCommentEnd, MakeToken(Token::CommentEnd, { matchStart, matchStart + 2 }));
                 }
                 
@@ -446,10 +766,10 @@ private:
             case RM_ExprEnd:
                 if (m_currentBlockInfo.type == TextBlockType::RawText)
                 {
-                    FinishCurrentLine(match.position() + 2);
+                    FinishCurrentLine(match.position + 2);
                     return MakeParseError(ErrorCode::UnexpectedExprEnd, MakeToken(Token::ExprEnd, { matchStart, matchStart + 2 }));
                 }
-                else if (m_currentBlockInfo.type != TextBlockType::Expression || (*m_template)[match.position() - 1] == '\'')
+                else if (m_currentBlockInfo.type != TextBlockType::Expression || (*m_template)[match.position - 1] == '\'')
                     break;
 
                 m_currentBlockInfo.range.startOffset = FinishCurrentBlock(matchStart, TextBlockType::RawText);
@@ -460,10 +780,10 @@ private:
             case RM_StmtEnd:
                 if (m_currentBlockInfo.type == TextBlockType::RawText)
                 {
-                    FinishCurrentLine(match.position() + 2);
+                    FinishCurrentLine(match.position + 2);
                     return MakeParseError(ErrorCode::UnexpectedStmtEnd, MakeToken(Token::StmtEnd, { matchStart, matchStart + 2 }));
                 }
-                else if (m_currentBlockInfo.type != TextBlockType::Statement || (*m_template)[match.position() - 1] == '\'')
+                else if (m_currentBlockInfo.type != TextBlockType::Statement || (*m_template)[match.position - 1] == '\'')
                     break;
 
                 m_currentBlockInfo.range.startOffset = FinishCurrentBlock(matchStart, TextBlockType::RawText);
@@ -473,32 +793,32 @@ private:
                     break;
                 else if (m_currentBlockInfo.type != TextBlockType::RawText && m_currentBlockInfo.type != TextBlockType::Comment)
                 {
-                    FinishCurrentLine(match.position() + match.length());
-                    return MakeParseError(ErrorCode::UnexpectedRawBegin, MakeToken(Token::RawBegin, { matchStart, matchStart + match.length() }));
+                    FinishCurrentLine(match.position + match.length);
+                    return MakeParseError(ErrorCode::UnexpectedRawBegin, MakeToken(Token::RawBegin, { matchStart, matchStart + match.length }));
                 }
-                StartControlBlock(TextBlockType::RawBlock, matchStart, matchStart + match.length());
+                StartControlBlock(TextBlockType::RawBlock, matchStart, matchStart + match.length);
                 break;
             case RM_RawEnd:
                 if (m_currentBlockInfo.type == TextBlockType::Comment)
                     break;
                 else if (m_currentBlockInfo.type != TextBlockType::RawBlock)
                 {
-                    FinishCurrentLine(match.position() + match.length());
-                    return MakeParseError(ErrorCode::UnexpectedRawEnd, MakeToken(Token::RawEnd, { matchStart, matchStart + match.length() }));
+                    FinishCurrentLine(match.position + match.length);
+                    return MakeParseError(ErrorCode::UnexpectedRawEnd, MakeToken(Token::RawEnd, { matchStart, matchStart + match.length }));
                 }
-                m_currentBlockInfo.range.startOffset = FinishCurrentBlock(matchStart + match.length() - 2, TextBlockType::RawText, matchStart);
+                m_currentBlockInfo.range.startOffset = FinishCurrentBlock(matchStart + match.length - 2, TextBlockType::RawText, matchStart);
                 break;
             case RM_MetaBegin:
                 if (m_currentBlockInfo.type == TextBlockType::Comment)
                     break;
                 if ((m_currentBlockInfo.type != TextBlockType::RawText && m_currentBlockInfo.type != TextBlockType::Comment) || m_hasMetaBlock)
                 {
-                    FinishCurrentLine(match.position() + match.length());
-                    return MakeParseError(ErrorCode::UnexpectedMetaBegin, MakeToken(Token::MetaBegin, { matchStart, matchStart + match.length() }));
+                    FinishCurrentLine(match.position + match.length);
+                    return MakeParseError(ErrorCode::UnexpectedMetaBegin, MakeToken(Token::MetaBegin, { matchStart, matchStart + match.length }));
                 }
-                StartControlBlock(TextBlockType::MetaBlock, matchStart, matchStart + match.length());
+                StartControlBlock(TextBlockType::MetaBlock, matchStart, matchStart + match.length);
                 m_metadataLocation.line = m_currentLineInfo.lineNumber + 1;
-                m_metadataLocation.col = static_cast<unsigned>(match.position() - m_currentLineInfo.range.startOffset + 1);
+                m_metadataLocation.col = static_cast<unsigned>(match.position - m_currentLineInfo.range.startOffset + 1);
                 m_metadataLocation.fileName = m_templateName;
                 break;
             case RM_MetaEnd:
@@ -506,10 +826,10 @@ private:
                     break;
                 if (m_currentBlockInfo.type != TextBlockType::MetaBlock)
                 {
-                    FinishCurrentLine(match.position() + match.length());
-                    return MakeParseError(ErrorCode::UnexpectedMetaEnd, MakeToken(Token::MetaEnd, { matchStart, matchStart + match.length() }));
+                    FinishCurrentLine(match.position + match.length);
+                    return MakeParseError(ErrorCode::UnexpectedMetaEnd, MakeToken(Token::MetaEnd, { matchStart, matchStart + match.length }));
                 }
-                m_currentBlockInfo.range.startOffset = FinishCurrentBlock(matchStart + match.length() - 2, TextBlockType::MetaBlock, matchStart);
+                m_currentBlockInfo.range.startOffset = FinishCurrentBlock(matchStart + match.length - 2, TextBlockType::MetaBlock, matchStart);
                 m_hasMetaBlock = true;
                 break;
         }
@@ -619,11 +939,10 @@ private:
         StatementInfoList statementsStack;
         StatementInfo root = StatementInfo::Create(StatementInfo::TemplateRoot, Token(), renderers);
         statementsStack.push_back(root);
+        PendingText pendingText;
         for (auto& origBlock : m_textBlocks)
         {
-            auto block = origBlock;
-            if (block.type == TextBlockType::LineStatement)
-                ++block.range.startOffset;
+            auto block = AdjustBlock(origBlock);
 
             switch (block.type)
             {
@@ -633,8 +952,7 @@ private:
                     auto range = block.range;
                     if (range.size() == 0)
                         break;
-                    auto renderer = std::make_shared<RawTextRenderer>(m_template->data() + range.startOffset, range.size());
-                    statementsStack.back().currentComposition->AddRenderer(renderer);
+                    pendingText.Add(m_template->data() + range.startOffset, range.size());
                     break;
                 }
                 case TextBlockType::MetaBlock:
@@ -649,6 +967,7 @@ private:
                 }
                 case TextBlockType::Expression:
                 {
+                    pendingText.Flush(*statementsStack.back().currentComposition, m_textPool);
                     auto parseResult = InvokeParser<RendererPtr, ExpressionParser>(block);
                     if (parseResult)
                         statementsStack.back().currentComposition->AddRenderer(*parseResult);
@@ -659,6 +978,7 @@ private:
                 case TextBlockType::Statement:
                 case TextBlockType::LineStatement:
                 {
+                    pendingText.Flush(*statementsStack.back().currentComposition, m_textPool);
                     auto parseResult = InvokeParser<void, StatementsParser>(block, statementsStack);
                     if (!parseResult)
                         errors.push_back(parseResult.error());
@@ -668,20 +988,34 @@ private:
                     break;
             }
         }
+        pendingText.Flush(*statementsStack.back().currentComposition, m_textPool);
 
         if (!errors.empty())
             return nonstd::make_unexpected(std::move(errors));
 
         return nonstd::expected<void, std::vector<ParseError>>();
     }
-    template<typename R, typename P, typename... Args>
-    nonstd::expected<R, ParseError> InvokeParser(const TextBlockInfo& block, Args&&... args)
+    static bool IsLexedBlock(TextBlockType type)
+    {
+        return type == TextBlockType::Expression || type == TextBlockType::Statement || type == TextBlockType::LineStatement;
+    }
+
+    // Line statement block starts with the '#' sign which isn't the part of the statement
+    static TextBlockInfo AdjustBlock(const TextBlockInfo& block)
+    {
+        auto result = block;
+        if (result.type == TextBlockType::LineStatement)
+            ++result.range.startOffset;
+        return result;
+    }
+
+    bool Tokenize(const TextBlockInfo& block, Lexer::TokensList& tokens)
     {
         lexertk::generator<CharT> tokenizer;
         auto range = block.range;
         auto start = m_template->data();
         if (!tokenizer.process(start + range.startOffset, start + range.endOffset))
-            return MakeParseError(ErrorCode::Unspecified, MakeToken(Token::Unknown, { range.startOffset, range.startOffset + 1 }));
+            return false;
 
         tokenizer.begin();
         Lexer lexer(
@@ -693,8 +1027,28 @@ private:
           this);
 
         if (!lexer.Preprocess())
+            return false;
+
+        tokens = lexer.GetTokens();
+        return true;
+    }
+
+    template<typename R, typename P, typename... Args>
+    nonstd::expected<R, ParseError> InvokeParser(const TextBlockInfo& block, Args&&... args)
+    {
+        auto range = block.range;
+        Lexer::TokensList tokens;
+        if (block.tokensCount != 0)
+        {
+            auto first = m_layoutTokens.begin() + block.firstToken;
+            tokens.assign(first, first + block.tokensCount);
+        }
+        else if (!Tokenize(block, tokens))
+        {
             return MakeParseError(ErrorCode::Unspecified, MakeToken(Token::Unknown, { range.startOffset, range.startOffset + 1 }));
+        }
 
+        Lexer lexer(std::move(tokens), this);
         P praser(m_settings, m_env);
         LexScanner scanner(lexer);
         auto result = praser.Parse(scanner, std::forward<Args>(args)...);
@@ -734,12 +1088,11 @@ private:
         return nonstd::make_unexpected(std::move(resultErrors));
     }
 
-    Token MakeToken(Token::Type type, const CharRange& range, string_t value = string_t())
+    Token MakeToken(Token::Type type, const CharRange& range)
     {
         Token tok;
         tok.type = type;
         tok.range = range;
-        tok.value = TargetString(static_cast<string_t>(value));
 
         return tok;
     }
@@ -753,15 +1106,7 @@ private:
         if (tok.range.size() != 0)
             return m_template->substr(tok.range.startOffset, tok.range.size());
         else if (tok.type == Token::Identifier)
-        {
-            if (!tok.value.IsEmpty())
-            {
-                std::basic_string<CharT> tpl;
-                return GetAsSameString(tpl, tok.value).value_or(std::basic_string<CharT>());
-            }
-
             return UNIVERSAL_STR("<<Identifier>>").template GetValue<CharT>();
-        }
         else if (tok.type == Token::String)
             return UNIVERSAL_STR("<<String>>").template GetValue<CharT>();
 
@@ -885,7 +1230,14 @@ private:
     }
 
     // LexerHelper interface
-    std::string GetAsString(const CharRange& range) override { return traits_t::GetAsString(*m_template, range); }
+    const std::string& GetAsString(const CharRange& range) override
+    {
+        auto name = nonstd::basic_string_view<CharT>(m_template->data() + range.startOffset, range.size());
+        auto p = m_names.find(name);
+        if (p == m_names.end())
+            p = m_names.emplace(name, traits_t::GetAsString(*m_template, range)).first;
+        return p->second;
+    }
     InternalValue GetAsValue(const CharRange& range, Token::Type type) override
     {
         if (type == Token::String)
@@ -899,24 +1251,7 @@ private:
     }
     Keyword GetKeyword(const CharRange& range) override
     {
-        auto matchBegin = sregex_iterator(m_template->begin() + range.startOffset, m_template->begin() + range.endOffset, m_keywords);
-        auto matchEnd = sregex_iterator();
-
-        auto matches = std::distance(matchBegin, matchEnd);
-        // One line, no customization
-        if (matches == 0)
-            return Keyword::Unknown;
-
-        auto& match = *matchBegin;
-        for (size_t idx = 1; idx != match.size(); ++idx)
-        {
-            if (match.length(idx) != 0)
-            {
-                return traits_t::s_keywordsInfo[idx - 1].type;
-            }
-        }
-
-        return Keyword::Unknown;
+        return traits_t::GetKeyword(m_template->data() + range.startOffset, range.size());
     }
     char GetCharAt(size_t /*pos*/) override { return '\0'; }
 
@@ -925,61 +1260,18 @@ private:
     std::string m_templateName;
     const Settings& m_settings;
     TemplateEnv* m_env = nullptr;
-    std::basic_regex<CharT> m_roughTokenizer;
-    std::basic_regex<CharT> m_keywords;
     std::vector<LineInfo> m_lines;
     std::vector<TextBlockInfo> m_textBlocks;
+    Lexer::TokensList m_layoutTokens;
     LineInfo m_currentLineInfo = {};
     TextBlockInfo m_currentBlockInfo = {};
     bool m_hasMetaBlock = false;
     nonstd::basic_string_view<CharT> m_metadata;
     std::string m_metadataType;
     SourceLocation m_metadataLocation;
-};
-
-template<typename T>
-KeywordsInfo ParserTraitsBase<T>::s_keywordsInfo[41] = {
-    { UNIVERSAL_STR("for"), Keyword::For },
-    { UNIVERSAL_STR("endfor"), Keyword::Endfor },
-    { UNIVERSAL_STR("in"), Keyword::In },
-    { UNIVERSAL_STR("if"), Keyword::If },
-    { UNIVERSAL_STR("else"), Keyword::Else },
-    { UNIVERSAL_STR("elif"), Keyword::ElIf },
-    { UNIVERSAL_STR("endif"), Keyword::EndIf },
-    { UNIVERSAL_STR("or"), Keyword::LogicalOr },
-    { UNIVERSAL_STR("and"), Keyword::LogicalAnd },
-    { UNIVERSAL_STR("not"), Keyword::LogicalNot },
-    { UNIVERSAL_STR("is"), Keyword::Is },
-    { UNIVERSAL_STR("block"), Keyword::Block },
-    { UNIVERSAL_STR("endblock"), Keyword::EndBlock },
-    { UNIVERSAL_STR("extends"), Keyword::Extends },
-    { UNIVERSAL_STR("macro"), Keyword::Macro },
-    { UNIVERSAL_STR("endmacro"), Keyword::EndMacro },
-    { UNIVERSAL_STR("call"), Keyword::Call },
-    { UNIVERSAL_STR("endcall"), Keyword::EndCall },
-    { UNIVERSAL_STR("filter"), Keyword::Filter },
-    { UNIVERSAL_STR("endfilter"), Keyword::EndFilter },
-    { UNIVERSAL_STR("set"), Keyword::Set },
-    { UNIVERSAL_STR("endset"), Keyword::EndSet },
-    { UNIVERSAL_STR("include"), Keyword::Include },
-    { UNIVERSAL_STR("import"), Keyword::Import },
-    { UNIVERSAL_STR("true"), Keyword::True },
-    { UNIVERSAL_STR("false"), Keyword::False },
-    { UNIVERSAL_STR("True"), Keyword::True },
-    { UNIVERSAL_STR("False"), Keyword::False },
-    { UNIVERSAL_STR("none"), Keyword::None },
-    { UNIVERSAL_STR("None"), Keyword::None },
-    { UNIVERSAL_STR("recursive"), Keyword::Recursive },
-    { UNIVERSAL_STR("scoped"), Keyword::Scoped },
-    { UNIVERSAL_STR("with"), Keyword::With },
-    { UNIVERSAL_STR("endwith"), Keyword::EndWith },
-    { UNIVERSAL_STR("without"), Keyword::Without },
-    { UNIVERSAL_STR("ignore"), Keyword::Ignore },
-    { UNIVERSAL_STR("missing"), Keyword::Missing },
-    { UNIVERSAL_STR("context"), Keyword::Context },
-    { UNIVERSAL_STR("from"), Keyword::From },
-    { UNIVERSAL_STR("as"), Keyword::As },
-    { UNIVERSAL_STR("do"), Keyword::Do },
+    // Names of the identifiers, keyed by their text in the template source
+    std::unordered_map<nonstd::basic_string_view<CharT>, std::string, NameHash> m_names;
+    std::shared_ptr<OwnedTextPool<CharT>> m_textPool = std::make_shared<OwnedTextPool<CharT>>();
 };
 
 template<typename T>
@@ -76,6 +76,7 @@ public:
     UserDefinedTester(std::string filterName, TesterParams params);
 
     bool Test(const InternalValue& baseVal, RenderContext& context) override;
+    bool InvokesCallables() const override {return true;}
 
 private:
     std::string m_testerName;
@@ -0,0 +1,144 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace jinja2
+{
+// Streaming implementation of the XXH64 non-cryptographic hash algorithm. Input is read in the native byte order, so results match
+// the reference implementation on little-endian platforms
+class XxHash64
+{
+public:
+    explicit XxHash64(uint64_t seed = 0)
+        : m_acc{seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1}
+        , m_seed(seed)
+    {
+    }
+
+    void Update(const void* data, size_t length)
+    {
+        auto ptr = static_cast<const uint8_t*>(data);
+        auto end = ptr + length;
+        m_totalLength += length;
+
+        if (m_bufferSize + length < StripeSize)
+        {
+            std::memcpy(m_buffer + m_bufferSize, ptr, length);
+            m_bufferSize += length;
+            return;
+        }
+
+        if (m_bufferSize != 0)
+        {
+            auto toFill = StripeSize - m_bufferSize;
+            std::memcpy(m_buffer + m_bufferSize, ptr, toFill);
+            ProcessStripe(m_buffer);
+            ptr += toFill;
+            m_bufferSize = 0;
+        }
+
+        for (; end - ptr >= static_cast<ptrdiff_t>(StripeSize); ptr += StripeSize)
+            ProcessStripe(ptr);
+
+        m_bufferSize = static_cast<size_t>(end - ptr);
+        std::memcpy(m_buffer, ptr, m_bufferSize);
+    }
+
+    uint64_t GetHash() const
+    {
+        uint64_t hash = 0;
+        if (m_totalLength >= StripeSize)
+        {
+            hash = Rotl(m_acc[0], 1) + Rotl(m_acc[1], 7) + Rotl(m_acc[2], 12) + Rotl(m_acc[3], 18);
+            for (auto acc : m_acc)
+                hash = MergeRound(hash, acc);
+        }
+        else
+        {
+            hash = m_seed + Prime5;
+        }
+
+        hash += m_totalLength;
+
+        const uint8_t* ptr = m_buffer;
+        const uint8_t* end = m_buffer + m_bufferSize;
+        for (; end - ptr >= 8; ptr += 8)
+        {
+            hash ^= Round(0, Read64(ptr));
+            hash = Rotl(hash, 27) * Prime1 + Prime4;
+        }
+        if (end - ptr >= 4)
+        {
+            hash ^= static_cast<uint64_t>(Read32(ptr)) * Prime1;
+            hash = Rotl(hash, 23) * Prime2 + Prime3;
+            ptr += 4;
+        }
+        for (; ptr != end; ++ ptr)
+        {
+            hash ^= *ptr * Prime5;
+            hash = Rotl(hash, 11) * Prime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= Prime2;
+        hash ^= hash >> 29;
+        hash *= Prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t Prime1 = 11400714785074694791ULL;
+    static constexpr uint64_t Prime2 = 14029467366897019727ULL;
+    static constexpr uint64_t Prime3 = 1609587929392839161ULL;
+    static constexpr uint64_t Prime4 = 9650029242287828579ULL;
+    static constexpr uint64_t Prime5 = 2870177450012600261ULL;
+    static constexpr size_t StripeSize = 32;
+
+    static uint64_t Rotl(uint64_t val, int bits) { return (val << bits) | (val >> (64 - bits)); }
+    static uint64_t Read64(const uint8_t* ptr)
+    {
+        uint64_t val;
+        std::memcpy(&val, ptr, sizeof(val));
+        return val;
+    }
+    static uint32_t Read32(const uint8_t* ptr)
+    {
+        uint32_t val;
+        std::memcpy(&val, ptr, sizeof(val));
+        return val;
+    }
+    static uint64_t Round(uint64_t acc, uint64_t input)
+    {
+        acc += input * Prime2;
+        acc = Rotl(acc, 31);
+        return acc * Prime1;
+    }
+    static uint64_t MergeRound(uint64_t acc, uint64_t val)
+    {
+        acc ^= Round(0, val);
+        return acc * Prime1 + Prime4;
+    }
+
+    void ProcessStripe(const uint8_t* ptr)
+    {
+        for (auto& acc : m_acc)
+        {
+            acc = Round(acc, Read64(ptr));
+            ptr += 8;
+        }
+    }
+
+private:
+    uint64_t m_acc[4];
+    uint64_t m_seed;
+    uint64_t m_totalLength = 0;
+    uint8_t m_buffer[StripeSize];
+    size_t m_bufferSize = 0;
+};
+} // jinja2
+
+#endif // XXHASH64_H
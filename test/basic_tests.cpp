@@ -1,10 +1,12 @@
 #include <iostream>
 #include <string>
+#include <sstream>
 
 #include "gtest/gtest.h"
 
 #include "jinja2cpp/template.h"
 #include "test_tools.h"
+#include "../src/template_layout.h"
 
 using namespace jinja2;
 
@@ -46,6 +48,14 @@ from Parser!)")
 {
 }
 
+MULTISTR_TEST(BasicMultiStrTest, OverlappedDelimiters, "{{ 42 }}}{% if true %}}{% endif %}{#}#}{{ '{{' }}{{ '}}' }}", "42}}{{}}")
+{
+}
+
+MULTISTR_TEST(BasicMultiStrTest, UnterminatedComment, "Hello World{# comment to skip", "Hello World")
+{
+}
+
 MULTISTR_TEST(BasicMultiStrTest, CommentedOutCodeSkip,
 R"(Hello World
 {#Comment to
@@ -647,4 +657,474 @@ from Parser!)";
 
 MULTISTR_TEST(BasicMultiStrTest, LiteralWithEscapeCharacters, R"({{ 'Hello\t\nWorld\n\twith\nescape\tcharacters!' }})", "Hello\t\nWorld\n\twith\nescape\tcharacters!")
 {
-}
\ No newline at end of file
+}
+TEST(BasicTests, StreamedRenderMatchesStringRender)
+{
+    std::string source = R"({% for i in range(2000) %}Line {{ i }} of the long document
+{% endfor %})";
+
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(source).has_value());
+
+    std::string expectedResult = tpl.RenderAsString(ValuesMap{}).value();
+    std::ostringstream os;
+    std::size_t emittedSize = 0;
+    ASSERT_TRUE(tpl.Render(os, ValuesMap{}, emittedSize).has_value());
+    EXPECT_EQ(expectedResult.size(), emittedSize);
+    EXPECT_EQ(expectedResult, os.str());
+}
+
+namespace
+{
+template<typename CharT>
+class RecordingSink : public IRenderSinkTpl<CharT>
+{
+public:
+    using string_t = std::basic_string<CharT>;
+
+    void WriteBuffer(const CharT* ptr, std::size_t length) override { pieces.push_back("B:" + ConvertString<std::string>(string_t(ptr, length))); }
+    void WriteInteger(int64_t val) override { pieces.push_back("I:" + std::to_string(val)); }
+    void WriteDouble(double val) override { pieces.push_back("D:" + std::to_string(val)); }
+    void WriteString(nonstd::basic_string_view<CharT> str) override { pieces.push_back("S:" + ConvertString<std::string>(str)); }
+
+    std::vector<std::string> pieces;
+};
+}
+
+TEST(BasicTests, RenderToSink)
+{
+    std::string source = R"(Hello {{ name }}: {{ 40 + 2 }} {{ 1.5 }} {{ flag }})";
+    std::vector<std::string> expectedResult = {"B:Hello ", "S:World", "B:: ", "I:42", "B: ", "D:1.500000", "B: ", "S:true"};
+
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(source).has_value());
+
+    RecordingSink<char> sink;
+    ASSERT_TRUE(tpl.Render(sink, {{"name", "World"}, {"flag", true}}).has_value());
+    EXPECT_EQ(expectedResult, sink.pieces);
+
+    TemplateW tplW;
+    ASSERT_TRUE(tplW.Load(ConvertString<std::wstring>(source)).has_value());
+
+    RecordingSink<wchar_t> sinkW;
+    ASSERT_TRUE(tplW.Render(sinkW, {{"name", "World"}, {"flag", true}}).has_value());
+    EXPECT_EQ(expectedResult, sinkW.pieces);
+}
+
+TEST(BasicTests, RenderAsSegments)
+{
+    std::string source = R"(Hello {{ name }}{{ '!' }} Static {% if true %}text{% endif %})";
+
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(source).has_value());
+
+    auto result = tpl.RenderAsSegments({{"name", "World"}});
+    ASSERT_TRUE(result.has_value());
+
+    // Constant '!' and the body of the constant 'if' are merged with the static text at load time. Merged text isn't a part of the
+    // template source, but it's kept by the template as well, so it isn't copied to the storage
+    auto& segments = result.value().segments;
+    ASSERT_EQ(3u, segments.size());
+    EXPECT_EQ("Hello ", segments[0]);
+    EXPECT_EQ("World", segments[1]);
+    EXPECT_EQ("! Static text", segments[2]);
+    EXPECT_EQ(segments[1].data(), result.value().storage->data());
+    EXPECT_EQ("World", *result.value().storage);
+
+    std::string joined;
+    for (auto& s : segments)
+        joined.append(s.data(), s.size());
+    EXPECT_EQ(tpl.RenderAsString({{"name", "World"}}).value(), joined);
+
+    Template dynamicTpl;
+    ASSERT_TRUE(dynamicTpl.Load(R"(Hello {{ name }}{{ mark }} Static {% if flag %}text{% endif %})").has_value());
+
+    ValuesMap params = {{"name", "World"}, {"mark", "!"}, {"flag", true}};
+    auto dynamicResult = dynamicTpl.RenderAsSegments(params);
+    ASSERT_TRUE(dynamicResult.has_value());
+
+    auto& dynamicSegments = dynamicResult.value().segments;
+    ASSERT_EQ(4u, dynamicSegments.size());
+    EXPECT_EQ("Hello ", dynamicSegments[0]);
+    EXPECT_EQ("World!", dynamicSegments[1]);
+    EXPECT_EQ(" Static ", dynamicSegments[2]);
+    EXPECT_EQ("text", dynamicSegments[3]);
+    EXPECT_EQ(dynamicSegments[1].data(), dynamicResult.value().storage->data());
+}
+
+TEST(BasicTests, RenderToExistingBuffer)
+{
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(R"({% for i in range(count) %}{{ i }},{% endfor %})").has_value());
+
+    std::string buffer = "Previous content";
+    ASSERT_TRUE(tpl.RenderAsString(buffer, {{"count", 500}}).has_value());
+    EXPECT_EQ(tpl.RenderAsString({{"count", 500}}).value(), buffer);
+
+    auto capacity = buffer.capacity();
+    ASSERT_TRUE(tpl.RenderAsString(buffer, {{"count", 3}}).has_value());
+    EXPECT_EQ("0,1,2,", buffer);
+    EXPECT_EQ(capacity, buffer.capacity());
+}
+
+TEST(BasicTests, ResumableRender)
+{
+    std::string source = R"(Header {{ title }}
+{% for i in range(3) %}{{ i }}{% endfor %}
+{% set x = 'ab' %}Middle {{ x }}
+Footer)";
+
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(source).has_value());
+
+    auto state = tpl.StartRender({{"title", "Report"}}, 8);
+    ASSERT_TRUE(state.has_value());
+
+    std::string result;
+    std::string chunk;
+    int chunksCount = 0;
+    while (!state.value().IsFinished())
+    {
+        ASSERT_TRUE(state.value().Resume(chunk).has_value());
+        result += chunk;
+        ++ chunksCount;
+    }
+
+    EXPECT_EQ(tpl.RenderAsString({{"title", "Report"}}).value(), result);
+    EXPECT_LT(1, chunksCount);
+}
+
+TEST(BasicTests, ResumableRenderWithinStatements)
+{
+    auto fs = std::make_shared<MemoryFileSystem>();
+    fs->AddFile("base", "<{% for i in range(count) %}{% block item %}{% endblock %};{% endfor %}>");
+    fs->AddFile("derived", "{% extends 'base' %}{% block item %}{% for j in range(3) %}{{ j }}{% endfor %}{% endblock %}");
+
+    TemplateEnv env;
+    env.AddFilesystemHandler(std::string(), fs);
+    auto tpl = env.LoadTemplate("derived").value();
+    ValuesMap params = {{"count", 50}};
+
+    // Loop of the parent template is suspended between the iterations. Overridden block is rendered at once
+    auto state = tpl.StartRender(params, 8);
+    ASSERT_TRUE(state.has_value());
+    std::string result;
+    std::string chunk;
+    size_t chunksCount = 0;
+    while (!state.value().IsFinished())
+    {
+        ASSERT_TRUE(state.value().Resume(chunk).has_value());
+        EXPECT_GE(8u, chunk.size());
+        result += chunk;
+        ++ chunksCount;
+    }
+
+    EXPECT_EQ(tpl.RenderAsString(params).value(), result);
+    EXPECT_EQ((result.size() + 7) / 8, chunksCount);
+
+    auto unfinished = tpl.StartRender(params, 8);
+    ASSERT_TRUE(unfinished.value().Resume(chunk).has_value());
+    EXPECT_EQ("<012;012", chunk);
+    EXPECT_FALSE(unfinished.value().IsFinished());
+
+    auto renderChunks = [](Template& tpl, const ValuesMap& params, size_t chunkSize) {
+        std::vector<std::string> chunks;
+        auto state = tpl.StartRender(params, chunkSize);
+        std::string chunk;
+        while (state && !state.value().IsFinished())
+        {
+            EXPECT_TRUE(state.value().Resume(chunk).has_value());
+            chunks.push_back(chunk);
+        }
+        return chunks;
+    };
+
+    Template branches;
+    ASSERT_TRUE(branches.Load("{% if flag %}{% for i in range(5) %}{{ i }}{% endfor %}{% else %}{% for i in ['a', 'b', 'c'] %}{{ i }}{% else %}no{% endfor %}{% endif %}").has_value());
+    EXPECT_EQ((std::vector<std::string>{"01", "23", "4"}), renderChunks(branches, {{"flag", true}}, 2));
+    EXPECT_EQ((std::vector<std::string>{"ab", "c"}), renderChunks(branches, {{"flag", false}}, 2));
+
+    // Macro call can't be suspended, so its output isn't split
+    Template macros;
+    ASSERT_TRUE(macros.Load("{% macro m() %}{% for i in range(5) %}{{ i }}{% endfor %}{% endmacro %}{{ m() }}-{{ m() }}").has_value());
+    EXPECT_EQ((std::vector<std::string>{"01234", "-01234"}), renderChunks(macros, {}, 2));
+}
+
+TEST(BasicTests, ResumableRenderError)
+{
+    TemplateEnv env;
+    env.AddFilesystemHandler(std::string(), std::make_shared<MemoryFileSystem>());
+    Template tpl(&env);
+    ASSERT_TRUE(tpl.Load("{% for i in range(10) %}{{ i }}{% endfor %}{% include 'missing' %}").has_value());
+
+    auto state = tpl.StartRender({}, 4);
+    ASSERT_TRUE(state.has_value());
+    std::string chunk;
+    ASSERT_TRUE(state.value().Resume(chunk).has_value());
+    EXPECT_EQ("0123", chunk);
+    ASSERT_TRUE(state.value().Resume(chunk).has_value());
+    EXPECT_EQ("4567", chunk);
+    auto result = state.value().Resume(chunk);
+    ASSERT_FALSE(result.has_value());
+    EXPECT_EQ(ErrorCode::TemplateNotFound, result.error().GetCode());
+    EXPECT_TRUE(state.value().IsFinished());
+    EXPECT_TRUE(state.value().Resume(chunk).has_value());
+    EXPECT_EQ("", chunk);
+}
+
+TEST(BasicTests, ConstantFolding)
+{
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(R"(Day: {{ 60 * 60 * 24 }}s {{ "a" ~ "b" }} {{ "x" | upper }}{% if false %}never{% elif 2 > 1 %} taken{% else %}else{% endif %}
+{% if 1 > 2 %}never{% elif flag %}flag{% else %}no flag{% endif %} {{ value * (2 + 3) }} {{ [3, 1, 2] | sort | first }})").has_value());
+
+    EXPECT_EQ("Day: 86400s ab X taken\nflag 50 1", tpl.RenderAsString({{"flag", true}, {"value", 10}}).value());
+    EXPECT_EQ("Day: 86400s ab X taken\nno flag 5 1", tpl.RenderAsString({{"flag", false}, {"value", 1}}).value());
+    EXPECT_EQ("Day: 86400s ab X taken\n", tpl.GetStaticPrefix().value());
+
+    auto segments = tpl.RenderAsSegments({{"flag", true}, {"value", 10}}).value();
+    ASSERT_LT(2u, segments.segments.size());
+    EXPECT_EQ("Day: ", segments.segments[0]);
+    EXPECT_EQ("86400", segments.segments[1]);
+    EXPECT_EQ("s ab X taken\n", segments.segments[2]);
+
+    RecordingSink<char> sink;
+    ASSERT_TRUE(tpl.Render(sink, {{"flag", false}, {"value", 1.5}}).has_value());
+    std::vector<std::string> expectedPieces = {"B:Day: ", "I:86400", "B:s ab X taken\n", "B:no flag", "B: ", "D:7.500000", "B: ", "I:1"};
+    EXPECT_EQ(expectedPieces, sink.pieces);
+
+    Template errorTpl;
+    ASSERT_TRUE(errorTpl.Load("{% if false %}{{ 1 / 0 }}{% endif %}{{ ([5, 5] | random) + 1 }}").has_value());
+    EXPECT_EQ("6", errorTpl.RenderAsString({}).value());
+}
+
+TEST(BasicTests, MergedStaticText)
+{
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(R"(Hello {# comment #}World{% raw %}, {{ raw }}{% endraw %}   {{- '!' }}
+{{ name }})").has_value());
+
+    RecordingSink<char> sink;
+    ASSERT_TRUE(tpl.Render(sink, {{"name", "Name"}}).has_value());
+    std::vector<std::string> expectedPieces = {"B:Hello World, {{ raw }}!\n", "S:Name"};
+    EXPECT_EQ(expectedPieces, sink.pieces);
+    EXPECT_EQ("Hello World, {{ raw }}!\nName", tpl.RenderAsString({{"name", "Name"}}).value());
+}
+
+TEST(BasicTests, StaticSlotResolution)
+{
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(R"({% set x = 'top' %}{% macro fact(n) %}{% if n > 1 %}{{ n }}*{{ fact(n - 1) }}{% else %}{{ n }}{% endif %}{% endmacro %}
+{{ fact(4) }}
+{% for x in ['a', 'b'] %}{{ x }}{% set x = x ~ '!' %}{{ x }}{% for y in [1] %}{{ x }}{{ y }}{{ loop.index }}{% endfor %};{% endfor %}{{ x }}
+{% for n in tree recursive %}{{ n.name }}{% set name = n.name %}{% if n.children %}({{ loop(n.children) }}){% endif %}{{ name }}{{ loop.depth }};{% endfor %}
+{% with x = 'with' %}{{ x }}{% endwith %} {{ x }})").has_value());
+
+    ValuesMap params = {
+        {"tree", ValuesList{ValuesMap{{"name", "a"}, {"children", ValuesList{ValuesMap{{"name", "b"}}}}}, ValuesMap{{"name", "c"}}}},
+    };
+    EXPECT_EQ("\n4*3*2*1\naa!a!11;bb!b!11;top\na(bb2;)a1;cc1;\nwith top", tpl.RenderAsString(params).value());
+}
+
+TEST(BasicTests, PrecompiledTemplates)
+{
+    auto makeEnv = [](std::shared_ptr<MemoryFileSystem>& fs) {
+        auto env = std::make_unique<TemplateEnv>();
+        fs = std::make_shared<MemoryFileSystem>();
+        fs->AddFile("main.j2tpl", "{% meta %}{\"title\": \"Main\"}{% endmeta %}{% for i in range(3) -%}\n  {{ i }}{# comment #}\n{%- endfor %} {% include 'inc.j2tpl' %}");
+        fs->AddFile("inc.j2tpl", "{% raw %}{{ raw }}{% endraw %} {{ name }}");
+        env->AddFilesystemHandler(std::string(), fs);
+        return env;
+    };
+
+    std::shared_ptr<MemoryFileSystem> fs;
+    auto env = makeEnv(fs);
+    ASSERT_TRUE(env->LoadTemplate("main.j2tpl").has_value());
+    ASSERT_TRUE(env->LoadTemplate("inc.j2tpl").has_value());
+
+    std::stringstream saved;
+    ASSERT_TRUE(env->SavePrecompiledTemplates(saved));
+    auto savedData = saved.str();
+
+    auto newEnv = makeEnv(fs);
+    std::istringstream input(savedData);
+    ASSERT_TRUE(newEnv->LoadPrecompiledTemplates(input));
+    auto tpl = newEnv->LoadTemplate("main.j2tpl").value();
+    EXPECT_EQ("  0  1  2 {{ raw }} Name", tpl.RenderAsString({{"name", "Name"}}).value());
+    EXPECT_EQ(env->LoadTemplate("main.j2tpl").value().RenderAsString({{"name", "Name"}}).value(), tpl.RenderAsString({{"name", "Name"}}).value());
+    auto metadata = tpl.GetMetadataRaw().value();
+    EXPECT_EQ(1u, metadata.location.line);
+    EXPECT_EQ(1u, metadata.location.col);
+    EXPECT_EQ("{\"title\": \"Main\"}", std::string(metadata.metadata.data(), metadata.metadata.size()));
+
+    // Changed source is parsed from scratch
+    auto changedEnv = makeEnv(fs);
+    fs->AddFile("inc.j2tpl", "{{ name }}!");
+    std::istringstream changedInput(savedData);
+    ASSERT_TRUE(changedEnv->LoadPrecompiledTemplates(changedInput));
+    EXPECT_EQ("  0  1  2 Name!", changedEnv->LoadTemplate("main.j2tpl").value().RenderAsString({{"name", "Name"}}).value());
+
+    std::istringstream truncated(savedData.substr(0, savedData.size() - 1));
+    EXPECT_FALSE(changedEnv->LoadPrecompiledTemplates(truncated));
+    std::istringstream wrongVersion(savedData.substr(0, 8) + std::string(4, '\xff') + savedData.substr(12));
+    EXPECT_FALSE(changedEnv->LoadPrecompiledTemplates(wrongVersion));
+}
+
+TEST(BasicTests, PrecompiledTemplatesValidation)
+{
+    auto fs = std::make_shared<MemoryFileSystem>();
+    fs->AddFile("main.j2tpl", "{% meta %}{}{% endmeta %}{% for i in range(3) %}{{ i + 10 }}{% endfor %}{# c #}\n{{ 'done' }}");
+    TemplateEnv env;
+    env.AddFilesystemHandler(std::string(), fs);
+    ASSERT_TRUE(env.LoadTemplate("main.j2tpl").has_value());
+    std::stringstream saved;
+    ASSERT_TRUE(env.SavePrecompiledTemplates(saved));
+    auto savedData = saved.str();
+
+    NamedTemplateLayouts layouts;
+    ASSERT_TRUE(ReadLayoutsFile(savedData, layouts));
+    ASSERT_EQ(1u, layouts.size());
+    const auto& layout = *layouts[0].second;
+    EXPECT_FALSE(layout.tokens.empty());
+
+    auto isAccepted = [&layouts](std::function<void (TemplateLayout&)> corrupt) {
+        auto copy = std::make_shared<TemplateLayout>(*layouts[0].second);
+        corrupt(*copy);
+        std::string data;
+        WriteLayoutsFile(data, {{layouts[0].first, copy}});
+        NamedTemplateLayouts result;
+        return ReadLayoutsFile(data, result);
+    };
+    EXPECT_TRUE(isAccepted([](TemplateLayout&) {}));
+    EXPECT_FALSE(isAccepted([](TemplateLayout& l) { l.blocks.back().type = TemplateLayout::MaxBlockType + 1; }));
+    EXPECT_FALSE(isAccepted([](TemplateLayout& l) { std::swap(l.blocks.front(), l.blocks.back()); }));
+    EXPECT_FALSE(isAccepted([](TemplateLayout& l) { l.blocks.back().endOffset = l.sourceLength + 1; }));
+    EXPECT_FALSE(isAccepted([](TemplateLayout& l) { ++ l.lines.back().lineNumber; }));
+    EXPECT_FALSE(isAccepted([](TemplateLayout& l) { l.hasMetaBlock = false; }));
+    EXPECT_FALSE(isAccepted([](TemplateLayout& l) { l.tokens.back().type = 0xffff; }));
+    EXPECT_FALSE(isAccepted([](TemplateLayout& l) { l.tokens.front().startOffset = 0; }));
+    EXPECT_FALSE(isAccepted([](TemplateLayout& l) { l.tokens.pop_back(); }));
+
+    // Any damaged byte either makes the file rejected or the template is still loaded from the source without crashes
+    for (size_t idx = 0; idx != savedData.size(); ++ idx)
+    {
+        auto damaged = savedData;
+        damaged[idx] = static_cast<char>(damaged[idx] ^ 0x5a);
+        TemplateEnv damagedEnv;
+        damagedEnv.AddFilesystemHandler(std::string(), fs);
+        std::istringstream input(damaged);
+        if (!damagedEnv.LoadPrecompiledTemplates(input))
+            continue;
+        auto tpl = damagedEnv.LoadTemplate("main.j2tpl");
+        if (tpl)
+            tpl.value().RenderAsString({});
+    }
+}
+
+TEST(BasicTests, RenderWithOutputHash)
+{
+    Template tpl;
+    ASSERT_TRUE(tpl.Load("a{{ 'b' }}{{ text }}").has_value());
+
+    uint64_t hash = 0;
+    EXPECT_EQ("abc", tpl.RenderAsString({{"text", "c"}}, hash).value());
+    EXPECT_EQ(0x44BC2CF5AD770999ULL, hash);
+
+    Template emptyTpl;
+    ASSERT_TRUE(emptyTpl.Load("").has_value());
+    EXPECT_EQ("", emptyTpl.RenderAsString({}, hash).value());
+    EXPECT_EQ(0xEF46DB3751D8E999ULL, hash);
+
+    Template loopTpl;
+    ASSERT_TRUE(loopTpl.Load("{% for i in range(count) %}{{ i }} - {{ i * 1.5 }};{% endfor %}").has_value());
+    Template rawTpl;
+    ASSERT_TRUE(rawTpl.Load(loopTpl.RenderAsString({{"count", 100}}).value()).has_value());
+    uint64_t rawHash = 0;
+    rawTpl.RenderAsString({}, rawHash);
+    loopTpl.RenderAsString({{"count", 100}}, hash);
+    EXPECT_EQ(rawHash, hash);
+    loopTpl.RenderAsString({{"count", 99}}, hash);
+    EXPECT_NE(rawHash, hash);
+}
+
+TEST(BasicTests, SpecializationOnGlobals)
+{
+    TemplateEnv env;
+    env.GetSettings().specializeOnGlobals = true;
+    env.AddGlobal("site", "Site");
+    env.AddGlobal("feature", true);
+
+    Template tpl(&env);
+    ASSERT_TRUE(tpl.Load("{{ site | upper }}{% if feature %} on{% else %} off{% endif %} {{ name }}{% set name = 'x' %}").has_value());
+
+    RecordingSink<char> sink;
+    ASSERT_TRUE(tpl.Render(sink, {{"name", "Name"}}).has_value());
+    std::vector<std::string> expectedPieces = {"B:SITE on ", "S:Name"};
+    EXPECT_EQ(expectedPieces, sink.pieces);
+
+    // Render params shadow the globals
+    EXPECT_EQ("OTHER off Name", tpl.RenderAsString({{"site", "Other"}, {"feature", false}, {"name", "Name"}}).value());
+
+    env.AddGlobal("feature", false);
+    EXPECT_EQ("SITE off Name", tpl.RenderAsString({{"name", "Name"}}).value());
+    env.RemoveGlobal("site");
+    EXPECT_EQ(" off Name", tpl.RenderAsString({{"name", "Name"}}).value());
+
+    // Variables which are assigned by the template aren't substituted
+    env.AddGlobal("name", "Global");
+    EXPECT_EQ(" off Name", tpl.RenderAsString({{"name", "Name"}}).value());
+    EXPECT_EQ(" off Global", tpl.RenderAsString({}).value());
+}
+
+TEST(BasicTests, SpecializationOnGlobalsForAllRenderings)
+{
+    TemplateEnv env;
+    env.GetSettings().specializeOnGlobals = true;
+    env.AddGlobal("site", "Site");
+    auto fs = std::make_shared<MemoryFileSystem>();
+    fs->AddFile("inc", "{{ site }}!");
+    fs->AddFile("base", "<{% block body %}{% endblock %}{{ site }}>");
+    env.AddFilesystemHandler(std::string(), fs);
+
+    // Included and parent templates are specialized unless the render params or the including template shadow the global
+    Template tpl(&env);
+    ASSERT_TRUE(tpl.Load("{% include 'inc' %}|{% set site = 'Local' %}{% include 'inc' %}").has_value());
+    RecordingSink<char> sink;
+    ASSERT_TRUE(tpl.Render(sink, {}).has_value());
+    std::vector<std::string> expectedPieces = {"B:Site!", "B:|", "S:Local", "B:!"};
+    EXPECT_EQ(expectedPieces, sink.pieces);
+
+    // Globals are substituted until the included template with the context can rebind them
+    fs->AddFile("setter", "{% set site = 'Local' %}");
+    Template including(&env);
+    ASSERT_TRUE(including.Load("{{ site | upper }}{% include 'setter' without context %}{{ site | upper }}{% include 'setter' %}{{ site | upper }}").has_value());
+    RecordingSink<char> includingSink;
+    ASSERT_TRUE(including.Render(includingSink, {}).has_value());
+    expectedPieces = {"B:SITE", "B:SITE", "S:LOCAL"};
+    EXPECT_EQ(expectedPieces, includingSink.pieces);
+    ASSERT_TRUE(including.Load("{% macro m() %}{{ site }}{% endmacro %}{{ m() }}{% include 'setter' %}{{ m() }}").has_value());
+    EXPECT_EQ("SiteLocal", including.RenderAsString({}).value());
+
+    Template derived(&env);
+    ASSERT_TRUE(derived.Load("{% extends 'base' %}{% block body %}{{ site | lower }}{% endblock %}").has_value());
+    RecordingSink<char> derivedSink;
+    ASSERT_TRUE(derived.Render(derivedSink, {}).has_value());
+    expectedPieces = {"B:<", "S:site", "B:Site>"};
+    EXPECT_EQ(expectedPieces, derivedSink.pieces);
+    // Not scoped block doesn't see the render params
+    EXPECT_EQ("<siteOther>", derived.RenderAsString({{"site", "Other"}}).value());
+
+    Template blocks(&env);
+    ASSERT_TRUE(blocks.Load("{% block title %}{{ site | upper }}{% endblock %}").has_value());
+    EXPECT_EQ("SITE", blocks.RenderBlock("title", {}).value());
+    EXPECT_EQ("OTHER", blocks.RenderBlock("title", {{"site", "Other"}}).value());
+
+    // Chunked rendering keeps the globals snapshot which is taken on start
+    auto state = blocks.StartRender({}, 1);
+    ASSERT_TRUE(state.has_value());
+    env.AddGlobal("site", "Changed");
+    std::string chunk;
+    ASSERT_TRUE(state.value().Resume(chunk).has_value());
+    EXPECT_EQ("SITE", chunk);
+    EXPECT_EQ("CHANGED", blocks.RenderAsString({}).value());
+}
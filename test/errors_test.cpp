@@ -1,5 +1,6 @@
 #include <iostream>
 #include <string>
+#include <sstream>
 
 #include "test_tools.h"
 #include "jinja2cpp/template.h"
@@ -59,6 +60,21 @@ TEST_F(TemplateEnvFixture, EnvironmentAbsentErrorsTest_Wide)
     EXPECT_EQ(L"noname.j2tpl:1:4: error: Template environment doesn't set\n{% import 'module' %}\n---^-------", ErrorToString(parseResult.error()));
 }
 
+TEST(ErrorsTests, StreamedRenderPartialOutput)
+{
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(R"(Hello {{ name }}!{{ foo() }} Never rendered)").has_value());
+
+    std::ostringstream os;
+    std::size_t emittedSize = 0;
+    auto renderResult = tpl.Render(os, {{"name", "World"}, {"foo", MakeCallable([]() -> Value {throw std::runtime_error("Bang!"); })}}, emittedSize);
+    ASSERT_FALSE(renderResult.has_value());
+
+    EXPECT_EQ("noname.j2tpl:1:1: error: Unexpected exception occurred during template processing. Exception: Bang!\n", ErrorToString(renderResult.error()));
+    EXPECT_EQ("Hello World!", os.str());
+    EXPECT_EQ(12u, emittedSize);
+}
+
 TEST_F(TemplateEnvFixture, RenderErrorsTest)
 {
     Template tpl1;
@@ -183,6 +199,67 @@ TEST_F(TemplateEnvFixture, ErrorPropagationTest_Wide)
     EXPECT_EQ(L"module:1:8: error: Identifier expected\n{% for %}\n    ---^-------", ErrorToString(renderResult.error()));
 }
 
+TEST_F(TemplateEnvFixture, RenderLimitsTest)
+{
+    AddFile("self_include", "{% include 'self_include' %}");
+    auto& limits = m_env.GetSettings().renderLimits;
+    limits.maxLoopIterations = 10;
+
+    Template tpl1(&m_env);
+    ASSERT_TRUE(tpl1.Load("{% for i in range(count) %}{{ i }}{% endfor %}").has_value());
+    EXPECT_EQ("0123456789", tpl1.RenderAsString({{"count", 10}}).value());
+    auto renderResult = tpl1.RenderAsString({{"count", 11}});
+    ASSERT_FALSE(renderResult.has_value());
+    EXPECT_EQ("noname.j2tpl:1:1: error: Render limit exceeded: maxLoopIterations\n", ErrorToString(renderResult.error()));
+
+    // Template takes the limits from the environment settings when it's created
+    limits = Settings::RenderLimits();
+    limits.maxOutputSize = 5;
+    EXPECT_FALSE(tpl1.RenderAsString({{"count", 11}}).has_value());
+    Template tpl5(&m_env);
+    ASSERT_TRUE(tpl5.Load("{% for i in range(count) %}{{ i }}{% endfor %}").has_value());
+    std::ostringstream os;
+    std::size_t emittedSize = 0;
+    auto streamResult = tpl5.Render(os, {{"count", 10}}, emittedSize);
+    ASSERT_FALSE(streamResult.has_value());
+    EXPECT_EQ("noname.j2tpl:1:1: error: Render limit exceeded: maxOutputSize\n", ErrorToString(streamResult.error()));
+    EXPECT_EQ("01234", os.str());
+    // Output which is captured by the blocks and the macro calls is counted as well
+    Template tpl6(&m_env);
+    ASSERT_TRUE(tpl6.Load("{% set s %}{% for i in range(count) %}{{ i }}{% endfor %}{% endset %}{{ s }}").has_value());
+    EXPECT_EQ("01", tpl6.RenderAsString({{"count", 2}}).value());
+    EXPECT_FALSE(tpl6.RenderAsString({{"count", 10}}).has_value());
+    Template tpl7(&m_env);
+    ASSERT_TRUE(tpl7.Load("{% macro m() %}{% for i in range(count) %}{{ i }}{% endfor %}{% endmacro %}{% set s = m() %}").has_value());
+    EXPECT_EQ("", tpl7.RenderAsString({{"count", 5}}).value());
+    renderResult = tpl7.RenderAsString({{"count", 10}});
+    ASSERT_FALSE(renderResult.has_value());
+    EXPECT_EQ("noname.j2tpl:1:1: error: Render limit exceeded: maxOutputSize\n", ErrorToString(renderResult.error()));
+
+    limits = Settings::RenderLimits();
+    limits.maxCallDepth = 20;
+    Template tpl2(&m_env);
+    ASSERT_TRUE(tpl2.Load("{% macro m(n) %}{% if n > 0 %}{{ m(n - 1) }}{% endif %}{{ n }}{% endmacro %}{{ m(depth) }}").has_value());
+    EXPECT_EQ("0123", tpl2.RenderAsString({{"depth", 3}}).value());
+    renderResult = tpl2.RenderAsString({{"depth", 100}});
+    ASSERT_FALSE(renderResult.has_value());
+    EXPECT_EQ("noname.j2tpl:1:1: error: Render limit exceeded: maxCallDepth\n", ErrorToString(renderResult.error()));
+
+    Template tpl3(&m_env);
+    ASSERT_TRUE(tpl3.Load("{% include 'self_include' %}").has_value());
+    renderResult = tpl3.RenderAsString({});
+    ASSERT_FALSE(renderResult.has_value());
+    EXPECT_EQ(ErrorCode::RenderLimitExceeded, renderResult.error().GetCode());
+
+    limits = Settings::RenderLimits();
+    limits.timeout = std::chrono::milliseconds(1);
+    Template tpl4(&m_env);
+    ASSERT_TRUE(tpl4.Load("{% for i in range(10000) %}{% for j in range(10000) %}{{ j }}{% endfor %}{% endfor %}").has_value());
+    renderResult = tpl4.RenderAsString({});
+    ASSERT_FALSE(renderResult.has_value());
+    EXPECT_EQ("noname.j2tpl:1:1: error: Render limit exceeded: timeout\n", ErrorToString(renderResult.error()));
+}
+
 TEST_P(ErrorsGenericTest, Test)
 {
     auto& testParam = GetParam();
@@ -494,6 +571,27 @@ INSTANTIATE_TEST_CASE_P(StatementsTest_2, ErrorsGenericTest, ::testing::Values(
     InputOutputPair{ "{% meta %}", "noname.j2tpl:1:11: error: Expected end of meta block\n{% meta %}\n       ---^-------" },
     InputOutputPair{ "{% endmeta %}", "noname.j2tpl:1:1: error: Unexpected meta block end\n{% endmeta %}\n^-------" }));
 
+INSTANTIATE_TEST_CASE_P(RoughScannerTest, ErrorsGenericTest, ::testing::Values(
+                            InputOutputPair{"{%raw%}x{%endraw%}",
+                                            "noname.j2tpl:1:3: error: Unexpected token: 'raw'\n{%raw%}x{%endraw%}\n--^-------"},
+                            InputOutputPair{"{% raw+ %}x{% endraw %}",
+                                            "noname.j2tpl:1:12: error: Unexpected raw block end\n{% raw+ %}x{% endraw %}\n        ---^-------"},
+                            InputOutputPair{"{% raw %}x{% endraw%}",
+                                            "noname.j2tpl:1:22: error: Expected end of raw block\n{% raw %}x{% endraw%}\n                  ---^-------"},
+                            InputOutputPair{"{% raw %}abc{% endraw",
+                                            "noname.j2tpl:1:22: error: Expected end of raw block\n{% raw %}abc{% endraw\n                  ---^-------"},
+                            InputOutputPair{"{%- meta %}{}{% endmeta %}",
+                                            "noname.j2tpl:1:14: error: Unexpected meta block end\n{%- meta %}{}{% endmeta %}\n          ---^-------"},
+                            InputOutputPair{"{{{ x }}}",
+                                            "noname.j2tpl:1:5: error: String expected\n{{{ x }}}\n ---^-------"},
+                            InputOutputPair{"{% if true %%}{% endif %}",
+                                            "noname.j2tpl:1:7: error: Expected expression, got: 'true'\n{% if true %%}{% endif %}\n   ---^-------"},
+                            InputOutputPair{"{{ x }}%}}",
+                                            "noname.j2tpl:1:8: error: Unexpected statement block end\n{{ x }}%}\n    ---^-------"},
+                            InputOutputPair{"{%}",
+                                            "noname.j2tpl:1:3: error: Unexpected token: '}'\n{%}\n--^-------"}
+                            ));
+
 INSTANTIATE_TEST_CASE_P(ExtensionStatementsTest, ErrorsGenericExtensionsTest, ::testing::Values(
                             InputOutputPair{"{% do %}",
                                             "noname.j2tpl:1:7: error: Unexpected token: '<<End of block>>'\n{% do %}\n   ---^-------"},
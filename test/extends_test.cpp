@@ -270,3 +270,44 @@ R"({% extends "base.j2tpl" %}{% block body %}->{{ testMacro('RegularMacroText')
     expectedResult = R"(->#REGULARMACROTEXT#<-)";
     EXPECT_STREQ(expectedResult.c_str(), result.c_str());
 }
+
+TEST_F(ExtendsTest, RenderSingleBlock)
+{
+    m_templateFs->AddFile("base.j2tpl", R"(Header {{ header() }}{% block b1 %}Base b1{% endblock %}{% block b2 %}Base b2 {% block b3 %}-Base b3-{% endblock %}{% endblock %})");
+    m_templateFs->AddFile("middle.j2tpl", R"({% extends "base.j2tpl" %}{% block b2 %}Middle b2 [{{ super() }}]{% endblock %})");
+    m_templateFs->AddFile("derived.j2tpl", R"({% extends "middle.j2tpl" %}{% block b3 %}Derived b3{% endblock %}{% block b1 %}Derived b1{% endblock %})");
+
+    auto baseTpl = m_env.LoadTemplate("base.j2tpl").value();
+    auto tpl = m_env.LoadTemplate("derived.j2tpl").value();
+
+    jinja2::ValuesMap params{{"name", "World"}};
+    EXPECT_EQ("Base b1", baseTpl.RenderBlock("b1", params).value());
+    EXPECT_EQ("Base b2 -Base b3-", baseTpl.RenderBlock("b2", params).value());
+    EXPECT_EQ("Derived b1", tpl.RenderBlock("b1", params).value());
+    EXPECT_EQ("Middle b2 [Base b2 Derived b3]", tpl.RenderBlock("b2", params).value());
+    EXPECT_EQ("Derived b3", tpl.RenderBlock("b3", params).value());
+
+    auto result = tpl.RenderBlock("b4", params);
+    ASSERT_FALSE(result.has_value());
+    EXPECT_EQ("derived.j2tpl:1:1: error: Block not found: b4\n", ErrorToString(result.error()));
+}
+
+TEST_F(ExtendsTest, StaticPrefix)
+{
+    m_templateFs->AddFile("base.j2tpl", R"(<html>{% block head %}<head>Static head</head>{% endblock %}<body>{% block body %}{% endblock %}{{ footer }})");
+    m_templateFs->AddFile("derived.j2tpl", R"({% extends "base.j2tpl" %}{% block body %}Hello {{ name }}!{% endblock %})");
+    m_templateFs->AddFile("derived_head.j2tpl", R"({% extends "base.j2tpl" %}{% block head %}<head>{{ title }}</head>{% endblock %})");
+
+    auto baseTpl = m_env.LoadTemplate("base.j2tpl").value();
+    auto tpl = m_env.LoadTemplate("derived.j2tpl").value();
+    auto headTpl = m_env.LoadTemplate("derived_head.j2tpl").value();
+
+    EXPECT_EQ("<html><head>Static head</head><body>", baseTpl.GetStaticPrefix().value());
+    EXPECT_EQ("<html><head>Static head</head><body>", tpl.GetStaticPrefix().value());
+    EXPECT_EQ("<html>", headTpl.GetStaticPrefix().value());
+
+    std::string result = tpl.RenderAsString({{"footer", "Footer"}}).value();
+    EXPECT_EQ(0u, result.find(tpl.GetStaticPrefix().value()));
+    result = headTpl.RenderAsString({{"footer", "Footer"}}).value();
+    EXPECT_EQ(0u, result.find(headTpl.GetStaticPrefix().value()));
+}
@@ -292,3 +292,60 @@ Line8
     EXPECT_EQ(test2Content, tpl2.RenderAsString({}).value());
 }
 
+
+TEST_F(FilesystemHandlerTest, TestPreloadTemplates)
+{
+    jinja2::MemoryFileSystem fs;
+    std::vector<std::string> fileNames;
+    for (int idx = 0; idx != 20; ++ idx)
+    {
+        auto fileName = "test" + std::to_string(idx) + ".j2tpl";
+        fs.AddFile(fileName, "Template " + std::to_string(idx) + ": {{ value }}");
+        fileNames.push_back(fileName);
+    }
+    fs.AddFile("broken.j2tpl", "{% for %}");
+    fileNames.push_back("broken.j2tpl");
+    fileNames.push_back("missing.j2tpl");
+
+    jinja2::TemplateEnv env;
+    env.AddFilesystemHandler("", fs);
+    auto errors = env.PreloadTemplates(fileNames, 4);
+
+    EXPECT_EQ(2u, errors.size());
+    EXPECT_EQ(1u, errors.count("broken.j2tpl"));
+    ASSERT_EQ(1u, errors.count("missing.j2tpl"));
+    EXPECT_EQ(jinja2::ErrorCode::FileNotFound, errors.at("missing.j2tpl").GetCode());
+
+    // Preloaded templates are taken from the cache
+    fs.AddFile("test7.j2tpl", "Changed");
+    auto tpl = env.LoadTemplate("test7.j2tpl").value();
+    EXPECT_EQ("Template 7: 42", tpl.RenderAsString({{"value", 42}}).value());
+}
+
+TEST_F(FilesystemHandlerTest, TestPreloadTemplatesHandlerThrows)
+{
+    struct ThrowingFileSystem : jinja2::MemoryFileSystem
+    {
+        jinja2::CharFileStreamPtr OpenStream(const std::string& name) const override
+        {
+            if (name == "throwing.j2tpl")
+                throw std::runtime_error("Disk is on fire");
+            return jinja2::MemoryFileSystem::OpenStream(name);
+        }
+    };
+
+    auto fs = std::make_shared<ThrowingFileSystem>();
+    fs->AddFile("good.j2tpl", "Good");
+    fs->AddFile("throwing.j2tpl", "Never loaded");
+
+    jinja2::TemplateEnv env;
+    env.AddFilesystemHandler("", fs);
+    auto errors = env.PreloadTemplates({"good.j2tpl", "throwing.j2tpl", "good.j2tpl"}, 2);
+
+    ASSERT_EQ(1u, errors.size());
+    ASSERT_EQ(1u, errors.count("throwing.j2tpl"));
+    auto& error = errors.at("throwing.j2tpl");
+    EXPECT_EQ(jinja2::ErrorCode::UnexpectedException, error.GetCode());
+    ASSERT_EQ(1u, error.GetExtraParams().size());
+    EXPECT_EQ("Disk is on fire", error.GetExtraParams()[0].asString());
+}
@@ -508,6 +508,14 @@ INSTANTIATE_TEST_CASE_P(Escape, FilterGenericTest, ::testing::Values(
                             InputOutputPair{"'\\\"\\'' | escape | pprint", "'&#34;&#39;'"}
                             ));
 
+INSTANTIATE_TEST_CASE_P(StringConvertersChain, FilterGenericTest, ::testing::Values(
+                            InputOutputPair{"'  Hello-World  ' | trim | lower | replace('-', ' ') | pprint", "'hello world'"},
+                            InputOutputPair{"'  Some Long Title Here ' | trim | upper | truncate(9, leeway=0) | pprint", "'SOME LONG...'"},
+                            InputOutputPair{"'<b>a&amp;b</b>' | striptags | escape | center(11) | pprint", "'  a&amp;b  '"},
+                            InputOutputPair{"'a b' | upper | urlencode | lower | pprint", "'a+b'"},
+                            InputOutputPair{"' hello  world ' | trim | title | wordcount", "2"}
+                            ));
+
 INSTANTIATE_TEST_CASE_P(Batch, FilterGenericTest, ::testing::Values(
                             InputOutputPair{
                                 "[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16] | batch(linecount=3) | pprint",
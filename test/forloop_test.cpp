@@ -344,6 +344,26 @@ length=3, index=3, index0=2, first=false, last=true, previtem=1, nextitem=;
     };
 }
 
+MULTISTR_TEST(ForLoopTest, LoopVariableIndirectUse,
+R"(
+{% macro pos() %}{{ loop.index }}{% endmacro %}
+{% for i in outers %}{{ pos() }}{% endfor %}
+{% for i in outers %}{% for j in [loop.index] %}{{ j }}{% endfor %}{% for j in inners %}{{ j }}{% endfor %};{% endfor %}
+)",
+//--------------
+R"(
+
+123
+101;201;301;
+)"
+)
+{
+    params = {
+        {"outers", ValuesList{0, 1, 2} },
+        {"inners", ValuesList{0, 1}}
+    };
+}
+
 MULTISTR_TEST(ForLoopTest, SimpleNestedLoop,
 R"(
 {% for i in outers %}a[{{i}}] = image[{{i}}];
@@ -21,6 +21,7 @@ protected:
 )");
         AddFile("header", "[{{ foo }}|{{ 23 }}]");
         AddFile("o_printer", "({{ o }})");
+        AddFile("o_module", "{% set o = {'a'={'b'=2}} %}");
     }
 };
 
@@ -56,6 +57,28 @@ TEST_F(ImportTest, TestContextImports)
     EXPECT_EQ("[42|23]", result);
 }
 
+TEST_F(ImportTest, TestImportsWithLocalMacros)
+{
+    jinja2::ValuesMap params{{"foo", 42}};
+
+    auto result = Render(R"({% macro item(v) %}<{{ v }}>{% endmacro %}{% import "module" as m %}{% from "module" import test_set %}{{ item(1) }}{{ m.test() }}{{ test_set() }}{{ item(2) }})", params);
+    EXPECT_EQ("<1>[|23][|56]<2>", result);
+    result = Render(R"({% macro test() %}local{% endmacro %}{{ test() }}{% from "module" import test %}{{ test() }})", params);
+    EXPECT_EQ("local[|23]", result);
+    result = Render(R"({% macro m() %}local{% endmacro %}{{ m() }}{% import "module" as m %}{{ m.test() }})", params);
+    EXPECT_EQ("local[|23]", result);
+}
+
+TEST_F(ImportTest, TestImportRebindsMemoizedPath)
+{
+    jinja2::ValuesMap params{{"o", jinja2::ValuesMap{{"a", jinja2::ValuesMap{{"b", 1}}}}}};
+
+    auto result = Render(R"({{ o.a.b }}{{ o.a.b }}{% from "o_module" import o %}{{ o.a.b }}{{ o.a.b }})", params);
+    EXPECT_EQ("1122", result);
+    result = Render(R"({{ o.a.b }}{{ o.a.b }}{% import "o_module" as o %}{{ o.o.a.b }}{{ o.o.a.b }})", params);
+    EXPECT_EQ("1122", result);
+}
+
 TEST_F(ImportTest, TestImportSyntax)
 {
     Load(R"({% from "foo" import bar %})");
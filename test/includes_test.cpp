@@ -145,3 +145,25 @@ R"({% macro outer(o) %}
 
     EXPECT_EQ("\n\n\n\n(FOO)\n", result);
 }
+
+TEST_F(IncludeTest, TestContextIncludeRebindsMacro)
+{
+    AddFile("macro_printer", "{% macro printer(v) %}<{{ v }}>{% endmacro %}");
+    auto result = Render(
+R"({% macro printer(v) %}({{ v }}){% endmacro %}{{ printer(1) }}
+{%- include "macro_printer" %}{{ printer(2) }}
+{%- include "macro_printer" without context %}{{ printer(3) }})");
+
+    EXPECT_EQ("(1)<2><3>", result);
+}
+
+TEST_F(IncludeTest, TestContextIncludeRebindsMemoizedPath)
+{
+    AddFile("o_setter", "{% set o = {'a'={'b'=2}} %}");
+    jinja2::ValuesMap params{{"o", jinja2::ValuesMap{{"a", jinja2::ValuesMap{{"b", 1}}}}}};
+
+    auto result = Render(R"({{ o.a.b }}{{ o.a.b }}{% include "o_setter" without context %}{{ o.a.b }}{% include "o_setter" %}{{ o.a.b }}{{ o.a.b }})", params);
+    EXPECT_EQ("11122", result);
+    result = Render(R"({{ o.a.b }}{{ o.a.b }}{% for i in [1] %}{% include "o_setter" %}{{ o.a.b }}{% endfor %}{{ o.a.b }})", params);
+    EXPECT_EQ("1121", result);
+}
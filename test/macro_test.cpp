@@ -233,3 +233,39 @@ kwargs: {'extraValue': 5}
 {
     params = PrepareTestData();
 }
+
+MULTISTR_TEST(MacroTest, InlinedMacroCalls,
+R"(
+{% macro item(value, prefix='-', suffix) %}{{ prefix }}{{ value }}{{ suffix }}{% endmacro %}
+{% macro list(items) %}{% for i in items %}{{ item(i, suffix=';') }}{% endfor %}{% endmacro %}
+{% macro info() %}{{ name }}:{{ varargs | length }}{% endmacro %}
+{{ item('a') }}|{{ item('b', '+', '!') }}|{{ list([1, 2]) }}|{{ info(1, 2) }}
+{% set suffix = '?' %}{{ item('c') }}
+)",
+//--------------
+R"(
+
+
+
+-a|+b!|-1;-2;|info:2
+-c?
+)"
+)
+{
+    params = PrepareTestData();
+}
+
+MULTISTR_TEST(MacroTest, InlinedMacroIntrospectionParams,
+R"(
+{% macro item(name, arguments, defaults='d') %}{{ name }}|{{ arguments }}|{{ defaults }}{% endmacro %}
+{{ item('a', 'b') }}
+)",
+//--------------
+R"(
+
+a|b|d
+)"
+)
+{
+    params = PrepareTestData();
+}
@@ -53,6 +53,19 @@ TEST(MetadataTest, Metadata_TagWithSpaces)
     EXPECT_EQ("Hello World!", renderResult.value());
 }
 
+TEST(MetadataTest, Metadata_TagWithWhitespaceVariants)
+{
+    constexpr auto source = "{% meta\t%}{\"title\": \"Main\"}{%\r\nendmeta  %}Hello World!";
+
+    Template tpl;
+    auto parse_result = tpl.Load(source);
+    ASSERT_FALSE(!parse_result);
+    EXPECT_EQ("{\"title\": \"Main\"}", std::string(tpl.GetMetadataRaw().value().metadata));
+    auto renderResult = tpl.RenderAsString({});
+    EXPECT_FALSE(!renderResult);
+    EXPECT_EQ("Hello World!", renderResult.value());
+}
+
 TEST(MetadataTest, Metadata_Invalid)
 {
     constexpr auto source = R"(
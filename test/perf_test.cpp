@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <limits>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -15,6 +18,26 @@ constexpr int Iterations = 10000;
 #define PerfTests PerfTests
 #endif
 
+constexpr int Repetitions = 5;
+
+// Renders are split into the repetitions and the time of the best one is reported, so the timings taken on the noisy hosts
+// can be compared between the runs
+std::string MeasureRender(Template& tpl, const ValuesMap& params, int rendersCount)
+{
+    std::string result;
+    double bestTime = std::numeric_limits<double>::max();
+    for (int rep = 0; rep < Repetitions; ++ rep)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < rendersCount / Repetitions; ++ n)
+            result = tpl.RenderAsString(params).value();
+        bestTime = std::min(bestTime, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::cout << "Best of " << Repetitions << " repetitions: " << bestTime * Repetitions << " ms per " << rendersCount << " renders" << std::endl;
+    return result;
+}
+
 TEST(PerfTests, PlainText)
 {
     std::string source = "Hello World from Parser!";
@@ -32,8 +55,7 @@ TEST(PerfTests, PlainText)
     }
     std::cout << renderResult.value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 100; ++ n)
-        result = tpl.RenderAsString(params).value();
+    result = MeasureRender(tpl, params, Iterations * 100);
 
     std::cout << result << std::endl;
 }
@@ -49,8 +71,7 @@ TEST(PerfTests, SimpleSubstituteText)
 
     std::cout << tpl.RenderAsString(params).value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 100; ++ n)
-        result = tpl.RenderAsString(params).value();
+    result = MeasureRender(tpl, params, Iterations * 100);
 
     std::cout << result << std::endl;
 }
@@ -66,8 +87,7 @@ TEST(PerfTests, ValueSubstituteText)
 
     std::cout << tpl.RenderAsString(params).value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 100; ++ n)
-        result = tpl.RenderAsString(params).value();
+    result = MeasureRender(tpl, params, Iterations * 100);
 
     std::cout << result << std::endl;
 }
@@ -83,8 +103,7 @@ TEST(PerfTests, SimpleSubstituteFilterText)
 
     std::cout << tpl.RenderAsString(params).value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 100; ++ n)
-        result = tpl.RenderAsString(params).value();
+    result = MeasureRender(tpl, params, Iterations * 100);
 
     std::cout << result << std::endl;
 }
@@ -101,8 +120,7 @@ TEST(PerfTests, DoubleSubstituteText)
 
     std::cout << tpl.RenderAsString(params).value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 100; ++ n)
-        result = tpl.RenderAsString(params).value();
+    result = MeasureRender(tpl, params, Iterations * 100);
 
     std::cout << result << std::endl;
 }
@@ -124,8 +142,7 @@ TEST(PerfTests, ForLoopText)
     }
     std::cout << renderResult.value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 20; ++ n)
-        tpl.RenderAsString(params);
+    MeasureRender(tpl, params, Iterations * 20);
 
     std::cout << result << std::endl;
 }
@@ -141,8 +158,7 @@ TEST(PerfTests, ForLoopParamText)
 
     std::cout << tpl.RenderAsString(params).value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 20; ++ n)
-        result = tpl.RenderAsString(params).value();
+    result = MeasureRender(tpl, params, Iterations * 20);
 
     std::cout << result << std::endl;
 }
@@ -158,8 +174,7 @@ TEST(PerfTests, ForLoopIndexText)
 
     std::cout << tpl.RenderAsString(params).value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 20; ++ n)
-        result = tpl.RenderAsString(params).value();
+    result = MeasureRender(tpl, params, Iterations * 20);
 
     std::cout << result << std::endl;
 }
@@ -175,8 +190,7 @@ TEST(PerfTests, ForLoopIfText)
 
     std::cout << tpl.RenderAsString(params).value() << std::endl;
     std::string result;
-    for (int n = 0; n < Iterations * 20; ++ n)
-        result = tpl.RenderAsString(params).value();
+    result = MeasureRender(tpl, params, Iterations * 20);
 
     std::cout << result << std::endl;
 }
@@ -104,6 +104,50 @@ world: World
 
 using WithTest = BasicTemplateRenderer;
 
+MULTISTR_TEST(SetTest, RebindMemoizedPathTest,
+R"(
+{% set a = {'b'={'c'=1}} %}{{ a.b.c }}{{ a.b.c }}
+{% set a = {'b'={'c'=2}} %}{{ a.b.c }}
+{% for a in [{'b'={'c'=3}}, {'b'={'c'=4}}] %}{{ a.b.c }}{{ a.b.c }};{% endfor %}
+{{ a.b.c }}{{ obj.x.y }}{{ obj.x.y }}
+)",
+//--------------
+R"(
+11
+2
+33;44;
+255
+)")
+{
+    params = {
+        {"obj", ValuesMap{{"x", ValuesMap{{"y", 5}}}}},
+    };
+}
+
+TEST(PathMemoTest, CallableChangesMemoizedPathTest)
+{
+    std::string source = R"({{ data.strValue }}{{ setData('Inner Value') }}{{ data.strValue }})";
+
+    TestInnerStruct innerStruct;
+    innerStruct.strValue = "Outer Value";
+
+    ValuesMap params = {
+        {"data", Reflect(&innerStruct)},
+        {"setData", MakeCallable(
+            [&innerStruct](const std::string& val) -> Value {
+                innerStruct.strValue = val;
+                return " - ";
+            },
+            ArgInfo{"val"})
+        },
+    };
+
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(source));
+    std::string result = tpl.RenderAsString(params).value();
+    EXPECT_EQ("Outer Value - Inner Value", result);
+}
+
 MULTISTR_TEST(WithTest, SimpleTest,
 R"(
 {% with inner = 42 %}
@@ -442,6 +486,28 @@ TEST(RawTest, ForRaw)
     EXPECT_STREQ("{{ x }} {{ x }} {{ x }} ", result.c_str());
 }
 
+TEST(RawTest, ControlMarkers)
+{
+    const std::string source = R"({%+ raw -%}  a {{ b }}  {%- endraw +%}|)";
+
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(source));
+    const auto result = tpl.RenderAsString({}).value();
+    std::cout << result << std::endl;
+    EXPECT_STREQ("a {{ b }}|", result.c_str());
+}
+
+TEST(RawTest, WhitespaceVariants)
+{
+    const std::string source = "{%\traw\t%}{{ x }}{%\n endraw \r\n%}";
+
+    Template tpl;
+    ASSERT_TRUE(tpl.Load(source));
+    const auto result = tpl.RenderAsString({}).value();
+    std::cout << result << std::endl;
+    EXPECT_STREQ("{{ x }}", result.c_str());
+}
+
 TEST(RawTest, CommentRaw)
 {
     const std::string source = R"({# {% raw %} {% endraw %} #})";